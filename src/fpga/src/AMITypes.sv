@@ -155,6 +155,20 @@ typedef struct packed {
     ABDPacket data_packet;
 } ABDInternalPacket;
 
+// Per app memory counters, kept by AmorphOSMemStats
+parameter AMI_NUM_STATS_COUNTERS = 8;
+
+typedef struct packed {
+	logic [63:0] read_reqs;
+	logic [63:0] write_reqs;
+	logic [63:0] read_bytes;
+	logic [63:0] write_bytes;
+	logic [63:0] stall_cycles; // cycles with a request on any port left ungranted
+	logic [63:0] read_resps;
+	logic [63:0] read_latency; // outstanding reads summed every cycle, over read_resps is the mean latency
+	logic [63:0] cycles;       // since reset, the same for every app
+} AMIAppStats;
+
 // Soft Reg virtualiztion
 
 parameter VIRT_SOFTREG_RESP_Q_SIZE = (USE_SOFT_FIFO ? 4 : 9);
@@ -30,7 +30,9 @@ module AmorphOSMem
 	output AMIRequest                   ch2mem_inter_req_out[AMI_NUM_CHANNELS-1:0],
 	input                               ch2mem_inter_req_grant_in[AMI_NUM_CHANNELS-1:0],
 	input AMIResponse                   ch2mem_inter_resp_in[AMI_NUM_CHANNELS-1:0],
-	output                              ch2mem_inter_resp_grant_out[AMI_NUM_CHANNELS-1:0]
+	output                              ch2mem_inter_resp_grant_out[AMI_NUM_CHANNELS-1:0],
+	// Per app traffic counters, read by the OS
+	output AMIAppStats                  app_stats[AMI_NUM_APPS-1:0]
 );
 
 	// Enable signals
@@ -194,5 +196,17 @@ module AmorphOSMem
 			end
 		end
 	endgenerate
+
+	// Per app counters on the app facing side of the memory system
+	AmorphOSMemStats
+	memStats(
+		.clk (clk),
+		.rst (rst),
+		.mem_req_in        (mem_req_in),
+		.mem_req_grant_out (mem_req_grant_out),
+		.mem_resp_out      (mem_resp_out),
+		.mem_resp_grant_in (mem_resp_grant_in),
+		.app_stats         (app_stats)
+	);
 	
 endmodule
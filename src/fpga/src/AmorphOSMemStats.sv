@@ -0,0 +1,123 @@
+/*
+
+	Per app counters of the traffic on the AMI ports. Only watches the
+	handshakes between the apps and AmorphOSMem, so it adds no logic to
+	the request or response paths.
+
+	Requests and bytes are counted when granted, a stall cycle is one in
+	which any port of the app holds a request that is not granted. The
+	read latency is the number of outstanding reads summed every cycle,
+	divided by read_resps it is the mean latency of a read in cycles.
+
+*/
+
+import ShellTypes::*;
+import AMITypes::*;
+
+module AmorphOSMemStats
+(
+    // User clock and reset
+    input                               clk,
+    input                               rst,
+	// AMI interface to the apps, observed only
+	input AMIRequest					mem_req_in[AMI_NUM_APPS-1:0][AMI_NUM_PORTS-1:0],
+	input								mem_req_grant_out[AMI_NUM_APPS-1:0][AMI_NUM_PORTS-1:0],
+	input AMIResponse                   mem_resp_out[AMI_NUM_APPS-1:0][AMI_NUM_PORTS-1:0],
+	input                               mem_resp_grant_in[AMI_NUM_APPS-1:0][AMI_NUM_PORTS-1:0],
+	// Running counters
+	output AMIAppStats					app_stats[AMI_NUM_APPS-1:0]
+);
+
+	// Cycle counter shared by all apps
+	wire[63:0] cycles;
+	Counter64
+	cycle_cntr
+	(
+		.clk(clk),
+		.rst(rst),
+		.increment(1'b1),
+		.count(cycles)
+	);
+
+	// Enough for every port's tag queue to be full
+	localparam OUTSTANDING_BITS = 16;
+	localparam PORT_SUM_BITS    = $clog2(AMI_NUM_PORTS + 1);
+	localparam BYTE_SUM_BITS    = $clog2((AMI_NUM_PORTS * 64) + 1);
+
+	genvar app_num;
+	generate
+		for (app_num = 0; app_num < AMI_NUM_APPS; app_num = app_num + 1) begin : per_app_stats
+
+			reg[63:0] read_reqs;
+			reg[63:0] write_reqs;
+			reg[63:0] read_bytes;
+			reg[63:0] write_bytes;
+			reg[63:0] stall_cycles;
+			reg[63:0] read_resps;
+			reg[63:0] read_latency;
+			reg[OUTSTANDING_BITS-1:0] outstanding;
+
+			logic[PORT_SUM_BITS-1:0] new_reads;
+			logic[PORT_SUM_BITS-1:0] new_writes;
+			logic[PORT_SUM_BITS-1:0] new_resps;
+			logic[BYTE_SUM_BITS-1:0] new_read_bytes;
+			logic[BYTE_SUM_BITS-1:0] new_write_bytes;
+			logic                    stalled;
+
+			// What the app's ports did this cycle
+			always_comb begin : port_sum_logic
+				new_reads       = 0;
+				new_writes      = 0;
+				new_resps       = 0;
+				new_read_bytes  = 0;
+				new_write_bytes = 0;
+				stalled         = 1'b0;
+				for (int port_num = 0; port_num < AMI_NUM_PORTS; port_num = port_num + 1) begin
+					if (mem_req_in[app_num][port_num].valid && mem_req_grant_out[app_num][port_num]) begin
+						// A size of 0 is a full 64 byte beat
+						if (mem_req_in[app_num][port_num].isWrite) begin
+							new_writes      = new_writes + 1'b1;
+							new_write_bytes = new_write_bytes + ((mem_req_in[app_num][port_num].size == 0) ? 64 : mem_req_in[app_num][port_num].size);
+						end else begin
+							new_reads       = new_reads + 1'b1;
+							new_read_bytes  = new_read_bytes + ((mem_req_in[app_num][port_num].size == 0) ? 64 : mem_req_in[app_num][port_num].size);
+						end
+					end
+					if (mem_req_in[app_num][port_num].valid && !mem_req_grant_out[app_num][port_num]) begin
+						stalled = 1'b1;
+					end
+					if (mem_resp_out[app_num][port_num].valid && mem_resp_grant_in[app_num][port_num]) begin
+						new_resps = new_resps + 1'b1;
+					end
+				end
+			end
+
+			always @(posedge clk) begin : stats_update
+				if (rst) begin
+					read_reqs    <= 64'h0;
+					write_reqs   <= 64'h0;
+					read_bytes   <= 64'h0;
+					write_bytes  <= 64'h0;
+					stall_cycles <= 64'h0;
+					read_resps   <= 64'h0;
+					read_latency <= 64'h0;
+					outstanding  <= 0;
+				end else begin
+					read_reqs    <= read_reqs + new_reads;
+					write_reqs   <= write_reqs + new_writes;
+					read_bytes   <= read_bytes + new_read_bytes;
+					write_bytes  <= write_bytes + new_write_bytes;
+					stall_cycles <= stall_cycles + stalled;
+					read_resps   <= read_resps + new_resps;
+					read_latency <= read_latency + outstanding;
+					outstanding  <= outstanding + new_reads - new_resps;
+				end
+			end
+
+			assign app_stats[app_num] = '{read_reqs: read_reqs, write_reqs: write_reqs, read_bytes: read_bytes, write_bytes: write_bytes,
+			                              stall_cycles: stall_cycles, read_resps: read_resps, read_latency: read_latency, cycles: cycles};
+
+		end
+	endgenerate
+
+endmodule
@@ -0,0 +1,99 @@
+/*
+
+	Serves the SoftReg window reserved for the OS, in front of the app
+	SoftReg router. Requests inside the window never reach an app.
+
+	A write anywhere in the window latches the memory counters of every
+	app in the same cycle, so the host reads one consistent snapshot of
+	all slots. A read at (app << 6) + (counter << 3) into the window
+	returns the latched counter, in the order of AMIAppStats, one cycle
+	later or as soon as no app response is going out.
+
+*/
+
+import ShellTypes::*;
+import AMITypes::*;
+import AOSF1Types::*;
+
+module AmorphOSStatsSoftReg #(parameter SR_NUM_APPS = AMI_NUM_APPS)
+(
+    // User clock and reset
+    input                               clk,
+    input                               rst,
+	// Running counters of every app
+	input  AMIAppStats					app_stats[SR_NUM_APPS-1:0],
+	// Interface to Host
+	input  SoftRegReq					softreg_req,
+	output SoftRegResp					softreg_resp,
+	// Interface to the app SoftReg router
+	output SoftRegReq					app_softreg_req,
+	input  SoftRegResp					app_softreg_resp
+);
+
+	// The whole app field of the window, so apps past SR_NUM_APPS read 0 instead of aliasing lower ones
+	localparam APP_SELECT_BITS = F1_OS_STATS_SOFTREG_BITS - 6;
+
+	// Route around the window
+	wire in_window;
+	assign in_window = softreg_req.valid && (softreg_req.addr[31:F1_OS_STATS_SOFTREG_BITS] == F1_OS_STATS_SOFTREG_BASE[31:F1_OS_STATS_SOFTREG_BITS]);
+
+	SoftRegReq disabled_softreg_req;
+	assign disabled_softreg_req = '{valid: 1'b0, isWrite: 1'b0, addr: 32'h0, data: 64'h0};
+	assign app_softreg_req = in_window ? disabled_softreg_req : softreg_req;
+
+	// Latched counters
+	AMIAppStats snapshot[SR_NUM_APPS-1:0];
+
+	genvar app_num;
+	generate
+		for (app_num = 0; app_num < SR_NUM_APPS; app_num = app_num + 1) begin : snapshot_logic
+			always @(posedge clk) begin
+				if (rst) begin
+					snapshot[app_num] <= '0;
+				end else if (in_window && softreg_req.isWrite) begin
+					snapshot[app_num] <= app_stats[app_num];
+				end
+			end
+		end
+	endgenerate
+
+	// Counter selected by a read
+	wire[APP_SELECT_BITS-1:0] app_select;
+	wire[2:0]                 counter_select;
+	logic[63:0]               selected_counter;
+
+	assign app_select     = softreg_req.addr[6 +: APP_SELECT_BITS];
+	assign counter_select = softreg_req.addr[5:3];
+
+	always_comb begin : counter_select_logic
+		selected_counter = 64'h0;
+		if (app_select < SR_NUM_APPS) begin
+			case (counter_select)
+				3'd0 : selected_counter = snapshot[app_select].read_reqs;
+				3'd1 : selected_counter = snapshot[app_select].write_reqs;
+				3'd2 : selected_counter = snapshot[app_select].read_bytes;
+				3'd3 : selected_counter = snapshot[app_select].write_bytes;
+				3'd4 : selected_counter = snapshot[app_select].stall_cycles;
+				3'd5 : selected_counter = snapshot[app_select].read_resps;
+				3'd6 : selected_counter = snapshot[app_select].read_latency;
+				3'd7 : selected_counter = snapshot[app_select].cycles;
+			endcase
+		end
+	end
+
+	// Response to a window read, held while an app response goes out
+	SoftRegResp stats_resp;
+
+	always @(posedge clk) begin : stats_resp_update
+		if (rst) begin
+			stats_resp <= '{valid: 1'b0, data: 64'h0};
+		end else if (in_window && !softreg_req.isWrite) begin
+			stats_resp <= '{valid: 1'b1, data: selected_counter};
+		end else if (!app_softreg_resp.valid) begin
+			stats_resp <= '{valid: 1'b0, data: 64'h0};
+		end
+	end
+
+	assign softreg_resp = app_softreg_resp.valid ? app_softreg_resp : stats_resp;
+
+endmodule
@@ -31,6 +31,9 @@
 
 #define BACKLOG 128
 
+// INTIATE_SESSION data64 flag, ops that cannot get a slot return RETRY instead of waiting
+#define AOS_SESSION_NONBLOCKING 0x1
+
 using session_id_t = uint64_t;
 
 enum class aos_socket_command {
@@ -43,7 +46,10 @@ enum class aos_socket_command {
     BULKDATA_READ_REQUEST,
     BULKDATA_READ_RESPONSE,
     BULKDATA_WRITE_REQUEST,
-    BULKDATA_WRITE_RESPONSE
+    BULKDATA_WRITE_RESPONSE,
+    COMPLETION_EVENTFD_REQUEST,
+    GET_STATS,
+    GET_TRACE
 };
 
 
@@ -85,7 +91,8 @@ public:
         session_id(~0x0),
         connection_socket(0),
         connectionOpen(false),
-        intialized(false)
+        intialized(false),
+        blocking(true)
     {
         // Setup the struct needed to connect the aos daemon
         memset(&socket_name, 0, sizeof(struct sockaddr_un));
@@ -103,6 +110,7 @@ public:
         // Copy the app name into the char_buf
         strncpy(cmd_pckt.char_buf, app_name.c_str(), app_name.length());
         cmd_pckt.char_buf[app_name.length()] = '\0';
+        cmd_pckt.data64 = blocking ? 0 : AOS_SESSION_NONBLOCKING;
         // send over the request
         writeCommandPacket(cmd_pckt);
         // read the response packet
@@ -280,11 +288,16 @@ public:
             closeSocket();
             return resp_pckt.errorcode;
         }
-        // Receive the data from
+        // Receive the data, a large read does not fit the socket buffer in one go
         uint64_t numBytes = resp_pckt.numBytes;
-        if (read(connection_socket, buf, numBytes) == -1) {
-        	closeSocket();
-        	return aos_errcode::SOCKET_FAILURE;
+        uint64_t received = 0;
+        while (received < numBytes) {
+            const ssize_t num_read = read(connection_socket, (char *)buf + received, numBytes - received);
+            if (num_read <= 0) {
+                closeSocket();
+                return aos_errcode::SOCKET_FAILURE;
+            }
+            received += num_read;
         }
 
         // close the socket
@@ -292,6 +305,55 @@ public:
         return aos_errcode::SUCCESS;
     }
 
+    /*
+    Returns an eventfd that the daemon signals every time the app bound to this
+    session raises its completion interrupt. The fd can be waited on with
+    poll/epoll and read as an 8 byte counter, see eventfd(2). The client owns
+    the returned descriptor and is responsible for closing it.
+    */
+    aos_errcode aos_completion_eventfd(int & event_fd) {
+        assert(intialized);
+        // Open the socket
+        openSocket();
+        // Create the packet
+        aos_socket_command_packet cmd_pckt;
+        cmd_pckt.command_type = aos_socket_command::COMPLETION_EVENTFD_REQUEST;
+        cmd_pckt.session_id = session_id;
+        // send over the request
+        writeCommandPacket(cmd_pckt);
+        // read the response packet, the eventfd rides along as ancillary data
+        aos_socket_response_packet resp_pckt;
+        event_fd = -1;
+        if (readResponsePacketWithFd(resp_pckt, event_fd) != 0) {
+            closeSocket();
+            return aos_errcode::SOCKET_FAILURE;
+        }
+        // close the socket
+        closeSocket();
+        if ((resp_pckt.errorcode == aos_errcode::SUCCESS) && (event_fd == -1)) {
+            return aos_errcode::SOCKET_FAILURE;
+        }
+        return resp_pckt.errorcode;
+    }
+
+    /*
+    Fetches the daemon's statistics as JSON: latency percentiles per
+    command and stage, ops and bytes per session and per FPGA (see
+    scheduler/aos_stats.cpp). Does not need a session.
+    */
+    aos_errcode aos_get_stats(std::string & stats_json) {
+        return requestDaemonDump(aos_socket_command::GET_STATS, stats_json);
+    }
+
+    /*
+    Fetches the spans the daemon's threads recorded most recently as
+    Chrome trace JSON, to be opened in chrome://tracing or
+    ui.perfetto.dev. Does not need a session.
+    */
+    aos_errcode aos_get_trace(std::string & trace_json) {
+        return requestDaemonDump(aos_socket_command::GET_TRACE, trace_json);
+    }
+
     aos_errcode aos_bulkdata_read(uint64_t addr, size_t numBytes, void * buf) {
         assert(intialized);
         // Open the socket
@@ -304,6 +366,18 @@ public:
         return errorcode;
     }
 
+    /*
+    By default an op that finds no slot for the app waits in the daemon's
+    admission queue until one frees up. A non-blocking session gets
+    aos_errcode::RETRY back instead and is expected to try again later,
+    blocking sessions only see RETRY when the queue is full. Must be set
+    before aos_init_session.
+    */
+    void setBlocking(bool is_blocking) {
+        assert(!intialized);
+        blocking = is_blocking;
+    }
+
     void printError(std::string errStr) {
         std::cout << errStr << std::endl;
     }
@@ -320,6 +394,7 @@ private:
     int connection_socket;
     bool connectionOpen;
     bool intialized;
+    bool blocking;
 
     void openSocket() {
         if (connectionOpen)  {
@@ -369,6 +444,67 @@ private:
         return 0;
     }
 
+    int readResponsePacketWithFd(aos_socket_response_packet & resp_pckt, int & recv_fd) {
+        if (!connectionOpen) {
+            printError("Can't read a response on a socket that isn't open");
+        }
+        iovec iov;
+        iov.iov_base = &resp_pckt;
+        iov.iov_len  = sizeof(aos_socket_response_packet);
+        char cmsg_buf[CMSG_SPACE(sizeof(int))];
+        memset(cmsg_buf, 0, sizeof(cmsg_buf));
+        msghdr msg;
+        memset(&msg, 0, sizeof(msghdr));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = cmsg_buf;
+        msg.msg_controllen = sizeof(cmsg_buf);
+        if (recvmsg(connection_socket, &msg, 0) == -1) {
+            perror("Unable to read respone packet from daemon");
+            return 1;
+        }
+        cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+        if ((cmsg != nullptr) && (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_RIGHTS)) {
+            memcpy(&recv_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+        return 0;
+    }
+
+    // Commands answered with a response packet followed by numBytes of text
+    aos_errcode requestDaemonDump(aos_socket_command command, std::string & text) {
+        // Open the socket
+        openSocket();
+        // Create the packet
+        aos_socket_command_packet cmd_pckt;
+        memset(&cmd_pckt, 0, sizeof(aos_socket_command_packet));
+        cmd_pckt.command_type = command;
+        cmd_pckt.session_id = session_id;
+        // send over the request
+        writeCommandPacket(cmd_pckt);
+        // read the response packet, numBytes of text follow it
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.errorcode = aos_errcode::SOCKET_FAILURE;
+        readResponsePacket(resp_pckt);
+        if (resp_pckt.errorcode != aos_errcode::SUCCESS) {
+            closeSocket();
+            return resp_pckt.errorcode;
+        }
+        text.assign(resp_pckt.numBytes, '\0');
+        uint64_t received = 0;
+        while (received < resp_pckt.numBytes) {
+            const ssize_t num_read = read(connection_socket, &text[received], resp_pckt.numBytes - received);
+            if (num_read <= 0) {
+                closeSocket();
+                return aos_errcode::SOCKET_FAILURE;
+            }
+            received += num_read;
+        }
+        // close the socket
+        closeSocket();
+        return aos_errcode::SUCCESS;
+    }
+
     int writeBulkData(uint64_t numBytes, void * buf_ptr) {
         if (!connectionOpen) {
             printError("Can't write data packet without an open socket");
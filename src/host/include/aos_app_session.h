@@ -3,6 +3,8 @@
 #define DMA_BUFFER_ALIGNMENT 512
 #define DEFAULT_DMA_WRITE_BUF_SIZE 1024*1024
 #define DEFAULT_DMA_READ_BUF_SIZE  1024*1024
+// Granularity of DRAM dirty tracking and of the host copy of a preempted session's DRAM
+#define DRAM_PAGE_BYTES ((uint64_t)4096)
 
 class aos_host;
 
@@ -21,10 +23,18 @@ public:
     bool hasSavedState() const;
     std::string debugString() const;
     session_id_t getSessionId() const;
-    void updateLastAccessTime();
+    void recordAccess(uint64_t now_ns, uint64_t num_bytes);
     std::time_t getCreationTime() const;
-    std::time_t getLastAccessTime() const;
+    uint64_t getLastAccessTime() const;
+    uint64_t getRecentBytes(uint64_t now_ns) const;
+    const aos_access_stats & getAccessStats() const;
     bool isMoreRecentlyUsed(aos_app_session * other) const;
+    // Admission
+    uint64_t getBoundTime() const;
+    void markWaiting(uint64_t now_ns);
+    uint64_t getWaitStartTime() const;
+    void setBlocking(bool blocking);
+    bool isBlocking() const;
     bool isDMAWriteBufferBusy() const;
     bool isDMAReadBufferBusy() const;
     char * getDMAWriteBuffer();
@@ -43,7 +53,34 @@ public:
     bool isDMAReadComplete() const;
     void markDMAWriteComplete();
     void markDMAReadComplete();
+    uint64_t getDMAWriteSize() const;
     uint64_t getDMAReadSize() const;
+    // CntrlReg shadow
+    void setShadowRanges(std::vector<cntrlreg_range_t> ranges);
+    void recordCntrlRegWrite(uint64_t addr, uint64_t value);
+    bool readShadowCntrlReg(uint64_t addr, uint64_t & value) const;
+    const std::map<uint64_t, uint64_t> & getShadowCntrlRegs() const;
+    // Preemption
+    void markDRAMDirty(uint64_t addr, uint64_t num_bytes);
+    bool isDRAMPageDirty(uint64_t page_addr) const;
+    const std::set<uint64_t> & getDirtyDRAMPages() const;
+    std::map<uint64_t, uint64_t> & getSavedCntrlRegs();
+    std::map<uint64_t, std::vector<char>> & getSavedDRAM();
+    void dropSavedState();
+    void markStateResident();
+    void recordStateSave(uint64_t save_ns, uint64_t num_bytes, uint64_t skipped_bytes);
+    void recordStateRestore(uint64_t restore_ns, uint64_t restored_bytes, uint64_t resident_bytes);
+    uint64_t getLastSaveTime() const;
+    uint64_t getLastRestoreTime() const;
+    uint64_t getSavedDRAMBytes() const;
+    const aos_preemption_stats & getPreemptionStats() const;
+    // Data residency
+    void addResidentDRAMPages(uint64_t fpga_id, uint64_t slot_id, int64_t num_pages);
+    void dropResidentDRAM(uint64_t fpga_id);
+    const std::map<std::pair<uint64_t, uint64_t>, uint64_t> & getResidentDRAMPages() const;
+    // Completion notification
+    int getCompletionEventFd();
+    void signalCompletion();
 
 private:
 
@@ -54,7 +91,13 @@ private:
     uint64_t fpga_slot;
     bool saved_state;
     std::time_t creation_time;
-    std::time_t last_access_time;
+    // Monotonic, updated on every op the session issues
+    aos_access_stats access_stats;
+    // Monotonic, when the session was last bound and when it started waiting for a slot (0 if not waiting)
+    uint64_t bound_ns;
+    uint64_t wait_start_ns;
+    // Ops that cannot get a slot wait in the admission queue instead of returning RETRY
+    bool blocking;
     // DMA Support
     // Writes
     char * dma_write_buffer;
@@ -72,5 +115,20 @@ private:
     uint64_t dma_read_dest_addr;
     std::time_t dma_read_enque_time;
     bool dma_read_complete;
+    // Last value written to every CntrlReg address, reads are only served
+    // from here for addresses inside the app's declared non-volatile ranges
+    std::map<uint64_t, uint64_t> shadow_cntrlregs;
+    std::vector<cntrlreg_range_t> shadow_ranges;
+    // DRAM pages written since the host copy was last taken
+    std::set<uint64_t> dram_dirty_pages;
+    // Slot state. The registers are only held while unbound (saved_state), the DRAM
+    // copy is kept across rebinds so clean pages need not come off the FPGA again.
+    std::map<uint64_t, uint64_t> saved_cntrlregs;
+    std::map<uint64_t, std::vector<char>> saved_dram;
+    aos_preemption_stats preemption_stats;
+    // Pages of the session's data still in a DRAM partition, by (FPGA, slot)
+    std::map<std::pair<uint64_t, uint64_t>, uint64_t> resident_dram_pages;
+    // Completion notification, created lazily when the client asks for it
+    int completion_eventfd;
 
 };
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "aos_app_session.h"
 //#include "aos_fpga_handle.h"
 #include "aos_scheduler.h"
+#include "aos_placement.h"
 
 
 enum DMA_OPERATION {
@@ -8,17 +9,243 @@ enum DMA_OPERATION {
     READ
 };
 
+// Identifies what an epoll event belongs to, stored in the top byte of epoll_event.data.u64
+enum EPOLL_SOURCE {
+    LISTEN_SOCKET,
+    USER_IRQ,
+    DUMMY_IRQ,
+    RECONFIG_DONE,
+    ADMISSION_TIMER
+};
+
+#define EPOLL_SOURCE_SHIFT 56
+#define EPOLL_ID_MASK ((1ULL << EPOLL_SOURCE_SHIFT) - 1)
+#define MAX_EPOLL_EVENTS 64
+// XDMA exposes 16 user interrupts per FPGA, slot N raises user interrupt N
+#define NUM_USER_IRQS 16
+
+// What a slot or FPGA victim search minimizes
+enum EVICTION_POLICY {
+    LRU,                // oldest last access
+    LEAST_LOAD,         // fewest bound tenants on the FPGA
+    LEAST_RECENT_BYTES  // fewest bytes moved in the recent accounting windows
+};
+
+// lru, least_load or least_recent_bytes, as given on the command line
+inline bool parseEvictionPolicy(const std::string & name, EVICTION_POLICY & policy) {
+    if (name == "lru") {
+        policy = EVICTION_POLICY::LRU;
+    } else if (name == "least_load") {
+        policy = EVICTION_POLICY::LEAST_LOAD;
+    } else if (name == "least_recent_bytes") {
+        policy = EVICTION_POLICY::LEAST_RECENT_BYTES;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A tenant that issued an op this recently is not considered idle
+#define DEFAULT_ACTIVE_THRESHOLD_NS (10ULL * 1000 * 1000)
+
+// Handler return code, the request waits on a reconfiguration and its cfd must stay open
+#define REQUEST_PARKED 2
+
+// No session, session IDs count up from 0
+#define NO_SESSION_ID (~0x0ULL)
+
+// Latency histograms are kept per command and stage, plus a row for work no request waits on (mode switches, prefetches)
+#define NUM_SOCKET_COMMANDS ((uint32_t)aos_socket_command::GET_TRACE + 1)
+#define BACKGROUND_LATENCY_ROW NUM_SOCKET_COMMANDS
+
+// Load time of the simulated backend
+#define DEFAULT_SIMULATED_LOAD_LATENCY_NS (100ULL * 1000 * 1000)
+
+// A request held back until the FPGA it needs finishes reconfiguring, or until it is admitted
+struct aos_parked_request {
+    int cfd;
+    aos_socket_command_packet cmd_pckt;
+};
+
+/*
+    Requests waiting for admission, a FIFO per app. A replay walks them
+    oldest first, but once a request goes back into the queue the younger
+    ones of its app are skipped, they would find the same slots taken. A
+    replay then costs a scheduling pass per app rather than per waiting
+    session.
+*/
+template <typename T>
+class aos_admission_queue {
+public:
+
+    aos_admission_queue() :
+        num_queued(0),
+        next_seq(0)
+    {}
+
+    void push(const std::string & app_id, const T & item) {
+        queues[app_id].push_back(std::make_pair(next_seq++, item));
+        num_queued++;
+    }
+
+    uint64_t size() const {
+        return num_queued;
+    }
+
+    bool empty() const {
+        return (num_queued == 0);
+    }
+
+    // Hands the requests to replay_fn oldest first, replay_fn may push the request back
+    template <typename F>
+    void replay(F replay_fn) {
+        std::set<std::string> blocked_apps;
+        while (true) {
+            auto oldest_it = queues.end();
+            for (auto queue_it = queues.begin(); queue_it != queues.end(); queue_it++) {
+                if (!queue_it->second.empty() && (blocked_apps.count(queue_it->first) == 0) &&
+                    ((oldest_it == queues.end()) || (queue_it->second.front().first < oldest_it->second.front().first))) {
+                    oldest_it = queue_it;
+                }
+            }
+            if (oldest_it == queues.end()) {
+                return;
+            }
+            std::deque<std::pair<uint64_t, T>> & queue = oldest_it->second;
+            const std::pair<uint64_t, T> entry = queue.front();
+            queue.pop_front();
+            num_queued--;
+            const uint64_t queued_before = queue.size();
+            replay_fn(entry.second);
+            if (queue.size() > queued_before) {
+                // Pushed back, it keeps its place at the head
+                queue.pop_back();
+                queue.push_front(entry);
+                blocked_apps.insert(oldest_it->first);
+            }
+        }
+    }
+
+private:
+
+    std::map<std::string, std::deque<std::pair<uint64_t, T>>> queues;
+    uint64_t num_queued;
+    uint64_t next_seq;
+
+};
+
+// Admission control. A session has to have waited this long for a slot before it may evict anyone.
+#define DEFAULT_EVICTION_HYSTERESIS_NS (20ULL * 1000 * 1000)
+// A tenant keeps its slot at least this long once bound
+#define DEFAULT_MIN_SLOT_RESIDENCY_NS (50ULL * 1000 * 1000)
+// An image stays at least this long once loaded before its FPGA can be reflashed for another app
+#define DEFAULT_MIN_IMAGE_RESIDENCY_NS (500ULL * 1000 * 1000)
+// Queued requests are retried at least this often
+#define ADMISSION_RECHECK_NS (5ULL * 1000 * 1000)
+// Mode switching and prefetching look at the FPGAs at least this often, residency and predicted arrivals change with time alone
+#define FLEET_RECHECK_NS (100ULL * 1000 * 1000)
+// Blocking requests past this many are answered RETRY
+#define MAX_ADMISSION_QUEUE 1024
+// handleScheduling wait id, the request has to wait for admission rather than for an FPGA
+#define ADMISSION_QUEUE_ID (~0x0ULL - 1)
+
+// Queueing delay versus thrash, all counters since the daemon started
+struct aos_admission_stats {
+    uint64_t num_admitted;         // sessions bound to a slot
+    uint64_t total_wait_ns;        // first scheduling attempt to bind, summed over admitted sessions
+    uint64_t max_wait_ns;
+    uint64_t num_queued;           // requests that waited in the admission queue
+    uint64_t num_retries;          // requests answered RETRY
+    uint64_t num_slot_evictions;   // tenants swapped out of a slot for another session
+    uint64_t num_fpga_evictions;   // FPGAs reflashed while they had tenants
+    uint64_t num_evicted_sessions; // tenants unbound by either
+    uint64_t elapsed_ns;
+};
+
+// Every slot owns an 8 GB partition of FPGA DRAM, app address A of slot N is at N * 8 GB + A (see AppLevelTranslate.sv)
+#define SLOT_DRAM_PARTITION_BYTES (8ULL << 30)
+// State capture streams DRAM through XDMA in transfers of at most this size
+#define STATE_DMA_CHUNK_BYTES (4ULL << 20)
+// A tenant keeps its slot at least this many times as long as its last save and restore took
+#define PREEMPTION_RESIDENCY_FACTOR 4
+
+// Mode switching. A lone tenant gets a single app image if its app runs at least this much faster there
+#define DEFAULT_SINGLE_TENANT_SPEEDUP 1.2
+// A single app FPGA goes back to a shared image once this many waiting sessions would fit on it
+#define DEFAULT_CONSOLIDATE_DEMAND 1
+
+// A tenant and the free slot it can be migrated to, see aos_host::migrateSession
+struct aos_tenant_move {
+    session_id_t session_id;
+    uint64_t fpga_id;
+    uint64_t slot_id;
+};
+
+// How far ahead arrival prediction looks when prefetching images
+#define DEFAULT_PREFETCH_HORIZON_NS (10ULL * 1000 * 1000 * 1000)
+
+// Metrics exporter, see aos_host::startMetricsExporter
+#define DEFAULT_METRICS_SOCKET "/tmp/aos_metrics.socket"
+// A scrape's request is read for at most this long, then answered regardless
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+#define METRICS_REQUEST_MAX_BYTES 4096
+// Reconfigurations are counted as loaded, failed or cancelled
+#define NUM_RECONFIG_OUTCOMES 3
+
+// What the epoll loop last published about one FPGA, read by the metrics exporter
+struct aos_fpga_gauges {
+    std::atomic<uint64_t> num_slots;
+    std::atomic<uint64_t> bound_slots;
+    std::atomic<uint64_t> parked_requests;
+    std::atomic<uint64_t> reconfiguring;
+};
+
+// Offline driver of the scheduling logic, see scheduler/aos_sim.cpp
+class aos_host_simulator;
+
 class aos_host {
 public:
 
+    friend class ::aos_host_simulator;
+
     const static uint16_t pci_vendor_id = 0x1D0F; /* Amazon PCI Vendor ID */
     const static uint16_t pci_device_id = 0xF000; /* PCI Device ID preassigned by Amazon for F1 applications */
 
 
-    aos_host(uint64_t num_fpgas, bool dummy) :
+    aos_host(uint64_t num_fpgas, bool dummy, bool simulated = false) :
         num_fpga(num_fpgas),
         isDummy(dummy),
-        lazy_reads(false)
+        isSimulated(simulated),
+        num_avoided_reconfigs(0),
+        speculative_prefetch(true),
+        prefetch_horizon_ns(DEFAULT_PREFETCH_HORIZON_NS),
+        num_speculative_loads(0),
+        num_speculative_hits(0),
+        num_speculative_cancels(0),
+        num_migrations(0),
+        total_migration_ns(0),
+        mode_switching(true),
+        single_tenant_speedup(DEFAULT_SINGLE_TENANT_SPEEDUP),
+        consolidate_demand(DEFAULT_CONSOLIDATE_DEMAND),
+        num_single_tenant_switches(0),
+        num_consolidations(0),
+        fleet_placement(true),
+        num_replans(0),
+        lazy_reads(false),
+        shadow_cntrlregs(true),
+        reconfig_horizon_ns(DEFAULT_RECONFIG_HORIZON_NS),
+        slot_eviction_policy(EVICTION_POLICY::LRU),
+        fpga_eviction_policy(EVICTION_POLICY::LEAST_LOAD),
+        active_threshold_ns(DEFAULT_ACTIVE_THRESHOLD_NS),
+        eviction_hysteresis_ns(DEFAULT_EVICTION_HYSTERESIS_NS),
+        min_slot_residency_ns(DEFAULT_MIN_SLOT_RESIDENCY_NS),
+        min_image_residency_ns(DEFAULT_MIN_IMAGE_RESIDENCY_NS),
+        admission_replay_pending(false),
+        replaying_admission(false),
+        fleet_changed(true),
+        start_ns(monotonic_ns()),
+        virtual_reconfig(false),
+        verbose_scheduling(true)
     {
         assert(num_fpga > 0);
 
@@ -31,6 +258,26 @@ public:
             interfaces_enabled.push_back(false);
             slot_session_map.push_back(std::map<uint64_t, aos_app_session *>());
             slot_appid_map.push_back(std::map<uint64_t, std::string>());
+            slot_bar1_base.push_back(std::vector<uint64_t>());
+            slot_bar1_limit.push_back(std::vector<uint64_t>());
+            slot_last_session.push_back(std::vector<session_id_t>());
+            slot_access_stats.push_back(std::vector<aos_access_stats>());
+            user_irq_fd.push_back(std::vector<int>());
+            fpga_reconfiguring.push_back(false);
+            reconfig_image_idx.push_back(0);
+            reconfig_result.push_back(0);
+            reconfig_worker.push_back(std::thread());
+            reconfig_speculative.push_back(false);
+            single_tenant_mode.push_back(false);
+            image_installed_ns.push_back(0);
+            reconfig_done_ns.push_back(0);
+            reconfig_begin_ns.push_back(0);
+            parked_requests.push_back(std::deque<aos_parked_request>());
+            sim_bar1.push_back(std::map<uint64_t, uint64_t>());
+            sim_dram.push_back(std::map<uint64_t, std::vector<char>>());
+            fpga_access_stats.push_back(aos_access_stats());
+            dram_page_owner.push_back(std::map<uint64_t, std::map<uint64_t, session_id_t>>());
+            pending_dram_zeroing.push_back(std::map<uint64_t, std::vector<dram_range_t>>());
             xdma_write_channel[fpga_id] = 0;
             xdma_read_channel[fpga_id]  = 0;
         }
@@ -39,11 +286,57 @@ public:
         socket_name.sun_family = AF_UNIX;
         strncpy(socket_name.sun_path, SOCKET_NAME, sizeof(socket_name.sun_path) - 1);
         socket_initialized = false;
+        // Everything the daemon waits on (clients, interrupts) goes through one epoll set
+        epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd == -1) {
+            perror("epoll_create1");
+            exit(EXIT_FAILURE);
+        }
+        // Reconfiguration workers report back through one eventfd per FPGA
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            int done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (done_fd == -1) {
+                perror("Unable to create reconfiguration eventfd");
+                exit(EXIT_FAILURE);
+            }
+            reconfig_done_fd.push_back(done_fd);
+            addEpollSource(done_fd, EPOLL_SOURCE::RECONFIG_DONE, fpga_id);
+        }
+        // Wakes the admission queue up while requests wait in it
+        admission_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (admission_timer_fd == -1) {
+            perror("Unable to create admission timer");
+            exit(EXIT_FAILURE);
+        }
+        addEpollSource(admission_timer_fd, EPOLL_SOURCE::ADMISSION_TIMER, 0);
+        memset(&admission_stats, 0, sizeof(aos_admission_stats));
+        memset(&preemption_stats, 0, sizeof(aos_preemption_stats));
+        num_local_rebinds = 0;
+        command_latency = new aos_latency_histogram[(NUM_SOCKET_COMMANDS + 1) * NUM_LATENCY_STAGES];
+        current_latency_row = BACKGROUND_LATENCY_ROW;
+        current_trace_session = TRACE_NO_ID;
+        request_counter = new aos_metric_counter[NUM_SOCKET_COMMANDS];
+        fpga_gauges = new aos_fpga_gauges[num_fpga]();
+        gauge_sessions.store(0, std::memory_order_relaxed);
+        gauge_admission_queue.store(0, std::memory_order_relaxed);
+        gauge_pending_dma.store(0, std::memory_order_relaxed);
+        gauge_pending_reads.store(0, std::memory_order_relaxed);
+        metrics_fd = -1;
+        metrics_stop.store(false, std::memory_order_relaxed);
+        state_dma_buffer = (char *)aligned_alloc(DMA_BUFFER_ALIGNMENT, STATE_DMA_CHUNK_BYTES);
+        zero_dma_buffer = (char *)aligned_alloc(DMA_BUFFER_ALIGNMENT, STATE_DMA_CHUNK_BYTES);
+        memset(zero_dma_buffer, 0, STATE_DMA_CHUNK_BYTES);
         // Session IDs
         next_session_id = 0;
         sched = new aos_scheduler(num_fpga);
+        placement = new aos_placement(*sched, reconfig_horizon_ns);
         // TODO: Load some images in
 
+        if (isSimulated) {
+            sched->setSimulatedReconfiguration(true, DEFAULT_SIMULATED_LOAD_LATENCY_NS);
+            return;
+        }
+
         // Init the FPGA library
         // Only needs to be called once
         int rc = fpga_init();
@@ -52,15 +345,369 @@ public:
         }
     }
 
+    ~aos_host() {
+        for (auto & worker : reconfig_worker) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+        if (metrics_thread.joinable()) {
+            // Wakes the exporter out of accept
+            metrics_stop.store(true, std::memory_order_relaxed);
+            shutdown(metrics_fd, SHUT_RDWR);
+            metrics_thread.join();
+            close(metrics_fd);
+        }
+        free(state_dma_buffer);
+        free(zero_dma_buffer);
+        delete[] command_latency;
+        delete[] request_counter;
+        delete[] fpga_gauges;
+    }
+
     // TODO: Implement and call
     void parseImagesJson(std::string fileName) {
         sched->parseImages(fileName);
     }
 
+    void setEvictionPolicies(EVICTION_POLICY slot_policy, EVICTION_POLICY fpga_policy) {
+        slot_eviction_policy = slot_policy;
+        fpga_eviction_policy = fpga_policy;
+    }
+
+    void setSimulatedLoadLatency(uint64_t load_latency_ns) {
+        assert(isSimulated);
+        sched->setSimulatedReconfiguration(true, load_latency_ns);
+    }
+
+    /*
+    Simulated backend only. Reconfigurations start no worker thread, a
+    load is due getSimulatedLoadLatency after it starts and the driver
+    completes it through handleReconfigurationDone once its clock gets
+    there (see setVirtualClock).
+    */
+    void setVirtualReconfiguration(bool is_virtual) {
+        assert(isSimulated);
+        virtual_reconfig = is_virtual;
+    }
+
+    // Dump the whole scheduler state on every scheduling decision, needs LEVEL_DEBUG lines
+    void setVerboseScheduling(bool verbose) {
+        verbose_scheduling = verbose;
+    }
+
+    uint64_t getNumAvoidedReconfigurations() const {
+        return num_avoided_reconfigs;
+    }
+
+    // Bulk transfers handed over by clients and slots waiting to have their DRAM zeroed, not issued yet
+    uint64_t getNumPendingDMAOperations() const {
+        uint64_t num_pending = pending_dma_session_id.size();
+        for (auto & fpga_zeroing : pending_dram_zeroing) {
+            num_pending += fpga_zeroing.size();
+        }
+        return num_pending;
+    }
+
+    /*
+    min_speedup is how much faster a single app image has to run a lone
+    tenant's app, by the slots' throughput ratings, before its FPGA is
+    switched to it, consolidate_threshold how many waiting sessions have
+    to fit on a shared image before the FPGA goes back to one.
+    */
+    void setModeSwitching(bool enabled, double min_speedup, uint32_t consolidate_threshold) {
+        mode_switching        = enabled;
+        single_tenant_speedup = min_speedup;
+        consolidate_demand    = consolidate_threshold;
+    }
+
+    void getModeSwitchStats(uint64_t & to_single_tenant, uint64_t & to_shared) const {
+        to_single_tenant = num_single_tenant_switches;
+        to_shared        = num_consolidations;
+    }
+
+    // Sessions moved between FPGAs and the time their ops were held for it, summed
+    void getMigrationStats(uint64_t & migrations, uint64_t & total_ns) const {
+        migrations = num_migrations;
+        total_ns   = total_migration_ns;
+    }
+
+    void getSpeculationStats(uint64_t & loads, uint64_t & hits, uint64_t & cancels) const {
+        loads   = num_speculative_loads;
+        hits    = num_speculative_hits;
+        cancels = num_speculative_cancels;
+    }
+
+    uint64_t getNumReplans() const {
+        return num_replans;
+    }
+
+    void setAdmissionControl(uint64_t hysteresis_ns, uint64_t slot_residency_ns, uint64_t image_residency_ns) {
+        eviction_hysteresis_ns = hysteresis_ns;
+        min_slot_residency_ns  = slot_residency_ns;
+        min_image_residency_ns = image_residency_ns;
+    }
+
+    aos_admission_stats getAdmissionStats() const {
+        aos_admission_stats stats = admission_stats;
+        stats.elapsed_ns = monotonic_ns() - start_ns;
+        return stats;
+    }
+
+    // Save and restore cost summed over every session since the daemon started
+    aos_preemption_stats getPreemptionStats() const {
+        return preemption_stats;
+    }
+
+    // Returns false if the session does not exist (any more)
+    bool getSessionPreemptionStats(session_id_t session_id, aos_preemption_stats & stats) const {
+        auto session_it = sessions.find(session_id);
+        if (session_it == sessions.end()) {
+            return false;
+        }
+        stats = session_it->second->getPreemptionStats();
+        return true;
+    }
+
+    /*
+    Where a session's DRAM data is: the partition (FPGA and slot) holding
+    the most of its pages, and how many bytes of it. Returns false if none
+    of it is left on an FPGA.
+    */
+    bool getDataResidency(session_id_t session_id, uint64_t & fpga_id, uint64_t & slot_id, uint64_t & resident_bytes) const {
+        auto session_it = sessions.find(session_id);
+        if (session_it == sessions.end()) {
+            return false;
+        }
+        resident_bytes = 0;
+        for (auto & partition : session_it->second->getResidentDRAMPages()) {
+            if ((partition.second * DRAM_PAGE_BYTES) > resident_bytes) {
+                fpga_id = partition.first.first;
+                slot_id = partition.first.second;
+                resident_bytes = partition.second * DRAM_PAGE_BYTES;
+            }
+        }
+        return (resident_bytes != 0);
+    }
+
+    // Sessions rebound to the partition that still held their data
+    uint64_t getNumLocalRebinds() const {
+        return num_local_rebinds;
+    }
+
+    const aos_latency_histogram & getCommandLatency(aos_socket_command command, LATENCY_STAGE stage) const {
+        return command_latency[(getLatencyRow(command) * NUM_LATENCY_STAGES) + stage];
+    }
+
+    /*
+    Everything GET_STATS reports: percentiles of every command and stage
+    that has samples, and ops and bytes per session and per FPGA since
+    they started.
+    */
+    json getStatsJson() const {
+        json stats;
+        stats["uptime_ns"] = monotonic_ns() - start_ns;
+        stats["latency"] = json::array();
+        for (uint32_t row = 0; row <= NUM_SOCKET_COMMANDS; row++) {
+            for (uint32_t stage = 0; stage < NUM_LATENCY_STAGES; stage++) {
+                const aos_latency_histogram & histogram = command_latency[(row * NUM_LATENCY_STAGES) + stage];
+                const uint64_t count = histogram.getCount();
+                if (count == 0) {
+                    continue;
+                }
+                json entry;
+                entry["command"] = getLatencyRowName(row);
+                entry["stage"]   = getLatencyStageName((LATENCY_STAGE)stage);
+                entry["count"]   = count;
+                entry["mean_ns"] = histogram.getTotal() / count;
+                entry["p50_ns"]  = histogram.getPercentile(0.50);
+                entry["p90_ns"]  = histogram.getPercentile(0.90);
+                entry["p99_ns"]  = histogram.getPercentile(0.99);
+                entry["p999_ns"] = histogram.getPercentile(0.999);
+                entry["max_ns"]  = histogram.getMax();
+                stats["latency"].push_back(entry);
+            }
+        }
+        stats["sessions"] = json::array();
+        for (auto & session_pair : sessions) {
+            const aos_app_session * session_ptr = session_pair.second;
+            json entry;
+            entry["session_id"] = session_pair.first;
+            entry["app_id"]     = session_ptr->getAppId();
+            entry["bound"]      = session_ptr->boundToSlot();
+            if (session_ptr->boundToSlot()) {
+                entry["fpga_id"] = session_ptr->getFPGAId();
+                entry["slot_id"] = session_ptr->getSlotId();
+            }
+            entry["num_ops"] = session_ptr->getAccessStats().num_ops;
+            entry["bytes"]   = session_ptr->getAccessStats().total_bytes;
+            stats["sessions"].push_back(entry);
+        }
+        stats["fpgas"] = json::array();
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            const int32_t image_idx = sched->getCurrentImageIdx(fpga_id);
+            uint64_t num_tenants = 0;
+            for (auto & slot_session : slot_session_map[fpga_id]) {
+                if (slot_session.second != nullptr) {
+                    num_tenants++;
+                }
+            }
+            json entry;
+            entry["fpga_id"]       = fpga_id;
+            entry["image"]         = (image_idx == NO_IMAGE_LOADED) ? std::string() : sched->getImageDescriptor(image_idx).description;
+            entry["reconfiguring"] = (bool)fpga_reconfiguring[fpga_id];
+            entry["tenants"]       = num_tenants;
+            entry["num_ops"]       = fpga_access_stats[fpga_id].num_ops;
+            entry["bytes"]         = fpga_access_stats[fpga_id].total_bytes;
+            stats["fpgas"].push_back(entry);
+        }
+        return stats;
+    }
+
+    /*
+    The counters and gauges of the daemon in the Prometheus text exposition
+    format. Safe from any thread, it only sums counters and reads the gauges
+    the epoll loop last published.
+    */
+    std::string getMetricsText() const {
+        static const char * reconfig_outcomes[NUM_RECONFIG_OUTCOMES] = {"loaded", "failed", "cancelled"};
+        std::ostringstream out;
+
+        writeMetricHeader(out, "aos_uptime_seconds", "gauge", "Seconds since the daemon started.");
+        out << "aos_uptime_seconds " << formatSeconds(monotonic_ns() - start_ns) << "\n";
+
+        writeMetricHeader(out, "aos_requests_total", "counter", "Requests answered, by command.");
+        for (uint32_t row = 0; row < NUM_SOCKET_COMMANDS; row++) {
+            out << "aos_requests_total{command=\"" << getLatencyRowName(row) << "\"} " << request_counter[row].get() << "\n";
+        }
+
+        writeMetricHeader(out, "aos_sessions", "gauge", "Open sessions.");
+        out << "aos_sessions " << gauge_sessions.load(std::memory_order_relaxed) << "\n";
+        writeMetricHeader(out, "aos_sessions_opened_total", "counter", "Sessions opened.");
+        out << "aos_sessions_opened_total " << sessions_opened_counter.get() << "\n";
+        writeMetricHeader(out, "aos_sessions_closed_total", "counter", "Sessions closed.");
+        out << "aos_sessions_closed_total " << sessions_closed_counter.get() << "\n";
+
+        writeMetricHeader(out, "aos_slots", "gauge", "Slots of the image loaded on the FPGA.");
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            out << "aos_slots{fpga=\"" << fpga_id << "\"} " << fpga_gauges[fpga_id].num_slots.load(std::memory_order_relaxed) << "\n";
+        }
+        writeMetricHeader(out, "aos_bound_slots", "gauge", "Slots with a session bound to them.");
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            out << "aos_bound_slots{fpga=\"" << fpga_id << "\"} " << fpga_gauges[fpga_id].bound_slots.load(std::memory_order_relaxed) << "\n";
+        }
+        writeMetricHeader(out, "aos_fpga_reconfiguring", "gauge", "1 while the FPGA loads an image.");
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            out << "aos_fpga_reconfiguring{fpga=\"" << fpga_id << "\"} " << fpga_gauges[fpga_id].reconfiguring.load(std::memory_order_relaxed) << "\n";
+        }
+        writeMetricHeader(out, "aos_slot_binds_total", "counter", "Sessions bound to a slot.");
+        out << "aos_slot_binds_total " << slot_bind_counter.get() << "\n";
+        writeMetricHeader(out, "aos_slot_evictions_total", "counter", "Tenants whose state was saved to free their slot.");
+        out << "aos_slot_evictions_total " << slot_evict_counter.get() << "\n";
+
+        writeMetricHeader(out, "aos_reconfigurations_total", "counter", "Image loads, by outcome.");
+        uint64_t num_reconfigs = 0;
+        for (uint32_t outcome = 0; outcome < NUM_RECONFIG_OUTCOMES; outcome++) {
+            const uint64_t count = reconfig_counter[outcome].get();
+            out << "aos_reconfigurations_total{result=\"" << reconfig_outcomes[outcome] << "\"} " << count << "\n";
+            num_reconfigs += count;
+        }
+        writeMetricHeader(out, "aos_reconfiguration_duration_seconds", "summary", "Start to finish of image loads.");
+        out << "aos_reconfiguration_duration_seconds_sum " << formatSeconds(reconfig_ns_counter.get()) << "\n";
+        out << "aos_reconfiguration_duration_seconds_count " << num_reconfigs << "\n";
+
+        writeMetricHeader(out, "aos_mmio_ops_total", "counter", "BAR1 accesses on behalf of tenants.");
+        out << "aos_mmio_ops_total{op=\"read\"} " << mmio_read_counter.get() << "\n";
+        out << "aos_mmio_ops_total{op=\"write\"} " << mmio_write_counter.get() << "\n";
+        writeMetricHeader(out, "aos_dma_bytes_total", "counter", "Bytes moved by XDMA, read is FPGA DRAM to host.");
+        out << "aos_dma_bytes_total{direction=\"read\"} " << dma_read_bytes_counter.get() << "\n";
+        out << "aos_dma_bytes_total{direction=\"write\"} " << dma_write_bytes_counter.get() << "\n";
+
+        writeMetricHeader(out, "aos_admission_queue_depth", "gauge", "Requests waiting for admission to a slot.");
+        out << "aos_admission_queue_depth " << gauge_admission_queue.load(std::memory_order_relaxed) << "\n";
+        writeMetricHeader(out, "aos_parked_requests", "gauge", "Requests waiting for the FPGA to finish reconfiguring.");
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            out << "aos_parked_requests{fpga=\"" << fpga_id << "\"} " << fpga_gauges[fpga_id].parked_requests.load(std::memory_order_relaxed) << "\n";
+        }
+        writeMetricHeader(out, "aos_pending_dma_ops", "gauge", "Bulk transfers staged but not yet issued.");
+        out << "aos_pending_dma_ops " << gauge_pending_dma.load(std::memory_order_relaxed) << "\n";
+        writeMetricHeader(out, "aos_pending_cntrlreg_reads", "gauge", "CntrlReg reads requested but not yet collected.");
+        out << "aos_pending_cntrlreg_reads " << gauge_pending_reads.load(std::memory_order_relaxed) << "\n";
+
+        writeMetricHeader(out, "aos_log_dropped_lines_total", "counter", "Log lines dropped because the log queue was full.");
+        out << "aos_log_dropped_lines_total " << getNumDroppedLogLines() << "\n";
+        return out.str();
+    }
+
+    /*
+    Serves getMetricsText on endpoint: a port number listens on 127.0.0.1,
+    anything else is a Unix socket path. Every connection gets one HTTP
+    response whatever it asked for, so a Prometheus scrape and
+    curl --unix-socket <path> http://localhost/metrics both work. The
+    exporter runs on a thread of its own, start it before listen_loop.
+    */
+    int startMetricsExporter(const std::string & endpoint) {
+        if (metrics_fd != -1) {
+            printErrorHost("Metrics exporter already running");
+            return 1;
+        }
+        const bool tcp = !endpoint.empty() && (endpoint.size() <= 5) && (endpoint.find_first_not_of("0123456789") == std::string::npos);
+        if (tcp && (std::stoul(endpoint) > 65535)) {
+            printErrorHost("Metrics port out of range");
+            return 1;
+        }
+        int listen_fd = socket(tcp ? AF_INET : AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd == -1) {
+            perror("Unable to create metrics socket");
+            return 1;
+        }
+        int ret;
+        if (tcp) {
+            int reuse = 1;
+            setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int));
+            sockaddr_in addr;
+            memset(&addr, 0, sizeof(sockaddr_in));
+            addr.sin_family      = AF_INET;
+            addr.sin_port        = htons((uint16_t)std::stoul(endpoint));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            ret = bind(listen_fd, (const sockaddr *)&addr, sizeof(sockaddr_in));
+        } else {
+            sockaddr_un addr;
+            memset(&addr, 0, sizeof(sockaddr_un));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path, endpoint.c_str(), sizeof(addr.sun_path) - 1);
+            // Only a socket nobody listens on any more is replaced, never a live exporter or some other file
+            struct stat path_stat;
+            if (lstat(addr.sun_path, &path_stat) == 0) {
+                if (!S_ISSOCK(path_stat.st_mode) || isSocketListening(addr.sun_path)) {
+                    printErrorHost("Metrics path " + endpoint + " is in use or not a socket");
+                    close(listen_fd);
+                    return 1;
+                }
+                unlink(addr.sun_path);
+            }
+            ret = bind(listen_fd, (const sockaddr *)&addr, sizeof(sockaddr_un));
+        }
+        if ((ret == -1) || (listen(listen_fd, BACKLOG) == -1)) {
+            perror("Unable to listen for metrics scrapes");
+            close(listen_fd);
+            return 1;
+        }
+        metrics_fd = listen_fd;
+        publishMetrics();
+        metrics_thread = std::thread(&aos_host::metricsLoop, this);
+        AOS_LOG_INFO("Metrics exporter listening on " << (tcp ? "127.0.0.1:" : "") << endpoint);
+        return 0;
+    }
+
     void loadDefaultImage(uint64_t fpga_id) {
         assert(fpga_id < num_fpga);
-        json default_image = sched->getImageByIdx(0);
-        switchImage(fpga_id, default_image);
+        // Keep whatever library image is already on the FPGA instead of reloading it
+        if (sched->probeResidentImage(fpga_id)) {
+            switchImage(fpga_id, sched->getCurrentImageIdx(fpga_id));
+            return;
+        }
+        switchImage(fpga_id, 0);
     }
 
     int init_socket() {
@@ -85,6 +732,8 @@ public:
             exit(EXIT_FAILURE);
         }
 
+        addEpollSource(passive_socket, EPOLL_SOURCE::LISTEN_SOCKET, 0);
+
         socket_initialized = true;
         return 0;
     }
@@ -100,6 +749,8 @@ public:
     }
 
     int writeResponsePacket(int cfd, aos_socket_response_packet & resp_pckt) {
+        aos_latency_timer timer(getStageHistogram(STAGE_RESPONSE));
+        aos_trace_span span("response", current_trace_session);
         if (!socket_initialized) {
             printErrorHost("Can't write response packet without an open socket");
         }
@@ -109,21 +760,83 @@ public:
         return 0;
     }
 
+    // Sends the response with a file descriptor attached, the client receives its own copy
+    int writeResponsePacketWithFd(int cfd, aos_socket_response_packet & resp_pckt, int fd_to_send) {
+        aos_latency_timer timer(getStageHistogram(STAGE_RESPONSE));
+        aos_trace_span span("response", current_trace_session);
+        if (!socket_initialized) {
+            printErrorHost("Can't write response packet without an open socket");
+        }
+        iovec iov;
+        iov.iov_base = &resp_pckt;
+        iov.iov_len  = sizeof(aos_socket_response_packet);
+        char cmsg_buf[CMSG_SPACE(sizeof(int))];
+        memset(cmsg_buf, 0, sizeof(cmsg_buf));
+        msghdr msg;
+        memset(&msg, 0, sizeof(msghdr));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = cmsg_buf;
+        msg.msg_controllen = sizeof(cmsg_buf);
+        cmsghdr * cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd_to_send, sizeof(int));
+        if (sendmsg(cfd, &msg, 0) == -1) {
+            printErrorHost("Daemon socket write response error");
+        }
+        return 0;
+    }
+
     int readCommandPacket(int cfd, aos_socket_command_packet & cmd_pckt) {
+        aos_trace_span span("decode");
+        const uint64_t start_ns = monotonic_ns();
         if (read(cfd, &cmd_pckt, sizeof(aos_socket_command_packet)) == -1) {
             perror("Unable to read from client");
         }
+        if (isSessionIdValid(cmd_pckt.session_id)) {
+            span.setSession(cmd_pckt.session_id);
+        }
+        // Only now is it known which command the time goes to
+        command_latency[(getLatencyRow(cmd_pckt.command_type) * NUM_LATENCY_STAGES) + STAGE_RECEIVE].record(monotonic_ns() - start_ns);
+        return 0;
+    }
+
+    // Loops until all of num_bytes went out, a large payload does not fit the socket buffer in one go
+    int writeSocketPayload(int cfd, const char * buf_ptr, uint64_t num_bytes) {
+        aos_latency_timer timer(getStageHistogram(STAGE_RESPONSE));
+        aos_trace_span span("response payload", current_trace_session);
+        uint64_t sent = 0;
+        while (sent < num_bytes) {
+            const ssize_t num_written = write(cfd, buf_ptr + sent, num_bytes - sent);
+            if (num_written <= 0) {
+                printErrorHost("Daemon socket write error");
+                return 1;
+            }
+            sent += num_written;
+        }
         return 0;
     }
 
     int readBulkDataFromSocket(int cfd, uint64_t numBytes, char * buf_ptr) {
-        if (read(cfd, buf_ptr, numBytes) == -1) {
-            perror("Unable to read bulk write packet from client");
+        aos_latency_timer timer(getStageHistogram(STAGE_RECEIVE));
+        aos_trace_span span("receive payload", current_trace_session);
+        // Like the response payload, a large write arrives in pieces
+        uint64_t received = 0;
+        while (received < numBytes) {
+            const ssize_t num_read = read(cfd, buf_ptr + received, numBytes - received);
+            if (num_read <= 0) {
+                perror("Unable to read bulk write packet from client");
+                return 1;
+            }
+            received += num_read;
         }
         return 0;
     }
 
     void startTransaction(int & cfd) {
+        aos_trace_span span("accept");
         // blocking call
         cfd = accept(passive_socket, NULL, NULL);
         if (cfd == -1) {
@@ -141,29 +854,115 @@ public:
 
         aos_socket_command_packet cmd_pckt;
         int cfd;
+        epoll_event events[MAX_EPOLL_EVENTS];
 
-        std::cout << "AOS Daemon ready to receive requests" << std::endl << std::flush;
+        setTraceThreadName("aos_host");
+        AOS_LOG_INFO("AOS Daemon ready to receive requests");
+        armAdmissionTimer();
 
         while (1) {
 
-            startTransaction(cfd);
+            int num_events = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, -1);
+            if (num_events == -1) {
+                if (errno != EINTR) {
+                    perror("epoll_wait");
+                }
+                continue;
+            }
+
+            for (int event_idx = 0; event_idx < num_events; event_idx++) {
+                const uint64_t source    = events[event_idx].data.u64 >> EPOLL_SOURCE_SHIFT;
+                const uint64_t source_id = events[event_idx].data.u64 & EPOLL_ID_MASK;
 
-            readCommandPacket(cfd, cmd_pckt);
+                switch (source) {
+                    case EPOLL_SOURCE::LISTEN_SOCKET : {
 
-            //std::cout << "Daemon Received 64 bit value: " <<  cmd_pckt.data64 << " for app " << cmd_pckt.app_id << " for addr " << cmd_pckt.addr64 << std::endl << std::flush;
+                        startTransaction(cfd);
 
-            handleTransaction(cfd, cmd_pckt);
+                        readCommandPacket(cfd, cmd_pckt);
 
-            closeTransaction(cfd);
+                        AOS_LOG_DEBUG("Daemon Received 64 bit value: " <<  cmd_pckt.data64 << " for session " << cmd_pckt.session_id << " for addr " << cmd_pckt.addr64);
 
-            // Later on we can move this to a different thread
-            scheduleDMAOperations();
+                        // Parked requests answer and close once their FPGA is back
+                        if (handleTransaction(cfd, cmd_pckt) != REQUEST_PARKED) {
+                            closeTransaction(cfd);
+                        }
+
+                        // Later on we can move this to a different thread
+                        scheduleDMAOperations();
+
+                        serviceAdmissionQueue();
+
+                        runFleetPasses();
+                    }
+                    break;
+                    case EPOLL_SOURCE::USER_IRQ : {
+                        handleUserInterrupt(source_id >> 16, source_id & 0xFFFF);
+                    }
+                    break;
+                    case EPOLL_SOURCE::DUMMY_IRQ : {
+                        handleDummyInterrupt(source_id);
+                    }
+                    break;
+                    case EPOLL_SOURCE::RECONFIG_DONE : {
+                        handleReconfigurationDone(source_id);
+                        scheduleDMAOperations();
+                        serviceAdmissionQueue();
+                        runFleetPasses();
+                    }
+                    break;
+                    case EPOLL_SOURCE::ADMISSION_TIMER : {
+                        uint64_t expirations = 0;
+                        if ((read(admission_timer_fd, &expirations, sizeof(uint64_t)) == -1) && (errno != EAGAIN)) {
+                            perror("Unable to read admission timer");
+                        }
+                        admission_replay_pending = true;
+                        serviceAdmissionQueue();
+                        fleet_changed = true;
+                        runFleetPasses();
+                        armAdmissionTimer();
+                    }
+                    break;
+                    default: {
+                        printErrorHost("Unknown epoll source in daemon");
+                    }
+                    break;
+                }
+            }
+
+            // The exporter only ever sees these copies, never daemon state
+            if (metrics_fd != -1) {
+                publishMetrics();
+            }
 
         }
 
     }
 
     int handleTransaction(int cfd, aos_socket_command_packet & cmd_pckt) {
+        current_latency_row = getLatencyRow(cmd_pckt.command_type);
+        current_trace_session = isSessionIdValid(cmd_pckt.session_id) ? cmd_pckt.session_id : TRACE_NO_ID;
+        AOS_PROBE2(request_start, (uint64_t)cmd_pckt.command_type, cmd_pckt.session_id);
+        int rc;
+        {
+            aos_trace_span span(getLatencyRowName(current_latency_row), current_trace_session);
+            rc = dispatchTransaction(cfd, cmd_pckt);
+        }
+        AOS_PROBE3(request_done, (uint64_t)cmd_pckt.command_type, cmd_pckt.session_id, rc);
+        current_latency_row = BACKGROUND_LATENCY_ROW;
+        current_trace_session = TRACE_NO_ID;
+        // A parked request is charged when it is replayed
+        if (rc != REQUEST_PARKED) {
+            recordSessionAccess(cmd_pckt);
+            const uint32_t row = getLatencyRow(cmd_pckt.command_type);
+            if (row < NUM_SOCKET_COMMANDS) {
+                request_counter[row].add();
+            }
+        }
+        return rc;
+    }
+
+    int dispatchTransaction(int cfd, aos_socket_command_packet & cmd_pckt) {
         switch(cmd_pckt.command_type) {
             case aos_socket_command::CNTRLREG_WRITE_REQUEST : {
                 return handleCntrlRegWriteRequest(cfd, cmd_pckt);
@@ -197,6 +996,18 @@ public:
                 return handleEndSession(cmd_pckt);
             }
             break;
+            case aos_socket_command::COMPLETION_EVENTFD_REQUEST : {
+                return handleCompletionEventFdRequest(cfd, cmd_pckt);
+            }
+            break;
+            case aos_socket_command::GET_STATS : {
+                return handleGetStatsRequest(cfd, cmd_pckt);
+            }
+            break;
+            case aos_socket_command::GET_TRACE : {
+                return handleGetTraceRequest(cfd, cmd_pckt);
+            }
+            break;
             default: {
                 perror("Unimplemented command type in daemon");
             }
@@ -205,6 +1016,50 @@ public:
         return 0;
     }
 
+    /*
+    Charge a data path op to its session and, if the session ended up bound,
+    to the slot it ran in. Session management commands are not accesses.
+    */
+    void recordSessionAccess(aos_socket_command_packet & cmd_pckt) {
+        uint64_t num_bytes = 0;
+        switch(cmd_pckt.command_type) {
+            case aos_socket_command::CNTRLREG_WRITE_REQUEST :
+            case aos_socket_command::CNTRLREG_READ_REQUEST : {
+                num_bytes = sizeof(uint64_t);
+            }
+            break;
+            case aos_socket_command::BULKDATA_WRITE_REQUEST :
+            case aos_socket_command::BULKDATA_READ_REQUEST : {
+                num_bytes = cmd_pckt.numBytes;
+            }
+            break;
+            case aos_socket_command::CNTRLREG_READ_RESPONSE :
+            case aos_socket_command::BULKDATA_READ_RESPONSE : {
+                num_bytes = 0;
+            }
+            break;
+            default: {
+                return;
+            }
+            break;
+        }
+        const session_id_t session_id = cmd_pckt.session_id;
+        if (!isSessionIdValid(session_id)) {
+            return;
+        }
+        const uint64_t now_ns = monotonic_ns();
+        aos_app_session * session_ptr = sessions[session_id];
+        session_ptr->recordAccess(now_ns, num_bytes);
+        if (session_ptr->boundToSlot()) {
+            const uint64_t fpga_id = session_ptr->getFPGAId();
+            const uint64_t slot_id = session_ptr->getSlotId();
+            if ((fpga_id < num_fpga) && (slot_id < slot_access_stats[fpga_id].size())) {
+                slot_access_stats[fpga_id][slot_id].recordAccess(now_ns, num_bytes);
+                fpga_access_stats[fpga_id].recordAccess(now_ns, num_bytes);
+            }
+        }
+    }
+
     int handleCntrlRegWriteRequest(int cfd, aos_socket_command_packet & cmd_pckt) {
         const session_id_t session_id = cmd_pckt.session_id;
         int success = 1;
@@ -221,12 +1076,24 @@ public:
         }
 
         if (!isDummy) {
-            if (!isSessionScheduled(session_id)) {
-                handleScheduling(session_id);
+            uint64_t wait_fpga_id;
+            if (!isSessionScheduled(session_id) && !handleScheduling(session_id, wait_fpga_id)) {
+                return parkRequest(cfd, cmd_pckt, wait_fpga_id);
             }
             const uint64_t fpga_id = getFPGAId(session_id);
             const uint64_t slot_id = getSlotId(session_id);
+            if (!isCntrlRegAddrValid(fpga_id, slot_id, cmd_pckt.addr64)) {
+                resp_pckt.errorcode = aos_errcode::PROTECTION_FAILURE;
+                writeResponsePacket(cfd, resp_pckt);
+                return success;
+            }
             success = write_pci_bar1(fpga_id, slot_id, cmd_pckt.addr64, cmd_pckt.data64);
+            if ((success == 0) && shadow_cntrlregs) {
+                sessions[session_id]->recordCntrlRegWrite(cmd_pckt.addr64, cmd_pckt.data64);
+            }
+            if ((success == 0) && isSimulated) {
+                raiseStandInInterrupt(session_id, cmd_pckt.addr64);
+            }
         } else {
             // Dummy mode uses the session_id to access everything, no real slots
             if (dummy_cntrlreg_map.find(session_id) == dummy_cntrlreg_map.end()) {
@@ -234,6 +1101,7 @@ public:
             }
             (dummy_cntrlreg_map[session_id])[cmd_pckt.addr64] = cmd_pckt.data64;
             success = 0;
+            raiseStandInInterrupt(session_id, cmd_pckt.addr64);
         }
 
         writeResponsePacket(cfd, resp_pckt);
@@ -258,16 +1126,27 @@ public:
 
         uint64_t read_addr_ = cmd_pckt.addr64;
 
-        cntrlRegEnqReadReq(session_id, read_addr_);
         // Check if the read is executed immediately
         if (!isDummy && !lazy_reads) {
-            if (!isSessionScheduled(session_id)) {
-                handleScheduling(session_id);
-            }
-            cntrlRegDeqReadReq(session_id);
             uint64_t read_value_;
+            // Non-volatile registers are served from the shadow, no scheduling or MMIO needed
+            if (shadow_cntrlregs && sessions[session_id]->readShadowCntrlReg(read_addr_, read_value_)) {
+                cntrlRegEnqReadResp(session_id, read_value_);
+                writeResponsePacket(cfd, resp_pckt);
+                return 0;
+            }
+            // Park before touching the queues so the replay starts from scratch
+            uint64_t wait_fpga_id;
+            if (!isSessionScheduled(session_id) && !handleScheduling(session_id, wait_fpga_id)) {
+                return parkRequest(cfd, cmd_pckt, wait_fpga_id);
+            }
             const uint64_t fpga_id = getFPGAId(session_id);
             const uint64_t slot_id = getSlotId(session_id);
+            if (!isCntrlRegAddrValid(fpga_id, slot_id, read_addr_)) {
+                resp_pckt.errorcode = aos_errcode::PROTECTION_FAILURE;
+                writeResponsePacket(cfd, resp_pckt);
+                return success;
+            }
             success = read_pci_bar1(fpga_id, slot_id, read_addr_, read_value_);
             if (success != 0) {
                 perror("Read over pci bar1 failed on the daemon");
@@ -275,6 +1154,10 @@ public:
             }
             cntrlRegEnqReadResp(session_id, read_value_);
 
+        } else if (!isDummy) {
+            // Lazy reads execute when the response is requested
+            cntrlRegEnqReadReq(session_id, read_addr_);
+            success = 0;
         } else {
             if (dummy_cntrlreg_map.find(session_id) == dummy_cntrlreg_map.end()) {
                 dummy_cntrlreg_map[session_id] = std::map<uint64_t, uint64_t>();
@@ -283,7 +1166,6 @@ public:
             if (app_cntrl_reg_map.find(read_addr_) == app_cntrl_reg_map.end()) {
                 app_cntrl_reg_map[read_addr_] = 0x0;
             }
-            cntrlRegDeqReadReq(session_id);
             cntrlRegEnqReadResp(session_id, app_cntrl_reg_map[read_addr_]);
             success = 0;
         }
@@ -312,13 +1194,26 @@ public:
                 data64_ = cntrlRegDeqReadResp(session_id);
             } else {
                 // Actually execute the read operation
-                if (!isSessionScheduled(session_id)) {
-                    handleScheduling(session_id);
+                uint64_t read_addr_ = cntrlreg_read_request_queue[session_id].front();
+                if (shadow_cntrlregs && sessions[session_id]->readShadowCntrlReg(read_addr_, data64_)) {
+                    cntrlRegDeqReadReq(session_id);
+                    resp_pckt.data64 = data64_;
+                    writeResponsePacket(cfd, resp_pckt);
+                    return success;
                 }
-                uint64_t read_addr_ = cntrlRegDeqReadReq(session_id);
+                // Leave the request queued if we have to wait, the replay dequeues it
+                uint64_t wait_fpga_id;
+                if (!isSessionScheduled(session_id) && !handleScheduling(session_id, wait_fpga_id)) {
+                    return parkRequest(cfd, cmd_pckt, wait_fpga_id);
+                }
+                cntrlRegDeqReadReq(session_id);
                 const uint64_t fpga_id = getFPGAId(session_id);
                 const uint64_t slot_id = getSlotId(session_id);
-                success = read_pci_bar1(fpga_id, slot_id, read_addr_, data64_);
+                if (!isCntrlRegAddrValid(fpga_id, slot_id, read_addr_)) {
+                    resp_pckt.errorcode = aos_errcode::PROTECTION_FAILURE;
+                } else {
+                    success = read_pci_bar1(fpga_id, slot_id, read_addr_, data64_);
+                }
                 if (success != 0) {
                     perror("Read over pci bar1 failed on the daemon");
                     resp_pckt.errorcode = aos_errcode::UNKNOWN_FAILURE;
@@ -364,6 +1259,8 @@ public:
         // Read from the socket into te buffer
         readBulkDataFromSocket(cfd, cmd_pckt.numBytes, session_ptr->getDMAWriteBuffer());
         session_ptr->enqueDMAWrite(cmd_pckt.addr64, cmd_pckt.numBytes, std::time(nullptr));
+        // Has to come off the FPGA if the session is preempted
+        session_ptr->markDRAMDirty(cmd_pckt.addr64, cmd_pckt.numBytes);
 
         pending_dma_session_id.push(session_id);
         pending_dma_operation_type.push(DMA_OPERATION::WRITE);
@@ -396,6 +1293,7 @@ public:
         writeResponsePacket(cfd, resp_pckt);
         // Make sure the read buffer for this session is big enough, resize if not
         session_ptr->checkAndResizeDMAReadBuffer(cmd_pckt.numBytes);
+        session_ptr->enqueDMARead(cmd_pckt.addr64, cmd_pckt.numBytes, std::time(nullptr));
 
         pending_dma_session_id.push(session_id);
         pending_dma_operation_type.push(DMA_OPERATION::READ);
@@ -421,16 +1319,30 @@ public:
         if (!session_ptr->isDMAReadBufferBusy()) {
             resp_pckt.errorcode = aos_errcode::INVALID_REQUEST;
             writeResponsePacket(cfd, resp_pckt);
+            return 0;
+        }
+
+        // A read of a session without a slot waits for one like a lazy CntrlReg read, the replay comes back here
+        if (!session_ptr->isDMAReadComplete()) {
+            uint64_t wait_fpga_id;
+            if (!isDummy && !isSessionScheduled(session_id) && !handleScheduling(session_id, wait_fpga_id)) {
+                return parkRequest(cfd, cmd_pckt, wait_fpga_id);
+            }
+            scheduleDMAOperations();
+        }
+        if (!session_ptr->isDMAReadComplete()) {
+            resp_pckt.errorcode = aos_errcode::RETRY;
+            writeResponsePacket(cfd, resp_pckt);
+            return 0;
         }
 
         // Let the client know the read is complete and how many bytes it was
         resp_pckt.errorcode = aos_errcode::SUCCESS;
         resp_pckt.numBytes = session_ptr->getDMAReadSize();
+        writeResponsePacket(cfd, resp_pckt);
 
         // Send the read results to the client
-        if (write(cfd, session_ptr->getDMAReadBuffer(), session_ptr->getDMAReadSize()) == -1) {
-            printErrorHost("Daemon socket write error");
-        }
+        writeSocketPayload(cfd, session_ptr->getDMAReadBuffer(), session_ptr->getDMAReadSize());
 
         // Clear the DMA read buffer's status
         session_ptr->clearPendingDMARead();
@@ -438,6 +1350,39 @@ public:
         return 0;
     }
 
+    /*
+    Answers with getStatsJson, numBytes of the response is the length of
+    the JSON text that follows it.
+    */
+    int handleGetStatsRequest(int cfd, aos_socket_command_packet & cmd_pckt) {
+        const std::string stats = getStatsJson().dump();
+
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.errorcode  = aos_errcode::SUCCESS;
+        resp_pckt.session_id = cmd_pckt.session_id;
+        resp_pckt.numBytes   = stats.size();
+        writeResponsePacket(cfd, resp_pckt);
+        writeSocketPayload(cfd, stats.data(), stats.size());
+        return 0;
+    }
+
+    // Answers with the trace rings as Chrome trace JSON, sent like GET_STATS
+    int handleGetTraceRequest(int cfd, aos_socket_command_packet & cmd_pckt) {
+        std::ostringstream trace;
+        dumpTrace(trace);
+        const std::string trace_json = trace.str();
+
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.errorcode  = aos_errcode::SUCCESS;
+        resp_pckt.session_id = cmd_pckt.session_id;
+        resp_pckt.numBytes   = trace_json.size();
+        writeResponsePacket(cfd, resp_pckt);
+        writeSocketPayload(cfd, trace_json.data(), trace_json.size());
+        return 0;
+    }
+
     int handleIntiateSession(int cfd, aos_socket_command_packet & cmd_pckt) {
         std::string app_id(cmd_pckt.char_buf);
 
@@ -452,9 +1397,7 @@ public:
             return 0;
         }
 
-        session_id_t new_session_id = generateNewSessionId();
-
-        sessions[new_session_id] = new aos_app_session(app_id, new_session_id);
+        const session_id_t new_session_id = openSession(app_id, (cmd_pckt.data64 & AOS_SESSION_NONBLOCKING) == 0);
 
         aos_socket_response_packet resp_pckt;
         resp_pckt.errorcode = aos_errcode::SUCCESS;
@@ -467,7 +1410,41 @@ public:
     }
 
     int handleEndSession(aos_socket_command_packet & cmd_pckt) {
-        const session_id_t session_id = cmd_pckt.session_id;
+        closeSession(cmd_pckt.session_id);
+        return 0;
+    }
+
+    // Everything a new session needs short of the socket reply
+    session_id_t openSession(const std::string & app_id, bool blocking) {
+        session_id_t new_session_id = generateNewSessionId();
+
+        sched->recordSessionArrival(app_id, monotonic_ns());
+        fleet_changed = true;
+
+        sessions[new_session_id] = new aos_app_session(app_id, new_session_id);
+        sessions[new_session_id]->setShadowRanges(sched->getShadowRegRanges(app_id));
+        sessions[new_session_id]->setBlocking(blocking);
+        sessions_opened_counter.add();
+        outstanding_sessions[app_id]++;
+        unscheduled_sessions[app_id]++;
+
+        replanPlacement(sched->getAppIdx(app_id));
+
+        // Dummy mode has no FPGA to raise interrupts, give the session a stand-in source
+        if (isDummy) {
+            int irq_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (irq_fd == -1) {
+                perror("Unable to create stand-in interrupt eventfd");
+            } else {
+                dummy_irq_fd[new_session_id] = irq_fd;
+                addEpollSource(irq_fd, EPOLL_SOURCE::DUMMY_IRQ, new_session_id);
+            }
+        }
+
+        return new_session_id;
+    }
+
+    void closeSession(session_id_t session_id) {
         // check if the session was valid
         if (!isSessionIdValid(session_id)) {
             // Invalid session
@@ -478,16 +1455,96 @@ public:
         if (isSessionScheduled(session_id)) {
             const uint64_t fpga_id = getFPGAId(session_id);
             const uint64_t slot_id = getSlotId(session_id);
-            unbindAppFromSlot(fpga_id, slot_id);
+            // Nothing to resume, skip the state capture
+            unbindAppFromSlot(fpga_id, slot_id, false);
             resetSlotState(fpga_id, slot_id);
         }
 
+        mode_switch_tenants.erase(session_id);
+        releaseDRAMPages(sessions[session_id]);
+
+        // Tear down the stand-in interrupt source
+        if (dummy_irq_fd.find(session_id) != dummy_irq_fd.end()) {
+            close(dummy_irq_fd[session_id]);
+            dummy_irq_fd.erase(session_id);
+        }
+
+        outstanding_sessions[sessions[session_id]->getAppId()]--;
+        unscheduled_sessions[sessions[session_id]->getAppId()]--;
+
         // Remove the session
+        delete sessions[session_id];
         sessions.erase(session_id);
+        fleet_changed = true;
+        sessions_closed_counter.add();
+    }
+
+    int handleCompletionEventFdRequest(int cfd, aos_socket_command_packet & cmd_pckt) {
+        const session_id_t session_id = cmd_pckt.session_id;
+
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.session_id = session_id;
+
+        if (!isSessionIdValid(session_id)) {
+            resp_pckt.errorcode = aos_errcode::INVALID_SESSION_ID;
+            writeResponsePacket(cfd, resp_pckt);
+            return 0;
+        }
+
+        const int event_fd = sessions[session_id]->getCompletionEventFd();
+        if (event_fd == -1) {
+            resp_pckt.errorcode = aos_errcode::UNKNOWN_FAILURE;
+            writeResponsePacket(cfd, resp_pckt);
+            return 1;
+        }
+
+        resp_pckt.errorcode = aos_errcode::SUCCESS;
+        writeResponsePacketWithFd(cfd, resp_pckt, event_fd);
 
         return 0;
     }
 
+    /*
+    Stand-in for an FPGA user interrupt in dummy mode, signals the
+    session's completion eventfd through the same path as real hardware
+    */
+    void raiseDummyInterrupt(session_id_t session_id) {
+        if (dummy_irq_fd.find(session_id) == dummy_irq_fd.end()) {
+            return;
+        }
+        uint64_t count = 1;
+        if (write(dummy_irq_fd[session_id], &count, sizeof(uint64_t)) == -1) {
+            perror("Unable to raise stand-in interrupt");
+        }
+    }
+
+    /*
+    Dummy and simulated mode have no app to raise an interrupt, a write
+    to the app's declared done_reg stands in for it. The simulated backend
+    signals the slot's event source, dummy mode the session's, and the
+    epoll loop forwards either to the completion eventfd.
+    */
+    void raiseStandInInterrupt(session_id_t session_id, uint64_t addr) {
+        uint64_t done_addr;
+        if (!sched->getDoneReg(sessions[session_id]->getAppId(), done_addr) || (addr != done_addr)) {
+            return;
+        }
+        if (isDummy) {
+            raiseDummyInterrupt(session_id);
+            return;
+        }
+        const uint64_t fpga_id = getFPGAId(session_id);
+        const uint64_t slot_id = getSlotId(session_id);
+        if ((slot_id >= user_irq_fd[fpga_id].size()) || (user_irq_fd[fpga_id][slot_id] == -1)) {
+            return;
+        }
+        uint64_t count = 1;
+        if (write(user_irq_fd[fpga_id][slot_id], &count, sizeof(uint64_t)) == -1) {
+            perror("Unable to raise simulated interrupt");
+        }
+    }
+
     session_id_t generateNewSessionId() {
         session_id_t tmp = next_session_id;
         next_session_id += 1;
@@ -498,6 +1555,25 @@ public:
         assert(pcie_slot_id < num_fpga);
         assert(!interfaces_enabled[pcie_slot_id]);
 
+        // The simulated backend keeps BAR1 in memory, an eventfd per slot stands in for its user interrupt
+        if (isSimulated) {
+            sim_bar1[pcie_slot_id].clear();
+            sim_dram[pcie_slot_id].clear();
+            const uint64_t num_slots = slot_session_map[pcie_slot_id].size();
+            user_irq_fd[pcie_slot_id].assign(num_slots, -1);
+            for (uint64_t slot_id = 0; (slot_id < num_slots) && (slot_id < NUM_USER_IRQS); slot_id++) {
+                int irq_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (irq_fd == -1) {
+                    perror("Unable to create simulated interrupt eventfd");
+                    continue;
+                }
+                user_irq_fd[pcie_slot_id][slot_id] = irq_fd;
+                addEpollSource(irq_fd, EPOLL_SOURCE::USER_IRQ, (pcie_slot_id << 16) | slot_id);
+            }
+            interfaces_enabled[pcie_slot_id] = true;
+            return 0;
+        }
+
         /*
         Only should be called once
         int rc = fpga_init();
@@ -510,6 +1586,8 @@ public:
         attach_pci_bar1(pcie_slot_id);
         // BAR 4
         attach_pci_bar4(pcie_slot_id);
+        // User interrupts
+        attach_user_irqs(pcie_slot_id);
         // XDMA channels
         //attach_xdma_write(pcie_slot_id);
         //attach_xdma_read(pcie_slot_id);
@@ -521,10 +1599,17 @@ public:
 
     int detach_from_image(int fpga_id) {
         assert(interfaces_enabled[fpga_id]);
+        if (isSimulated) {
+            detach_user_irqs(fpga_id);
+            interfaces_enabled[fpga_id] = false;
+            return 0;
+        }
         // BAR 1
         detach_pci_bar1(fpga_id);
         // BAR 4
         detach_pci_bar4(fpga_id);
+        // User interrupts
+        detach_user_irqs(fpga_id);
         // XDMA Channels
         //detach_xdma_write(fpga_id);
         //detach_xdma_read(fpga_id);
@@ -643,6 +1728,39 @@ public:
             return 1;
     } 
 
+    int attach_user_irqs(uint64_t fpga_id) {
+        const uint64_t num_slots = slot_session_map[fpga_id].size();
+        user_irq_fd[fpga_id].assign(num_slots, -1);
+        for (uint64_t slot_id = 0; (slot_id < num_slots) && (slot_id < NUM_USER_IRQS); slot_id++) {
+            // Form the event device name
+            std::stringstream irq_name;
+            irq_name << "/dev/xdma";
+            irq_name << fpga_id;
+            irq_name << "_events_";
+            irq_name << slot_id;
+            int irq_fd = open(irq_name.str().c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (irq_fd == -1) {
+                irq_name << " failed to open";
+                perror(irq_name.str().c_str());
+                continue;
+            }
+            user_irq_fd[fpga_id][slot_id] = irq_fd;
+            addEpollSource(irq_fd, EPOLL_SOURCE::USER_IRQ, (fpga_id << 16) | slot_id);
+        }
+        return 0;
+    }
+
+    int detach_user_irqs(uint64_t fpga_id) {
+        for (auto & irq_fd : user_irq_fd[fpga_id]) {
+            if (irq_fd != -1) {
+                // Closing the fd also removes it from the epoll set
+                close(irq_fd);
+            }
+        }
+        user_irq_fd[fpga_id].clear();
+        return 0;
+    }
+
     int detach_xdma_write(uint64_t fpga_id) {
         std::stringstream write_channel_name;
         write_channel_name << "/dev/xdma";
@@ -674,45 +1792,178 @@ public:
     }
 
     int write_pci_bar1(uint64_t fpga_id, uint64_t slot_id, uint64_t addr, uint64_t value) {
+        zeroSlotDRAM(fpga_id, slot_id);
+        aos_latency_timer timer(getStageHistogram(STAGE_MMIO));
+        aos_trace_span span("bar1_write", current_trace_session, fpga_id, slot_id);
+        AOS_PROBE4(mmio_write, fpga_id, slot_id, addr, value);
+        mmio_write_counter.add();
         // Check the address is 64-bit aligned
         if ((addr % 8) != 0) {
             printf("Addr is not correctly aligned");
             assert(false);
         }
         int rc;
+        uint64_t bar1_addr;
 
-        rc = fpga_pci_poke(pci_bar1_handle[fpga_id], applySlotMaskForBAR1(slot_id, addr), lower32(value));
-        fail_on(rc, out, "Unable to write first half of BAR1 write");
-
-        rc = fpga_pci_poke(pci_bar1_handle[fpga_id], applySlotMaskForBAR1(slot_id, addr + 0x04), upper32(value));
-        fail_on(rc, out, "Unable to write second half of BAR1 write");
+        rc = (translateBAR1Addr(fpga_id, slot_id, addr, bar1_addr) ? 0 : 1);
+        fail_on(rc, out, "BAR1 write outside of the slot's register window");
 
-        return rc;
+        return poke_bar1(fpga_id, bar1_addr, value);
         out:
             return 1;
     }
 
     int read_pci_bar1(uint64_t fpga_id, uint64_t slot_id, uint64_t addr, uint64_t & value) {
+        zeroSlotDRAM(fpga_id, slot_id);
+        aos_latency_timer timer(getStageHistogram(STAGE_MMIO));
+        aos_trace_span span("bar1_read", current_trace_session, fpga_id, slot_id);
+        mmio_read_counter.add();
         // Check the address is 64-bit aligned
         if ((addr % 8) != 0) {
             printf("Addr is not correctly aligned");
             assert(false);
         }
         int rc;
-        uint32_t bottomVal;
-        uint32_t upperVal;
+        uint64_t bar1_addr;
 
-        rc = fpga_pci_peek(pci_bar1_handle[fpga_id], applySlotMaskForBAR1(slot_id, addr) , &bottomVal);
-        fail_on(rc, out, "Unable to do first read for BAR1");
+        rc = (translateBAR1Addr(fpga_id, slot_id, addr, bar1_addr) ? 0 : 1);
+        fail_on(rc, out, "BAR1 read outside of the slot's register window");
 
-        rc = fpga_pci_peek(pci_bar1_handle[fpga_id], applySlotMaskForBAR1(slot_id, addr + 0x04) , &upperVal);
-        fail_on(rc, out, "Unable to do second read for BAR1");
+        rc = peek_bar1(fpga_id, bar1_addr, value);
+        fail_on(rc, out, "Unable to read BAR1");
+        AOS_PROBE4(mmio_read, fpga_id, slot_id, addr, value);
 
-        // Combine them for the final value
-        value = (uint64_t)bottomVal | (((uint64_t)upperVal) << 32);
+        return rc;
+        out:
+            return 1;
+    }
+
+    /*
+    Latches the memory counters of every slot in the shell at once, then
+    reads back those of each slot of the loaded image, indexed by slot.
+    The counters run from the image load, so rates come from the
+    difference of two snapshots. All zeros on the simulated backend.
+    */
+    int snapshotMemCounters(uint64_t fpga_id, std::vector<aos_mem_counters> & slot_counters) {
+        aos_latency_timer timer(getStageHistogram(STAGE_MMIO));
+        aos_trace_span span("mem_counters", TRACE_NO_ID, fpga_id, TRACE_NO_ID);
+        int rc;
+        uint64_t num_slots;
+        slot_counters.clear();
+
+        rc = (areInterfacesEnabled(fpga_id) && (sched->getCurrentImageIdx(fpga_id) != NO_IMAGE_LOADED)) ? 0 : 1;
+        fail_on(rc, out, "No image to read memory counters from");
+        num_slots = slot_bar1_base[fpga_id].size();
+        rc = (num_slots <= MEM_STATS_MAX_SLOTS) ? 0 : 1;
+        fail_on(rc, out, "More slots than the memory counter window holds");
+
+        rc = poke_bar1(fpga_id, MEM_STATS_BAR1_BASE, 1);
+        fail_on(rc, out, "Unable to latch the memory counters");
+
+        slot_counters.resize(num_slots);
+        for (uint64_t slot_id = 0; slot_id < num_slots; slot_id++) {
+            uint64_t * counter = reinterpret_cast<uint64_t *>(&slot_counters[slot_id]);
+            const uint64_t slot_base = MEM_STATS_BAR1_BASE + (slot_id << MEM_STATS_SLOT_SHIFT);
+            for (uint64_t counter_idx = 0; counter_idx < (sizeof(aos_mem_counters) / sizeof(uint64_t)); counter_idx++) {
+                rc = peek_bar1(fpga_id, slot_base + (counter_idx * 8), counter[counter_idx]);
+                fail_on(rc, out, "Unable to read a memory counter");
+            }
+        }
+
+        return 0;
+        out:
+            slot_counters.clear();
+            return 1;
+    }
 
+    /*
+    Streams num_bytes of the DRAM partition of slot_id, starting at the app
+    address addr, into buf. The simulated backend keeps DRAM in memory,
+    pages that were never written read as zero. Zeroing queued for the
+    slot is issued first, here and on every other access to the slot.
+    */
+    int dma_read_dram(uint64_t fpga_id, uint64_t slot_id, uint64_t addr, char * buf, uint64_t num_bytes) {
+        zeroSlotDRAM(fpga_id, slot_id);
+        aos_latency_timer timer(getStageHistogram(STAGE_DMA));
+        aos_trace_span span("dma_read", current_trace_session, fpga_id, slot_id);
+        dma_read_bytes_counter.add(num_bytes);
+        int rc;
+        uint64_t dram_addr;
+
+        rc = (translateDRAMAddr(slot_id, addr, num_bytes, dram_addr) ? 0 : 1);
+        fail_on(rc, out, "DMA read outside of the slot's DRAM partition");
+
+        if (isSimulated) {
+            for (uint64_t offset = 0; offset < num_bytes; ) {
+                const uint64_t page_addr   = ((dram_addr + offset) / DRAM_PAGE_BYTES) * DRAM_PAGE_BYTES;
+                const uint64_t page_offset = (dram_addr + offset) - page_addr;
+                const uint64_t len = std::min(DRAM_PAGE_BYTES - page_offset, num_bytes - offset);
+                auto page_it = sim_dram[fpga_id].find(page_addr);
+                if (page_it == sim_dram[fpga_id].end()) {
+                    memset(buf + offset, 0, len);
+                } else {
+                    memcpy(buf + offset, page_it->second.data() + page_offset, len);
+                }
+                offset += len;
+            }
+            AOS_PROBE5(dma_read_done, fpga_id, slot_id, addr, num_bytes, 0);
+            return 0;
+        }
+
+        if (xdma_read_channel[fpga_id] == 0) {
+            attach_xdma_read(fpga_id);
+        }
+        rc = (xdma_read_channel[fpga_id] < 0) ? 1 : 0;
+        fail_on(rc, out, "XDMA read channel is not available");
+
+        rc = fpga_dma_burst_read(xdma_read_channel[fpga_id], (uint8_t *)buf, num_bytes, dram_addr);
+        fail_on(rc, out, "Unable to DMA from FPGA DRAM");
+
+        AOS_PROBE5(dma_read_done, fpga_id, slot_id, addr, num_bytes, rc);
+        return rc;
+        out:
+            AOS_PROBE5(dma_read_done, fpga_id, slot_id, addr, num_bytes, 1);
+            return 1;
+    }
+
+    int dma_write_dram(uint64_t fpga_id, uint64_t slot_id, uint64_t addr, char * buf, uint64_t num_bytes) {
+        zeroSlotDRAM(fpga_id, slot_id);
+        aos_latency_timer timer(getStageHistogram(STAGE_DMA));
+        aos_trace_span span("dma_write", current_trace_session, fpga_id, slot_id);
+        dma_write_bytes_counter.add(num_bytes);
+        int rc;
+        uint64_t dram_addr;
+
+        rc = (translateDRAMAddr(slot_id, addr, num_bytes, dram_addr) ? 0 : 1);
+        fail_on(rc, out, "DMA write outside of the slot's DRAM partition");
+
+        if (isSimulated) {
+            for (uint64_t offset = 0; offset < num_bytes; ) {
+                const uint64_t page_addr   = ((dram_addr + offset) / DRAM_PAGE_BYTES) * DRAM_PAGE_BYTES;
+                const uint64_t page_offset = (dram_addr + offset) - page_addr;
+                const uint64_t len = std::min(DRAM_PAGE_BYTES - page_offset, num_bytes - offset);
+                std::vector<char> & page = sim_dram[fpga_id][page_addr];
+                page.resize(DRAM_PAGE_BYTES, 0);
+                memcpy(page.data() + page_offset, buf + offset, len);
+                offset += len;
+            }
+            AOS_PROBE5(dma_write_done, fpga_id, slot_id, addr, num_bytes, 0);
+            return 0;
+        }
+
+        if (xdma_write_channel[fpga_id] == 0) {
+            attach_xdma_write(fpga_id);
+        }
+        rc = (xdma_write_channel[fpga_id] < 0) ? 1 : 0;
+        fail_on(rc, out, "XDMA write channel is not available");
+
+        rc = fpga_dma_burst_write(xdma_write_channel[fpga_id], (uint8_t *)buf, num_bytes, dram_addr);
+        fail_on(rc, out, "Unable to DMA to FPGA DRAM");
+
+        AOS_PROBE5(dma_write_done, fpga_id, slot_id, addr, num_bytes, rc);
         return rc;
         out:
+            AOS_PROBE5(dma_write_done, fpga_id, slot_id, addr, num_bytes, 1);
             return 1;
     }
 
@@ -720,6 +1971,8 @@ private:
 
     // Scheduler
     aos_scheduler * sched;
+    // Fleet wide image placement, re-planned as sessions arrive
+    aos_placement * placement;
     // Num FPGAS
     const uint64_t num_fpga;
     // Image information
@@ -728,24 +1981,296 @@ private:
     session_id_t next_session_id; // make this more secure at some point
     // Map session_id to session object
     std::map<session_id_t, aos_app_session *> sessions;
+    // Sessions per app id, kept up to date so demand is not a walk over every session
+    std::map<std::string, uint32_t> outstanding_sessions;
+    std::map<std::string, uint32_t> unscheduled_sessions; // not bound to a slot
     // Map slot to session object
     std::vector<std::map<uint64_t, aos_app_session *>> slot_session_map; // should be cleared when an image is switched
     // Map slot to app names
     std::vector<std::map<uint64_t, std::string>> slot_appid_map; // function of the currently loaded image
+    // Per slot BAR1 register windows, [base, limit), function of the currently loaded image
+    std::vector<std::vector<uint64_t>> slot_bar1_base;
+    std::vector<std::vector<uint64_t>> slot_bar1_limit;
+    // Per slot, the last session whose registers and DRAM the slot may still hold, NO_SESSION_ID if clean
+    std::vector<std::vector<session_id_t>> slot_last_session;
 
     // Dummy behavior
     const bool isDummy;
     std::map<uint64_t, std::map<uint64_t, uint64_t>> dummy_cntrlreg_map;
 
+    // Simulated backend, the scheduler runs but BAR1 and image loads are stand-ins
+    const bool isSimulated;
+    std::vector<std::map<uint64_t, uint64_t>> sim_bar1; // per FPGA, by BAR1 address
+    std::vector<std::map<uint64_t, std::vector<char>>> sim_dram; // per FPGA, DRAM_PAGE_BYTES pages by DRAM address
+
+    // Asynchronous reconfiguration, per FPGA
+    std::vector<bool> fpga_reconfiguring;
+    std::vector<uint32_t> reconfig_image_idx;
+    std::vector<int> reconfig_result; // written by the worker before it signals
+    std::vector<std::thread> reconfig_worker;
+    std::vector<int> reconfig_done_fd;
+    std::vector<std::deque<aos_parked_request>> parked_requests;
+    uint64_t num_avoided_reconfigs; // switches to an image that was already resident
+
+    // Speculative prefetch, loads started before any request needed them
+    const bool speculative_prefetch;
+    uint64_t prefetch_horizon_ns;
+    std::vector<bool> reconfig_speculative; // per FPGA, the in flight load was speculative
+    uint64_t num_speculative_loads;
+    uint64_t num_speculative_hits;    // a request found its image already loading
+    uint64_t num_speculative_cancels; // a request needed the FPGA for something else
+    // Live migration, see migrateSession
+    uint64_t num_migrations;
+    uint64_t total_migration_ns;
+    // Mode switching, see checkFPGAModes
+    bool mode_switching;
+    double single_tenant_speedup;
+    uint32_t consolidate_demand;
+    std::vector<bool> single_tenant_mode; // per FPGA, holds the image a mode switch picked for its lone tenant
+    std::map<session_id_t, uint64_t> mode_switch_tenants; // saved tenants waiting for their FPGA's new image
+    uint64_t num_single_tenant_switches;
+    uint64_t num_consolidations;
+
+    // Joint placement of the outstanding demand, loads it starts count as speculative
+    const bool fleet_placement;
+    PlacementPlan placement_plan;
+    uint64_t num_replans;
+
     // CntrlReq read/response state
     const bool lazy_reads;
     std::map<uint64_t, std::queue<uint64_t>> cntrlreg_read_request_queue;
     std::map<uint64_t, std::queue<uint64_t>> cntrlreg_read_response_queue;
+    // Keep a per session copy of written CntrlRegs
+    const bool shadow_cntrlregs;
+
+    // Image selection
+    uint64_t reconfig_horizon_ns;
+
+    // Victim selection
+    EVICTION_POLICY slot_eviction_policy;
+    EVICTION_POLICY fpga_eviction_policy;
+    uint64_t active_threshold_ns;
+    std::vector<std::vector<aos_access_stats>> slot_access_stats; // per FPGA, per slot of the loaded image
+    std::vector<aos_access_stats> fpga_access_stats; // per FPGA, since the daemon started
+
+    // Admission control
+    uint64_t eviction_hysteresis_ns;
+    uint64_t min_slot_residency_ns;
+    uint64_t min_image_residency_ns;
+    std::vector<uint64_t> image_installed_ns; // per FPGA, monotonic
+    aos_admission_queue<aos_parked_request> admission_queue;
+    bool admission_replay_pending; // a slot freed up since the queue was last replayed
+    bool replaying_admission;
+    bool fleet_changed; // a session came, went, was bound or unbound, or an image came up since the fleet passes last ran
+    int admission_timer_fd;
+    aos_admission_stats admission_stats;
+    const uint64_t start_ns;
+
+    // Offline simulation
+    bool virtual_reconfig;
+    std::vector<uint64_t> reconfig_done_ns; // per FPGA, when a virtual load is due
+    bool verbose_scheduling;
+
+    // Completion notification
+    int epoll_fd;
+    std::vector<std::vector<int>> user_irq_fd; // per FPGA, per slot XDMA event devices
+    std::map<session_id_t, int> dummy_irq_fd; // stand-in interrupt sources for dummy mode
 
     // Keep track of DMA writes/reads that need to happen
     std::queue<uint64_t> pending_dma_session_id;
     std::queue<DMA_OPERATION> pending_dma_operation_type;
 
+    // State capture, staging for one streamed transfer and what preemption has cost so far
+    char * state_dma_buffer;
+    aos_preemption_stats preemption_stats;
+    // Data locality, per FPGA, per slot, the session whose data each DRAM page of the partition holds
+    std::vector<std::map<uint64_t, std::map<uint64_t, session_id_t>>> dram_page_owner;
+    // Per FPGA, per slot, runs of DRAM a reset left to zero and the all zero source they are streamed from
+    std::vector<std::map<uint64_t, std::vector<dram_range_t>>> pending_dram_zeroing;
+    char * zero_dma_buffer;
+    uint64_t num_local_rebinds;
+    // Latency, NUM_LATENCY_STAGES histograms per command row, the row of the request being handled
+    aos_latency_histogram * command_latency;
+    uint32_t current_latency_row;
+    // Session of the request being handled, its spans are tagged with it
+    uint64_t current_trace_session;
+    // Metrics, counters are added to on the hot paths, gauges are published by the epoll loop
+    aos_metric_counter * request_counter; // per command
+    aos_metric_counter sessions_opened_counter;
+    aos_metric_counter sessions_closed_counter;
+    aos_metric_counter slot_bind_counter;
+    aos_metric_counter slot_evict_counter;
+    aos_metric_counter reconfig_counter[NUM_RECONFIG_OUTCOMES];
+    aos_metric_counter reconfig_ns_counter;
+    aos_metric_counter mmio_read_counter;
+    aos_metric_counter mmio_write_counter;
+    aos_metric_counter dma_read_bytes_counter;
+    aos_metric_counter dma_write_bytes_counter;
+    std::vector<uint64_t> reconfig_begin_ns; // per FPGA, monotonic
+    std::atomic<uint64_t> gauge_sessions;
+    std::atomic<uint64_t> gauge_admission_queue;
+    std::atomic<uint64_t> gauge_pending_dma;
+    std::atomic<uint64_t> gauge_pending_reads;
+    aos_fpga_gauges * fpga_gauges;
+    int metrics_fd;
+    std::atomic<bool> metrics_stop;
+    std::thread metrics_thread;
+
+    static uint32_t getLatencyRow(aos_socket_command command) {
+        const uint32_t row = (uint32_t)command;
+        return (row < NUM_SOCKET_COMMANDS) ? row : BACKGROUND_LATENCY_ROW;
+    }
+
+    static const char * getLatencyRowName(uint32_t row) {
+        static const char * names[NUM_SOCKET_COMMANDS + 1] = {
+            "INTIATE_SESSION", "END_SESSION", "CNTRLREG_READ_REQUEST", "CNTRLREG_READ_RESPONSE",
+            "CNTRLREG_WRITE_REQUEST", "CNTRLREG_WRITE_RESPONSE", "BULKDATA_READ_REQUEST", "BULKDATA_READ_RESPONSE",
+            "BULKDATA_WRITE_REQUEST", "BULKDATA_WRITE_RESPONSE", "COMPLETION_EVENTFD_REQUEST", "GET_STATS", "GET_TRACE", "BACKGROUND"
+        };
+        return names[std::min(row, (uint32_t)BACKGROUND_LATENCY_ROW)];
+    }
+
+    // Metrics exporter
+    static void writeMetricHeader(std::ostream & out, const char * name, const char * type, const char * help) {
+        out << "# HELP " << name << " " << help << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+    }
+
+    static std::string formatSeconds(uint64_t value_ns) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%llu.%09llu", (unsigned long long)(value_ns / 1000000000ULL), (unsigned long long)(value_ns % 1000000000ULL));
+        return std::string(buf);
+    }
+
+    // Copies what the exporter reports as gauges out of daemon state, on the daemon thread
+    void publishMetrics() {
+        gauge_sessions.store(sessions.size(), std::memory_order_relaxed);
+        gauge_admission_queue.store(admission_queue.size(), std::memory_order_relaxed);
+        gauge_pending_dma.store(getNumPendingDMAOperations(), std::memory_order_relaxed);
+        uint64_t num_pending_reads = 0;
+        for (auto & read_queue : cntrlreg_read_request_queue) {
+            num_pending_reads += read_queue.second.size();
+        }
+        gauge_pending_reads.store(num_pending_reads, std::memory_order_relaxed);
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            uint64_t num_bound = 0;
+            for (auto & slot_session : slot_session_map[fpga_id]) {
+                if (slot_session.second != nullptr) {
+                    num_bound++;
+                }
+            }
+            fpga_gauges[fpga_id].num_slots.store(slot_session_map[fpga_id].size(), std::memory_order_relaxed);
+            fpga_gauges[fpga_id].bound_slots.store(num_bound, std::memory_order_relaxed);
+            fpga_gauges[fpga_id].parked_requests.store(parked_requests[fpga_id].size(), std::memory_order_relaxed);
+            fpga_gauges[fpga_id].reconfiguring.store(fpga_reconfiguring[fpga_id] ? 1 : 0, std::memory_order_relaxed);
+        }
+    }
+
+    // Exporter thread, one response per connection until the destructor shuts the socket down
+    void metricsLoop() {
+        while (!metrics_stop.load(std::memory_order_relaxed)) {
+            const int cfd = accept(metrics_fd, NULL, NULL);
+            if (cfd == -1) {
+                if ((errno == EINTR) || (errno == ECONNABORTED)) {
+                    continue;
+                }
+                if (!metrics_stop.load(std::memory_order_relaxed)) {
+                    perror("Metrics accept error");
+                }
+                break;
+            }
+            serveMetricsScrape(cfd);
+            close(cfd);
+        }
+    }
+
+    void serveMetricsScrape(int cfd) {
+        // The request itself does not matter, read it so the client sees a clean close
+        timeval timeout;
+        timeout.tv_sec  = METRICS_REQUEST_TIMEOUT_MS / 1000;
+        timeout.tv_usec = (METRICS_REQUEST_TIMEOUT_MS % 1000) * 1000;
+        setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeval));
+        std::string request;
+        char buf[512];
+        while ((request.size() < METRICS_REQUEST_MAX_BYTES) && (request.find("\r\n\r\n") == std::string::npos)) {
+            const ssize_t num_read = read(cfd, buf, sizeof(buf));
+            if (num_read <= 0) {
+                break;
+            }
+            request.append(buf, num_read);
+        }
+
+        const std::string body = getMetricsText();
+        std::ostringstream response;
+        response << "HTTP/1.1 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 << "Content-Length: " << body.size() << "\r\n"
+                 << "Connection: close\r\n\r\n"
+                 << body;
+        const std::string out = response.str();
+        uint64_t sent = 0;
+        while (sent < out.size()) {
+            // A scraper that hung up must not take the daemon down with SIGPIPE
+            const ssize_t num_written = send(cfd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if (num_written <= 0) {
+                return;
+            }
+            sent += num_written;
+        }
+    }
+
+    aos_latency_histogram * getStageHistogram(LATENCY_STAGE stage) {
+        return &command_latency[(current_latency_row * NUM_LATENCY_STAGES) + stage];
+    }
+
+    void addEpollSource(int fd, EPOLL_SOURCE source, uint64_t source_id) {
+        epoll_event event;
+        memset(&event, 0, sizeof(epoll_event));
+        event.events   = EPOLLIN;
+        event.data.u64 = (((uint64_t)source) << EPOLL_SOURCE_SHIFT) | (source_id & EPOLL_ID_MASK);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+            perror("epoll_ctl add");
+        }
+    }
+
+    /*
+    The app in a slot raised its user interrupt, forward it to whichever
+    session is bound there. Interrupts from unbound slots are dropped.
+    */
+    void handleUserInterrupt(uint64_t fpga_id, uint64_t slot_id) {
+        if ((fpga_id >= num_fpga) || (slot_id >= user_irq_fd[fpga_id].size())) {
+            return;
+        }
+        // Acknowledge, the XDMA event device returns a 32 bit event count, the simulated backend's eventfd a 64 bit one
+        uint64_t num_irqs = 0;
+        if (read(user_irq_fd[fpga_id][slot_id], &num_irqs, isSimulated ? sizeof(uint64_t) : sizeof(uint32_t)) == -1) {
+            if (errno != EAGAIN) {
+                perror("Unable to read user interrupt");
+            }
+            return;
+        }
+        aos_app_session * session_ptr = slot_session_map[fpga_id][slot_id];
+        if (session_ptr != nullptr) {
+            session_ptr->signalCompletion();
+        }
+    }
+
+    void handleDummyInterrupt(session_id_t session_id) {
+        if (dummy_irq_fd.find(session_id) == dummy_irq_fd.end()) {
+            return;
+        }
+        uint64_t num_irqs = 0;
+        if (read(dummy_irq_fd[session_id], &num_irqs, sizeof(uint64_t)) == -1) {
+            if (errno != EAGAIN) {
+                perror("Unable to read stand-in interrupt");
+            }
+            return;
+        }
+        if (isSessionIdValid(session_id)) {
+            sessions[session_id]->signalCompletion();
+        }
+    }
+
     bool areInterfacesEnabled(uint64_t fpga_id) const {
         assert(fpga_id < num_fpga);
         return interfaces_enabled[fpga_id];
@@ -771,7 +2296,7 @@ private:
         if (cntrlreg_read_response_queue.find(app_id) == cntrlreg_read_response_queue.end()) {
             cntrlreg_read_response_queue[app_id] = std::queue<uint64_t>();
         }
-        //std::cout << "Daemon Enqueu resp: " << data64 << " for app: " << app_id << std::endl << std::flush;
+        AOS_LOG_DEBUG("Daemon Enqueu resp: " << data64 << " for app: " << app_id);
         cntrlreg_read_response_queue[app_id].push(data64);
     }
 
@@ -783,7 +2308,7 @@ private:
             perror("No response ready");
         }
         uint64_t data64_ = cntrlreg_read_response_queue[app_id].front();
-        //std::cout << "Daemon Deqeue resp: " << data64_ << " for app: " << app_id << std::endl << std::flush;
+        AOS_LOG_DEBUG("Daemon Deqeue resp: " << data64_ << " for app: " << app_id);
 
         cntrlreg_read_response_queue[app_id].pop();
         return data64_;
@@ -807,9 +2332,82 @@ private:
     std::map<uint64_t, int> xdma_write_channel;
     std::map<uint64_t, int> xdma_read_channel;
 
-    // This function will apply the upper bit masks to the address
-    uint64_t applySlotMaskForBAR1(uint64_t slot_id, uint64_t addr) {
-        return (((slot_id << 13)) | addr) & 0xFFFF;
+    // Checks that a full 64-bit access at addr stays inside the slot's window
+    bool isCntrlRegAddrValid(uint64_t fpga_id, uint64_t slot_id, uint64_t addr) const {
+        if (slot_id >= slot_bar1_base[fpga_id].size()) {
+            return false;
+        }
+        const uint64_t window_size = slot_bar1_limit[fpga_id][slot_id] - slot_bar1_base[fpga_id][slot_id];
+        return (window_size >= 8) && (addr <= (window_size - 8));
+    }
+
+    // Translates an app relative register address into a BAR1 offset
+    bool translateBAR1Addr(uint64_t fpga_id, uint64_t slot_id, uint64_t addr, uint64_t & bar1_addr) const {
+        if (!isCntrlRegAddrValid(fpga_id, slot_id, addr)) {
+            return false;
+        }
+        bar1_addr = slot_bar1_base[fpga_id][slot_id] + addr;
+        return true;
+    }
+
+    // The shell's counter window has no stand-in in the simulated backend, it reads as zero
+    bool isMemStatsBAR1Addr(uint64_t bar1_addr) const {
+        return (bar1_addr >= MEM_STATS_BAR1_BASE) && (bar1_addr < (MEM_STATS_BAR1_BASE + MEM_STATS_BAR1_SIZE));
+    }
+
+    // Raw 64-bit BAR1 accesses as two 32-bit halves, the caller checks the address
+    int poke_bar1(uint64_t fpga_id, uint64_t bar1_addr, uint64_t value) {
+        int rc;
+
+        if (isSimulated) {
+            if (!isMemStatsBAR1Addr(bar1_addr)) {
+                sim_bar1[fpga_id][bar1_addr] = value;
+            }
+            return 0;
+        }
+
+        rc = fpga_pci_poke(pci_bar1_handle[fpga_id], bar1_addr, lower32(value));
+        fail_on(rc, out, "Unable to write first half of BAR1 write");
+
+        rc = fpga_pci_poke(pci_bar1_handle[fpga_id], bar1_addr + 0x04, upper32(value));
+        fail_on(rc, out, "Unable to write second half of BAR1 write");
+
+        return rc;
+        out:
+            return 1;
+    }
+
+    int peek_bar1(uint64_t fpga_id, uint64_t bar1_addr, uint64_t & value) {
+        int rc;
+        uint32_t bottomVal;
+        uint32_t upperVal;
+
+        if (isSimulated) {
+            value = isMemStatsBAR1Addr(bar1_addr) ? 0 : sim_bar1[fpga_id][bar1_addr];
+            return 0;
+        }
+
+        rc = fpga_pci_peek(pci_bar1_handle[fpga_id], bar1_addr, &bottomVal);
+        fail_on(rc, out, "Unable to do first read for BAR1");
+
+        rc = fpga_pci_peek(pci_bar1_handle[fpga_id], bar1_addr + 0x04, &upperVal);
+        fail_on(rc, out, "Unable to do second read for BAR1");
+
+        // Combine them for the final value
+        value = (uint64_t)bottomVal | (((uint64_t)upperVal) << 32);
+
+        return rc;
+        out:
+            return 1;
+    }
+
+    // App relative DRAM address to the FPGA's, the whole transfer has to stay inside the slot's partition
+    bool translateDRAMAddr(uint64_t slot_id, uint64_t addr, uint64_t num_bytes, uint64_t & dram_addr) const {
+        if ((addr >= SLOT_DRAM_PARTITION_BYTES) || (num_bytes > (SLOT_DRAM_PARTITION_BYTES - addr))) {
+            return false;
+        }
+        dram_addr = (slot_id * SLOT_DRAM_PARTITION_BYTES) + addr;
+        return true;
     }
 
     int check_afi_ready(int slot_id) {
@@ -874,15 +2472,99 @@ private:
     }
 
     /*
-    TODO: Implement
-    Resets the state of the slot, incase another session had used it prior
+    Resets the state of the slot, incase another session had used it prior.
+    The shell has no per app reset, so the registers the app declares as
+    resettable are zeroed, and every DRAM page of the partition that a
+    session put there is no longer resident and queued to be zeroed, see
+    zeroSlotDRAM. Pages of keep_session_id, the session about to be bound,
+    stay where they are.
     */
-    void resetSlotState(uint64_t fpga_id, uint64_t slot_id) {
-
-    }
-
-    /*
-    Checks if a slot is available on the current image
+    void resetSlotState(uint64_t fpga_id, uint64_t slot_id, session_id_t keep_session_id = NO_SESSION_ID) {
+        assert(fpga_id < num_fpga);
+        if ((slot_id >= slot_bar1_base[fpga_id].size()) || isDummy) {
+            return;
+        }
+        aos_trace_span span("resetSlotState", TRACE_NO_ID, fpga_id, slot_id);
+        slot_last_session[fpga_id][slot_id] = keep_session_id;
+        const std::string & app_id = slot_appid_map[fpga_id][slot_id];
+
+        for (auto & range : sched->getResetRegRanges(app_id)) {
+            for (uint64_t addr = range.first; addr < (range.first + range.second); addr += 8) {
+                if (write_pci_bar1(fpga_id, slot_id, addr, 0) != 0) {
+                    AOS_LOG_ERROR("Scheduler: Unable to reset CntrlReg " << addr << " of FPGA " << fpga_id << " slot " << slot_id);
+                }
+            }
+        }
+
+        auto slot_it = dram_page_owner[fpga_id].find(slot_id);
+        if (slot_it == dram_page_owner[fpga_id].end()) {
+            return;
+        }
+        std::map<uint64_t, session_id_t> & owners = slot_it->second;
+        std::vector<dram_range_t> & zero_runs = pending_dram_zeroing[fpga_id][slot_id];
+        auto owner_it = owners.begin();
+        while (owner_it != owners.end()) {
+            if (owner_it->second == keep_session_id) {
+                owner_it++;
+                continue;
+            }
+            // Runs of contiguous pages are zeroed in one transfer each
+            const uint64_t run_start = owner_it->first;
+            uint64_t run_end = run_start;
+            while ((owner_it != owners.end()) && (owner_it->first == run_end) && (owner_it->second != keep_session_id) &&
+                   ((run_end - run_start) < STATE_DMA_CHUNK_BYTES)) {
+                if (isSessionIdValid(owner_it->second)) {
+                    sessions[owner_it->second]->addResidentDRAMPages(fpga_id, slot_id, -1);
+                }
+                owner_it = owners.erase(owner_it);
+                run_end += DRAM_PAGE_BYTES;
+            }
+            zero_runs.push_back(dram_range_t(run_start, run_end - run_start));
+        }
+        if (zero_runs.empty()) {
+            pending_dram_zeroing[fpga_id].erase(slot_id);
+        }
+    }
+
+    /*
+    Issues the zeroing resetSlotState queued for the slot. The DMA queue
+    drains it once the request that reset the slot is answered, and every
+    BAR1 or DRAM access to the slot issues it first, so a new tenant never
+    sees the data it replaces and a restore is never zeroed after the fact.
+    */
+    void zeroSlotDRAM(uint64_t fpga_id, uint64_t slot_id) {
+        if (pending_dram_zeroing[fpga_id].empty()) {
+            return;
+        }
+        auto slot_it = pending_dram_zeroing[fpga_id].find(slot_id);
+        if (slot_it == pending_dram_zeroing[fpga_id].end()) {
+            return;
+        }
+        // Taken out first, the writes below come back through here
+        const std::vector<dram_range_t> zero_runs = std::move(slot_it->second);
+        pending_dram_zeroing[fpga_id].erase(slot_it);
+        aos_trace_span span("zero_dram", TRACE_NO_ID, fpga_id, slot_id);
+        for (auto & run : zero_runs) {
+            if (dma_write_dram(fpga_id, slot_id, run.first, zero_dma_buffer, run.second) != 0) {
+                AOS_LOG_ERROR("Scheduler: Unable to zero DRAM of FPGA " << fpga_id << " slot " << slot_id);
+            }
+        }
+    }
+
+    // A slot someone else used last is reset before session_id gets it
+    void cleanSlotFor(session_id_t session_id, uint64_t fpga_id, uint64_t slot_id) {
+        if (slot_id >= slot_last_session[fpga_id].size()) {
+            return;
+        }
+        const session_id_t last_session_id = slot_last_session[fpga_id][slot_id];
+        if ((last_session_id != NO_SESSION_ID) && (last_session_id != session_id)) {
+            resetSlotState(fpga_id, slot_id, session_id);
+        }
+        slot_last_session[fpga_id][slot_id] = session_id;
+    }
+
+    /*
+    Checks if a slot is available on the current image
     */
     bool slotAvailable(uint64_t fpga_id, std::string app_id)  {
         assert(fpga_id < num_fpga);
@@ -910,32 +2592,387 @@ private:
         return ~0x0;
     }
 
-    // TODO: Implement
-    void evacuateApp(uint64_t fpga_id, uint64_t slot_id) {
-        // Some state capture
+    /*
+    Captures the tenant of slot_id into host memory so it can resume
+    wherever it is bound next: its declared state registers, read back
+    from the slot, the non-volatile registers the shadow already holds,
+    and the DRAM pages written since the last capture plus the app's
+    declared DRAM regions. Runs of contiguous pages are streamed in one
+    transfer each, pages the host copy already holds are left alone. A
+    failed capture drops the state, the tenant then starts over as it
+    would without one. Returns 0 if the state was captured.
+    */
+    int evacuateApp(uint64_t fpga_id, uint64_t slot_id) {
+        aos_app_session * session_ptr = slot_session_map[fpga_id][slot_id];
+        if (session_ptr == nullptr) {
+            return 1;
+        }
+        aos_trace_span span("evacuateApp", session_ptr->getSessionId(), fpga_id, slot_id);
+        AOS_PROBE3(slot_evict, session_ptr->getSessionId(), fpga_id, slot_id);
+        slot_evict_counter.add();
+        const uint64_t start_ns = monotonic_ns();
+        const std::string app_id = session_ptr->getAppId();
+        std::map<uint64_t, uint64_t> & saved_cntrlregs = session_ptr->getSavedCntrlRegs();
+        std::map<uint64_t, std::vector<char>> & saved_dram = session_ptr->getSavedDRAM();
+
+        saved_cntrlregs.clear();
+        for (auto & shadow : session_ptr->getShadowCntrlRegs()) {
+            uint64_t value = 0;
+            if (session_ptr->readShadowCntrlReg(shadow.first, value)) {
+                saved_cntrlregs[shadow.first] = value;
+            }
+        }
+        for (auto & range : sched->getStateRegRanges(app_id)) {
+            for (uint64_t addr = range.first; addr < (range.first + range.second); addr += 8) {
+                uint64_t value = 0;
+                if (read_pci_bar1(fpga_id, slot_id, addr, value) != 0) {
+                    AOS_LOG_ERROR("Scheduler: Unable to save CntrlReg " << addr << " of session " << session_ptr->getSessionId() << ", dropping its state");
+                    session_ptr->dropSavedState();
+                    return 1;
+                }
+                saved_cntrlregs[addr] = value;
+            }
+        }
+
+        // The app may have written anywhere in its declared regions
+        std::set<uint64_t> pages = session_ptr->getDirtyDRAMPages();
+        for (auto & region : sched->getDRAMRegions(app_id)) {
+            if (region.second == 0) {
+                continue;
+            }
+            const uint64_t last_page = (region.first + region.second - 1) / DRAM_PAGE_BYTES;
+            for (uint64_t page = region.first / DRAM_PAGE_BYTES; page <= last_page; page++) {
+                pages.insert(page * DRAM_PAGE_BYTES);
+            }
+        }
+        uint64_t skipped_bytes = 0;
+        for (auto & page : saved_dram) {
+            if (pages.find(page.first) == pages.end()) {
+                skipped_bytes += DRAM_PAGE_BYTES;
+            }
+        }
+
+        auto page_it = pages.begin();
+        while (page_it != pages.end()) {
+            const uint64_t run_start = *page_it;
+            uint64_t run_end = run_start + DRAM_PAGE_BYTES;
+            for (page_it++; (page_it != pages.end()) && (*page_it == run_end) && ((run_end - run_start) < STATE_DMA_CHUNK_BYTES); page_it++) {
+                run_end += DRAM_PAGE_BYTES;
+            }
+            if (dma_read_dram(fpga_id, slot_id, run_start, state_dma_buffer, run_end - run_start) != 0) {
+                AOS_LOG_ERROR("Scheduler: Unable to save DRAM of session " << session_ptr->getSessionId() << ", dropping its state");
+                session_ptr->dropSavedState();
+                return 1;
+            }
+            for (uint64_t page_addr = run_start; page_addr < run_end; page_addr += DRAM_PAGE_BYTES) {
+                const char * page_data = state_dma_buffer + (page_addr - run_start);
+                saved_dram[page_addr].assign(page_data, page_data + DRAM_PAGE_BYTES);
+            }
+        }
+
+        const uint64_t save_ns = monotonic_ns() - start_ns;
+        const uint64_t saved_bytes = pages.size() * DRAM_PAGE_BYTES;
+        session_ptr->recordStateSave(save_ns, saved_bytes, skipped_bytes);
+        preemption_stats.num_saves++;
+        preemption_stats.total_save_ns += save_ns;
+        preemption_stats.last_save_ns   = save_ns;
+        preemption_stats.saved_bytes   += saved_bytes;
+        preemption_stats.skipped_bytes += skipped_bytes;
+        AOS_LOG_INFO("Scheduler: Saved session " << session_ptr->getSessionId() << ", " << saved_cntrlregs.size() << " CntrlRegs and "
+                     << saved_bytes << " bytes of DRAM (" << skipped_bytes << " already held) in " << save_ns << " ns");
+        return 0;
     }
 
-    // TODO: Implement
-    void restoreApp(session_id_t session_id, uint64_t fpga_id, uint64_t slot_id) {
+    /*
+    Puts a preempted tenant back into the slot it was just bound to. Pages
+    of the host copy the slot's partition still holds, because the tenant
+    is back where it ran and nobody wrote them since, stay where they are,
+    the rest goes back before the registers, which may start the app.
+    Returns 0 if the state is back, the host copy is left as it was either
+    way.
+    */
+    int restoreApp(session_id_t session_id, uint64_t fpga_id, uint64_t slot_id) {
+        aos_trace_span span("restoreApp", session_id, fpga_id, slot_id);
+        aos_app_session * session_ptr = sessions[session_id];
+        const uint64_t start_ns = monotonic_ns();
+        std::map<uint64_t, std::vector<char>> & saved_dram = session_ptr->getSavedDRAM();
+        uint64_t restored_bytes = 0;
+        uint64_t resident_bytes = 0;
+
+        auto page_it = saved_dram.begin();
+        while (page_it != saved_dram.end()) {
+            if (isDRAMPageResident(fpga_id, slot_id, page_it->first, session_id)) {
+                resident_bytes += DRAM_PAGE_BYTES;
+                page_it++;
+                continue;
+            }
+            const uint64_t run_start = page_it->first;
+            uint64_t run_end = run_start;
+            for (; (page_it != saved_dram.end()) && (page_it->first == run_end) && ((run_end - run_start) < STATE_DMA_CHUNK_BYTES) &&
+                   !isDRAMPageResident(fpga_id, slot_id, page_it->first, session_id); page_it++) {
+                memcpy(state_dma_buffer + (run_end - run_start), page_it->second.data(), DRAM_PAGE_BYTES);
+                run_end += DRAM_PAGE_BYTES;
+            }
+            if (dma_write_dram(fpga_id, slot_id, run_start, state_dma_buffer, run_end - run_start) != 0) {
+                AOS_LOG_ERROR("Scheduler: Unable to restore DRAM of session " << session_id);
+                return 1;
+            }
+            claimDRAMPages(fpga_id, slot_id, session_ptr, run_start, run_end - run_start);
+            restored_bytes += (run_end - run_start);
+        }
+
+        for (auto & saved : session_ptr->getSavedCntrlRegs()) {
+            if (write_pci_bar1(fpga_id, slot_id, saved.first, saved.second) != 0) {
+                AOS_LOG_ERROR("Scheduler: Unable to restore CntrlReg " << saved.first << " of session " << session_id);
+                return 1;
+            }
+        }
+
+        const uint64_t restore_ns = monotonic_ns() - start_ns;
+        session_ptr->recordStateRestore(restore_ns, restored_bytes, resident_bytes);
+        preemption_stats.num_restores++;
+        preemption_stats.total_restore_ns += restore_ns;
+        preemption_stats.last_restore_ns   = restore_ns;
+        preemption_stats.restored_bytes   += restored_bytes;
+        preemption_stats.resident_bytes   += resident_bytes;
+        AOS_LOG_INFO("Scheduler: Restored session " << session_id << " on FPGA " << fpga_id << " slot " << slot_id << " in " << restore_ns << " ns, "
+                     << restored_bytes << " bytes of DRAM written back (" << resident_bytes << " still resident)");
+        return 0;
+    }
+
+    /*
+    Data residency. Every page the daemon puts into a slot's DRAM partition
+    (bulk data writes, restores) and every page of an app's declared DRAM
+    regions while it is bound belongs to that session until someone else
+    writes it or the FPGA is reflashed.
+    */
+    void claimDRAMPages(uint64_t fpga_id, uint64_t slot_id, aos_app_session * session_ptr, uint64_t addr, uint64_t num_bytes) {
+        if (num_bytes == 0) {
+            return;
+        }
+        std::map<uint64_t, session_id_t> & owners = dram_page_owner[fpga_id][slot_id];
+        const session_id_t session_id = session_ptr->getSessionId();
+        const uint64_t last_page = (addr + num_bytes - 1) / DRAM_PAGE_BYTES;
+        int64_t num_claimed = 0;
+        for (uint64_t page = addr / DRAM_PAGE_BYTES; page <= last_page; page++) {
+            auto owner_it = owners.find(page * DRAM_PAGE_BYTES);
+            if (owner_it == owners.end()) {
+                owners[page * DRAM_PAGE_BYTES] = session_id;
+                num_claimed++;
+            } else if (owner_it->second != session_id) {
+                if (isSessionIdValid(owner_it->second)) {
+                    sessions[owner_it->second]->addResidentDRAMPages(fpga_id, slot_id, -1);
+                }
+                owner_it->second = session_id;
+                num_claimed++;
+            }
+        }
+        session_ptr->addResidentDRAMPages(fpga_id, slot_id, num_claimed);
+    }
 
+    bool isDRAMPageResident(uint64_t fpga_id, uint64_t slot_id, uint64_t page_addr, session_id_t session_id) const {
+        auto slot_it = dram_page_owner[fpga_id].find(slot_id);
+        if (slot_it == dram_page_owner[fpga_id].end()) {
+            return false;
+        }
+        auto owner_it = slot_it->second.find(page_addr);
+        return ((owner_it != slot_it->second.end()) && (owner_it->second == session_id));
+    }
+
+    void dropDRAMResidency(uint64_t fpga_id) {
+        for (auto & session_pair : sessions) {
+            session_pair.second->dropResidentDRAM(fpga_id);
+        }
+        dram_page_owner[fpga_id].clear();
+    }
+
+    // The session is gone, its pages are free for whoever writes them next
+    void releaseDRAMPages(aos_app_session * session_ptr) {
+        for (auto & partition : session_ptr->getResidentDRAMPages()) {
+            std::map<uint64_t, session_id_t> & owners = dram_page_owner[partition.first.first][partition.first.second];
+            auto owner_it = owners.begin();
+            while (owner_it != owners.end()) {
+                if (owner_it->second == session_ptr->getSessionId()) {
+                    owner_it = owners.erase(owner_it);
+                } else {
+                    owner_it++;
+                }
+            }
+        }
+    }
+
+    // How long a tenant keeps its slot, longer for tenants whose state is expensive to move
+    uint64_t getResidencyLeft(aos_app_session * session_ptr, uint64_t now_ns) const {
+        const uint64_t move_ns = session_ptr->getLastSaveTime() + session_ptr->getLastRestoreTime();
+        const uint64_t residency_ns = std::max(min_slot_residency_ns, PREEMPTION_RESIDENCY_FACTOR * move_ns);
+        const uint64_t bound_for_ns = now_ns - session_ptr->getBoundTime();
+        return (bound_for_ns >= residency_ns) ? 0 : (residency_ns - bound_for_ns);
+    }
+
+    // Soonest any tenant of app_id leaves its residency quantum, ~0 if none is bound
+    uint64_t getAppResidencyLeft(const std::string & app_id, uint64_t now_ns) const {
+        uint64_t residency_left_ns = ~0x0ULL;
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            for (auto & slot_session : slot_session_map[fpga_id]) {
+                if ((slot_session.second != nullptr) && (slot_session.second->getAppId() == app_id)) {
+                    residency_left_ns = std::min(residency_left_ns, getResidencyLeft(slot_session.second, now_ns));
+                }
+            }
+        }
+        return residency_left_ns;
+    }
+
+    // Quickest load of an image that runs app_id
+    uint64_t getAppLoadLatency(const std::string & app_id) const {
+        uint64_t load_ns = ~0x0ULL;
+        for (uint32_t image_idx = 0; image_idx < sched->getNumImages(); image_idx++) {
+            if (imageHasApp(image_idx, app_id)) {
+                load_ns = std::min(load_ns, sched->getImageLoadLatency(image_idx));
+            }
+        }
+        return load_ns;
     }
 
     void bindAppToSlot(session_id_t session_id, uint64_t fpga_id, uint64_t slot_id) {
+        aos_trace_span span("bindAppToSlot", session_id, fpga_id, slot_id);
+        AOS_PROBE3(slot_bind, session_id, fpga_id, slot_id);
+        slot_bind_counter.add();
         assert(fpga_id < num_fpga);
         assert(isSessionIdValid(session_id));
         aos_app_session * session_ptr = sessions[session_id];
+        assert(!session_ptr->boundToSlot());
+
+        const uint64_t wait_start_ns = session_ptr->getWaitStartTime();
+        if (wait_start_ns != 0) {
+            const uint64_t wait_ns = monotonic_ns() - wait_start_ns;
+            admission_stats.num_admitted++;
+            admission_stats.total_wait_ns += wait_ns;
+            admission_stats.max_wait_ns = std::max(admission_stats.max_wait_ns, wait_ns);
+        }
 
         slot_session_map[fpga_id][slot_id] = session_ptr;
+        fleet_changed = true;
+        cleanSlotFor(session_id, fpga_id, slot_id);
 
+        unscheduled_sessions[session_ptr->getAppId()]--;
         session_ptr->bindToSlot(fpga_id, slot_id);
 
         // Take captured state and put it back on the FPGA (if any)
-        if (session_ptr->hasSavedState()) {
-            restoreApp(session_id, fpga_id, slot_id);           
+        if (session_ptr->hasSavedState() && (restoreApp(session_id, fpga_id, slot_id) != 0)) {
+            AOS_LOG_WARN("Scheduler: Session " << session_id << " starts over");
+            session_ptr->dropSavedState();
+        }
+        // The app may write its declared regions from now on
+        for (auto & region : sched->getDRAMRegions(session_ptr->getAppId())) {
+            claimDRAMPages(fpga_id, slot_id, session_ptr, region.first, region.second);
+        }
+    }
+
+    /*
+    Live migration. Checkpoints a bound session's slot (registers and DRAM)
+    and restores it into dst_slot_id on dst_fpga_id, which has to be free
+    and run the same app. The daemon serves one request at a time, so the
+    client's ops wait in the socket backlog while the state moves and then
+    find the session at its new slot. If either half fails the session
+    stays where it was, its state still in the old slot. Returns 0 if the
+    session moved.
+    */
+    int migrateSession(session_id_t session_id, uint64_t dst_fpga_id, uint64_t dst_slot_id) {
+        if (!isSessionIdValid(session_id) || !isSessionScheduled(session_id) || (dst_fpga_id >= num_fpga) ||
+            isFPGAReconfiguring(dst_fpga_id) || (slot_session_map[dst_fpga_id].find(dst_slot_id) == slot_session_map[dst_fpga_id].end())) {
+            return 1;
+        }
+        aos_app_session * session_ptr = sessions[session_id];
+        const uint64_t src_fpga_id = session_ptr->getFPGAId();
+        const uint64_t src_slot_id = session_ptr->getSlotId();
+        if ((slot_session_map[dst_fpga_id][dst_slot_id] != nullptr) || (slot_appid_map[dst_fpga_id][dst_slot_id] != session_ptr->getAppId()) ||
+            ((src_fpga_id == dst_fpga_id) && (src_slot_id == dst_slot_id))) {
+            return 1;
+        }
+
+        const uint64_t start_ns = monotonic_ns();
+        if (evacuateApp(src_fpga_id, src_slot_id) != 0) {
+            return 1;
+        }
+        slot_session_map[src_fpga_id][src_slot_id] = nullptr;
+        slot_session_map[dst_fpga_id][dst_slot_id] = session_ptr;
+        cleanSlotFor(session_id, dst_fpga_id, dst_slot_id);
+        session_ptr->bindToSlot(dst_fpga_id, dst_slot_id);
+        if (restoreApp(session_id, dst_fpga_id, dst_slot_id) != 0) {
+            slot_session_map[dst_fpga_id][dst_slot_id] = nullptr;
+            slot_session_map[src_fpga_id][src_slot_id] = session_ptr;
+            session_ptr->bindToSlot(src_fpga_id, src_slot_id);
+            session_ptr->markStateResident();
+            return 1;
+        }
+        admission_replay_pending = true;
+
+        const uint64_t migration_ns = monotonic_ns() - start_ns;
+        num_migrations++;
+        total_migration_ns += migration_ns;
+        AOS_LOG_INFO("Scheduler: Migrated session " << session_id << " from FPGA " << src_fpga_id << " slot " << src_slot_id
+                     << " to FPGA " << dst_fpga_id << " slot " << dst_slot_id << " in " << migration_ns << " ns");
+        return 0;
+    }
+
+    /*
+    Finds every tenant of fpga_id a free slot for its app on another FPGA
+    that is not reconfiguring, filling the busiest FPGAs first so idle
+    ones stay free for new images. Returns true if all of them fit, moves
+    holds whatever fits either way.
+    */
+    bool planTenantMoves(uint64_t fpga_id, std::vector<aos_tenant_move> & moves) {
+        moves.clear();
+        std::vector<uint64_t> dst_load(num_fpga, 0);
+        for (uint64_t dst_fpga_id = 0; dst_fpga_id < num_fpga; dst_fpga_id++) {
+            dst_load[dst_fpga_id] = calcFPGALoad(dst_fpga_id);
+        }
+        std::set<std::pair<uint64_t, uint64_t>> taken;
+        bool all_fit = true;
+        for (auto & slot_session : slot_session_map[fpga_id]) {
+            aos_app_session * session_ptr = slot_session.second;
+            if (session_ptr == nullptr) {
+                continue;
+            }
+            bool found = false;
+            uint64_t best_fpga_id = 0;
+            uint64_t best_slot_id = 0;
+            for (uint64_t dst_fpga_id = 0; dst_fpga_id < num_fpga; dst_fpga_id++) {
+                if ((dst_fpga_id == fpga_id) || isFPGAReconfiguring(dst_fpga_id) || (found && (dst_load[dst_fpga_id] <= dst_load[best_fpga_id]))) {
+                    continue;
+                }
+                for (auto & dst_slot : slot_session_map[dst_fpga_id]) {
+                    if ((dst_slot.second == nullptr) && (slot_appid_map[dst_fpga_id][dst_slot.first] == session_ptr->getAppId()) &&
+                        (taken.find(std::make_pair(dst_fpga_id, dst_slot.first)) == taken.end())) {
+                        found = true;
+                        best_fpga_id = dst_fpga_id;
+                        best_slot_id = dst_slot.first;
+                        break;
+                    }
+                }
+            }
+            if (!found) {
+                all_fit = false;
+                continue;
+            }
+            taken.insert(std::make_pair(best_fpga_id, best_slot_id));
+            dst_load[best_fpga_id]++;
+            aos_tenant_move move;
+            move.session_id = session_ptr->getSessionId();
+            move.fpga_id    = best_fpga_id;
+            move.slot_id    = best_slot_id;
+            moves.push_back(move);
+        }
+        return all_fit;
+    }
+
+    void migrateTenants(const std::vector<aos_tenant_move> & moves) {
+        for (auto & move : moves) {
+            migrateSession(move.session_id, move.fpga_id, move.slot_id);
         }
     }
 
-    void unbindAppFromSlot(uint64_t fpga_id, uint64_t slot_id) {
+    void unbindAppFromSlot(uint64_t fpga_id, uint64_t slot_id, bool save_state = true) {
         assert(fpga_id < num_fpga);
         aos_app_session * session_ptr = slot_session_map[fpga_id][slot_id];
         if (session_ptr == nullptr) {
@@ -943,10 +2980,15 @@ private:
             return;
         }
         // Evacuate the app, state capture
-        evacuateApp(fpga_id, slot_id);
+        if (save_state) {
+            evacuateApp(fpga_id, slot_id);
+        }
         // Clean up metadata
         slot_session_map[fpga_id][slot_id] = nullptr;
         session_ptr->unbindFromSlot();
+        unscheduled_sessions[session_ptr->getAppId()]++;
+        admission_replay_pending = true;
+        fleet_changed = true;
     }
 
     void unbindAllApps(uint64_t fpga_id) {
@@ -958,45 +3000,310 @@ private:
         }
     }
 
-    void switchImage(uint64_t fpga_id, json & newImage) {
+    /*
+    Reprograms fpga_id and waits for it. Only for use before the daemon
+    starts serving, scheduling goes through beginSwitchImage.
+    */
+    void switchImage(uint64_t fpga_id, uint32_t image_idx) {
+        aos_trace_span span("switchImage", TRACE_NO_ID, fpga_id);
+        if (!beginSwitchImage(fpga_id, image_idx)) {
+            finishSwitchImage(fpga_id);
+        }
+    }
+
+    /*
+    Starts reprogramming fpga_id with image_idx. The FPGA has no slots
+    until the worker thread is done and the epoll loop calls
+    finishSwitchImage, every other FPGA keeps serving in the meantime.
+    Returns true instead if the image is already resident, in which case
+    it is reused right away, each slot reset when a new tenant is bound.
+    */
+    bool beginSwitchImage(uint64_t fpga_id, uint32_t image_idx) {
         assert(fpga_id < num_fpga);
-        auto & slot_appid_map_   = slot_appid_map[fpga_id];
-        auto & slot_session_map_ = slot_session_map[fpga_id];
+        assert(!fpga_reconfiguring[fpga_id]);
+        aos_trace_span span("beginSwitchImage", current_trace_session, fpga_id);
+
+        if (sched->isImageResident(fpga_id, image_idx)) {
+            num_avoided_reconfigs++;
+            AOS_LOG_INFO("Scheduler: Image " << image_idx << " already resident on FPGA " << fpga_id << ", skipping reconfiguration (" << num_avoided_reconfigs << " avoided)");
+            // Chosen again, it gets a fresh residency quantum like a load would
+            image_installed_ns[fpga_id] = monotonic_ns();
+            if (!areInterfacesEnabled(fpga_id)) {
+                // Adopted from a previous daemon, nothing is set up yet
+                installImage(fpga_id, image_idx);
+                return true;
+            }
+            // Slots are reset as they are bound, see cleanSlotFor
+            return true;
+        }
+
+        // Whoever switches next decides the mode, checkFPGAModes marks its own switches
+        single_tenant_mode[fpga_id] = false;
+        // The new image starts from a reset, nobody's data is left in DRAM
+        dropDRAMResidency(fpga_id);
+
         // Image specific data
         // Clear the slot_appid_map
-        slot_appid_map_.clear();
+        slot_appid_map[fpga_id].clear();
         // Clear the slot_session_map
-        slot_session_map_.clear();
+        slot_session_map[fpga_id].clear();
+        slot_bar1_base[fpga_id].clear();
+        slot_bar1_limit[fpga_id].clear();
+        slot_last_session[fpga_id].clear();
+        slot_access_stats[fpga_id].clear();
+
+        // Disable the interfaces to the FPGA
+        // Only do it if an image was loaded
+        if (areInterfacesEnabled(fpga_id)) {
+            detach_from_image(fpga_id);
+        }
+
+        // Have the scheduler switch bitstreams
+        sched->beginReconfiguration(fpga_id, image_idx);
+        fpga_reconfiguring[fpga_id] = true;
+        reconfig_begin_ns[fpga_id] = monotonic_ns();
+        reconfig_speculative[fpga_id] = false;
+        reconfig_image_idx[fpga_id] = image_idx;
+        if (virtual_reconfig) {
+            reconfig_done_ns[fpga_id] = monotonic_ns() + sched->getSimulatedLoadLatency();
+            return false;
+        }
+        reconfig_worker[fpga_id] = std::thread(&aos_host::reconfigurationWorker, this, fpga_id, image_idx);
+        return false;
+    }
+
+    // Runs on the worker thread, must not touch daemon state other than its own result slot
+    void reconfigurationWorker(uint64_t fpga_id, uint32_t image_idx) {
+        setTraceThreadName("reconfig fpga " + std::to_string(fpga_id));
+        {
+            aos_trace_span span("programImage", TRACE_NO_ID, fpga_id);
+            reconfig_result[fpga_id] = sched->programImage(fpga_id, image_idx);
+        }
+        uint64_t done = 1;
+        if (write(reconfig_done_fd[fpga_id], &done, sizeof(uint64_t)) == -1) {
+            perror("Unable to signal reconfiguration done");
+        }
+    }
+
+    /*
+    Bookkeeping once the new image is on fpga_id, blocks until the worker
+    exits. Returns false if the load failed, the FPGA is then left empty.
+    */
+    bool finishSwitchImage(uint64_t fpga_id) {
+        assert(fpga_id < num_fpga);
+        assert(fpga_reconfiguring[fpga_id]);
+        aos_trace_span span("finishSwitchImage", TRACE_NO_ID, fpga_id);
+        fleet_changed = true;
+        if (virtual_reconfig) {
+            // Cancelled loads stop wherever they are, like the simulated programImage
+            reconfig_result[fpga_id] = sched->isReconfigurationCancelled(fpga_id) ? RECONFIG_CANCELLED : 0;
+        } else {
+            reconfig_worker[fpga_id].join();
+            // Drain the completion count, the join already synchronized with the worker
+            uint64_t done = 0;
+            if ((read(reconfig_done_fd[fpga_id], &done, sizeof(uint64_t)) == -1) && (errno != EAGAIN)) {
+                perror("Unable to read reconfiguration done");
+            }
+        }
 
-        uint64_t num_slots_new_image = newImage["num_slots"];
+        const uint32_t image_idx = reconfig_image_idx[fpga_id];
+        const int rc = reconfig_result[fpga_id];
+        sched->completeReconfiguration(fpga_id, image_idx, rc);
+        fpga_reconfiguring[fpga_id] = false;
+        reconfig_counter[(rc == 0) ? 0 : ((rc == RECONFIG_CANCELLED) ? 2 : 1)].add();
+        reconfig_ns_counter.add(monotonic_ns() - reconfig_begin_ns[fpga_id]);
+        if (rc != 0) {
+            return false;
+        }
+
+        installImage(fpga_id, image_idx);
+        return true;
+    }
+
+    // Build the slot tables for the image now on fpga_id and attach to it
+    void installImage(uint64_t fpga_id, uint32_t image_idx) {
+        auto & slot_appid_map_   = slot_appid_map[fpga_id];
+        auto & slot_session_map_ = slot_session_map[fpga_id];
+
+        const ImageDescriptor & newImage = sched->getImageDescriptor(image_idx);
+        const uint64_t num_slots_new_image = newImage.num_slots;
 
         for (uint64_t slot_id = 0; slot_id < num_slots_new_image; slot_id++) {
             slot_session_map_[slot_id] = nullptr; // reset the slot
         }
 
-        slot_appid_map_ = sched->getSlotAppIdMap(newImage);
+        slot_appid_map_ = sched->getSlotAppIdMap(image_idx);
 
         assert(slot_appid_map_.size() == slot_session_map_.size());
 
-        // Disable the interfaces to the FPGA
-        // Only do it if an image was loaded
-        if (areInterfacesEnabled(fpga_id)) {
-            detach_from_image(fpga_id);
+        // Resolve the image's slot windows once, so every access is an add and a compare
+        slot_bar1_base[fpga_id].assign(num_slots_new_image, 0);
+        slot_bar1_limit[fpga_id].assign(num_slots_new_image, 0);
+        slot_last_session[fpga_id].assign(num_slots_new_image, NO_SESSION_ID);
+        // Fresh accounting, counts as an access so a just loaded image is not the LRU victim
+        slot_access_stats[fpga_id].assign(num_slots_new_image, aos_access_stats());
+        for (auto & slot : newImage.slots) {
+            if (slot.slot_id < num_slots_new_image) {
+                slot_bar1_base[fpga_id][slot.slot_id]  = slot.bar1_base;
+                slot_bar1_limit[fpga_id][slot.slot_id] = slot.bar1_base + slot.bar1_size;
+            }
         }
 
-        // Have the scheduler switch bitstreams
-        int32_t image_idx = sched->getImageIdx(newImage);
-        assert(image_idx != -1);
-        // Clear the old bit stream
-        sched->clearImage(fpga_id);
-        // Load the new one
-        sched->loadImage(fpga_id, (uint32_t)image_idx);
+        image_installed_ns[fpga_id] = monotonic_ns();
+        admission_replay_pending = true;
 
         // Re-enable the interfaces to the FPGA
         attach_to_image(fpga_id);
     }
 
-    json & getReplacementImage(std::string app_id_to_schedule) {
+    /*
+    A reconfiguration worker finished. Replay the requests that were
+    waiting on the FPGA in arrival order, or fail them if the load failed.
+    */
+    void handleReconfigurationDone(uint64_t fpga_id) {
+        if ((fpga_id >= num_fpga) || !fpga_reconfiguring[fpga_id]) {
+            return;
+        }
+        const bool loaded = finishSwitchImage(fpga_id);
+        // A cancelled load leaves the FPGA empty, the requests it was cancelled for reschedule onto it
+        const bool cancelled = (reconfig_result[fpga_id] == RECONFIG_CANCELLED);
+
+        // The tenant a mode switch was for gets its slot back before anyone else
+        for (auto tenant_it = mode_switch_tenants.begin(); tenant_it != mode_switch_tenants.end(); ) {
+            if (tenant_it->second != fpga_id) {
+                tenant_it++;
+                continue;
+            }
+            if (loaded && isSessionIdValid(tenant_it->first) && !isSessionScheduled(tenant_it->first)) {
+                bindAppToUnusedSlot(tenant_it->first, fpga_id);
+            }
+            tenant_it = mode_switch_tenants.erase(tenant_it);
+        }
+
+        std::deque<aos_parked_request> to_replay;
+        to_replay.swap(parked_requests[fpga_id]);
+        AOS_LOG_INFO("Scheduler: FPGA " << fpga_id << " reconfigured, replaying " << to_replay.size() << " parked requests");
+        for (auto & parked : to_replay) {
+            if (!loaded && !cancelled) {
+                aos_socket_response_packet resp_pckt;
+                memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+                resp_pckt.errorcode  = aos_errcode::UNKNOWN_FAILURE;
+                resp_pckt.session_id = parked.cmd_pckt.session_id;
+                writeResponsePacket(parked.cfd, resp_pckt);
+                closeTransaction(parked.cfd);
+                continue;
+            }
+            // May park again if scheduling now needs another reconfiguration
+            if (handleTransaction(parked.cfd, parked.cmd_pckt) != REQUEST_PARKED) {
+                closeTransaction(parked.cfd);
+            }
+        }
+    }
+
+    /*
+    Hold a request until wait_fpga_id is reconfigured. If scheduling failed
+    without starting a reconfiguration there is nothing to wait for.
+    */
+    int parkRequest(int cfd, aos_socket_command_packet & cmd_pckt, uint64_t wait_fpga_id) {
+        if (wait_fpga_id == ADMISSION_QUEUE_ID) {
+            return queueForAdmission(cfd, cmd_pckt);
+        }
+        if ((wait_fpga_id < num_fpga) && fpga_reconfiguring[wait_fpga_id]) {
+            aos_parked_request parked;
+            parked.cfd      = cfd;
+            parked.cmd_pckt = cmd_pckt;
+            parked_requests[wait_fpga_id].push_back(parked);
+            return REQUEST_PARKED;
+        }
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.errorcode  = aos_errcode::UNKNOWN_FAILURE;
+        resp_pckt.session_id = cmd_pckt.session_id;
+        writeResponsePacket(cfd, resp_pckt);
+        return 1;
+    }
+
+    /*
+    No slot for the session and it may not evict anyone yet. Blocking
+    sessions wait in the admission queue, which is replayed in arrival
+    order whenever a slot frees up and every ADMISSION_RECHECK_NS so
+    hysteresis and residency can run out, see aos_admission_queue.
+    Everyone else gets RETRY.
+    */
+    int queueForAdmission(int cfd, aos_socket_command_packet & cmd_pckt) {
+        aos_app_session * const session_ptr = sessions[cmd_pckt.session_id];
+        if (session_ptr->isBlocking() && (admission_queue.size() < MAX_ADMISSION_QUEUE)) {
+            aos_parked_request parked;
+            parked.cfd      = cfd;
+            parked.cmd_pckt = cmd_pckt;
+            admission_queue.push(session_ptr->getAppId(), parked);
+            // Replays that queue again were already counted
+            if (!replaying_admission) {
+                admission_stats.num_queued++;
+            }
+            armAdmissionTimer();
+            return REQUEST_PARKED;
+        }
+        admission_stats.num_retries++;
+        aos_socket_response_packet resp_pckt;
+        memset(&resp_pckt, 0, sizeof(aos_socket_response_packet));
+        resp_pckt.errorcode  = aos_errcode::RETRY;
+        resp_pckt.session_id = cmd_pckt.session_id;
+        writeResponsePacket(cfd, resp_pckt);
+        return 1;
+    }
+
+    void serviceAdmissionQueue() {
+        if (!admission_replay_pending || admission_queue.empty()) {
+            return;
+        }
+        admission_replay_pending = false;
+        replaying_admission = true;
+        admission_queue.replay([this](const aos_parked_request & parked) {
+            aos_socket_command_packet cmd_pckt = parked.cmd_pckt;
+            if (handleTransaction(parked.cfd, cmd_pckt) != REQUEST_PARKED) {
+                closeTransaction(parked.cfd);
+            }
+        });
+        replaying_admission = false;
+        armAdmissionTimer();
+    }
+
+    /*
+    One shot, re-armed after every replay while the queue is not empty.
+    Otherwise it still fires every FLEET_RECHECK_NS while mode switching or
+    prefetching is on, see runFleetPasses.
+    */
+    void armAdmissionTimer() {
+        uint64_t delay_ns = 0;
+        if (!admission_queue.empty()) {
+            delay_ns = ADMISSION_RECHECK_NS;
+        } else if (!isDummy && (mode_switching || speculative_prefetch)) {
+            delay_ns = FLEET_RECHECK_NS;
+        }
+        itimerspec timer_spec;
+        memset(&timer_spec, 0, sizeof(itimerspec));
+        timer_spec.it_value.tv_sec  = delay_ns / (1000ULL * 1000 * 1000);
+        timer_spec.it_value.tv_nsec = delay_ns % (1000ULL * 1000 * 1000);
+        if (timerfd_settime(admission_timer_fd, 0, &timer_spec, nullptr) == -1) {
+            perror("Unable to arm admission timer");
+        }
+    }
+
+    bool isFPGAReconfiguring(uint64_t fpga_id) const {
+        assert(fpga_id < num_fpga);
+        return fpga_reconfiguring[fpga_id];
+    }
+
+    /*
+    Picks the image to load on fpga_id so that app_id_to_schedule can run.
+    Every image with the app is scored by the sessions it could run out of
+    the outstanding demand (unscheduled sessions plus the ones it would
+    evict), discounted by how much of the planning horizon its measured
+    load latency eats, minus the sessions it evicts. Ties go to the image
+    with the most slots.
+    */
+    uint32_t getReplacementImage(std::string app_id_to_schedule, uint64_t fpga_id) {
 
         // Generate app id / count vectors
         std::vector<std::string>   app_ids;
@@ -1005,23 +3312,140 @@ private:
         app_ids.push_back(app_id_to_schedule);
         app_counts.push_back(1);
         // Get all images that can satisfy that have at least one copy of the app we want to ensure is on there
-        json app_tuple = sched->generateAppTuples(app_ids, app_counts);
-        std::vector<uint32_t> fitting_indices = sched->getAllFittingImages(app_tuple);
+        app_demand_t app_demand = sched->generateAppDemand(app_ids, app_counts);
+        std::vector<uint32_t> fitting_indices = sched->getAllFittingImages(app_demand);
+
+        // Outstanding demand by app, sessions that would be evicted become demand again
+        std::vector<uint32_t> outstanding_demand = getUnscheduledDemand();
+        uint64_t num_evicted = 0;
+        for (auto & slot_session : slot_session_map[fpga_id]) {
+            if (slot_session.second != nullptr) {
+                const int32_t app_idx = sched->getAppIdx(slot_session.second->getAppId());
+                if (app_idx != -1) {
+                    outstanding_demand[app_idx]++;
+                }
+                num_evicted++;
+            }
+        }
+
+        const int32_t resident_idx = sched->getCurrentImageIdx(fpga_id);
         // Determine which image should be the replacement one
         uint32_t selected_idx = 0;
-        // Current algorithm just selects the one with the highest overall app/slot count (very basic)
-        uint32_t highest_num_apps = 0;
-        for (uint32_t vector_idx = 0; vector_idx < fitting_indices.size(); vector_idx++) {
-            const uint32_t num_slots = sched->getImageByIdx(fitting_indices[vector_idx])["num_slots"];
-            if (num_slots > highest_num_apps) {
-                selected_idx = fitting_indices[vector_idx];
-                highest_num_apps = num_slots;
+        bool selected = false;
+        double best_score = 0.0;
+        uint32_t best_num_slots = 0;
+        for (auto & image_idx : fitting_indices) {
+            const ImageDescriptor & image = sched->getImageDescriptor(image_idx);
+            // Sessions this image could run right away
+            uint64_t servable = 0;
+            for (uint32_t app_idx = 0; app_idx < outstanding_demand.size(); app_idx++) {
+                servable += std::min(image.getAppCount(app_idx), outstanding_demand[app_idx]);
+            }
+            // Keeping the resident image costs neither a load nor an eviction
+            const bool is_resident = ((int32_t)image_idx == resident_idx);
+            const uint64_t load_ns = is_resident ? 0 : sched->getImageLoadLatency(image_idx);
+            const double useful_fraction = (load_ns >= reconfig_horizon_ns) ? 0.0 : ((double)(reconfig_horizon_ns - load_ns) / (double)reconfig_horizon_ns);
+            const double score = ((double)servable * useful_fraction) - (is_resident ? 0.0 : (double)num_evicted);
+
+            if (!selected || (score > best_score) || ((score == best_score) && (image.num_slots > best_num_slots))) {
+                selected = true;
+                selected_idx = image_idx;
+                best_score = score;
+                best_num_slots = image.num_slots;
             }
         }
         // Return the image corresponding to that index
-        std::cout << " Found replacement image, id:" << selected_idx << std::endl;
-        std::cout << std::flush;
-        return sched->getImageByIdx(selected_idx);
+        AOS_LOG_DEBUG("Found replacement image, id:" << selected_idx << " score: " << best_score);
+        return selected_idx;
+    }
+
+    // Number of sessions per interned app id that are waiting for a slot
+    std::vector<uint32_t> getUnscheduledDemand() {
+        return getDemand(unscheduled_sessions);
+    }
+
+    // Number of sessions per interned app id, running or waiting for a slot
+    std::vector<uint32_t> getOutstandingDemand() {
+        return getDemand(outstanding_sessions);
+    }
+
+    std::vector<uint32_t> getDemand(const std::map<std::string, uint32_t> & sessions_per_app) {
+        std::vector<uint32_t> demand(sched->getNumApps(), 0);
+        for (auto & app_sessions : sessions_per_app) {
+            const int32_t app_idx = sched->getAppIdx(app_sessions.first);
+            if (app_idx != -1) {
+                demand[app_idx] = app_sessions.second;
+            }
+        }
+        return demand;
+    }
+
+    // What the placement engine sees of each FPGA, a load in flight counts as its image
+    std::vector<FPGAPlacementState> getPlacementState() {
+        std::vector<FPGAPlacementState> fpgas(num_fpga);
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            const bool reconfiguring = isFPGAReconfiguring(fpga_id);
+            fpgas[fpga_id].image_idx = reconfiguring ? (int32_t)reconfig_image_idx[fpga_id] : sched->getCurrentImageIdx(fpga_id);
+            fpgas[fpga_id].locked    = reconfiguring;
+            fpgas[fpga_id].num_bound = reconfiguring ? 0 : calcFPGALoad(fpga_id);
+        }
+        return fpgas;
+    }
+
+    /*
+    Re-plans images for the whole fleet against every running and waiting
+    session. Incremental, an arrival the current plan already has room for
+    leaves it as is. Only idle FPGAs are switched to their planned image
+    here, FPGAs with tenants change when a request forces it.
+    */
+    void replanPlacement(int32_t arrived_app_idx) {
+        if (isDummy || !fleet_placement) {
+            return;
+        }
+        const std::vector<uint32_t> demand = getOutstandingDemand();
+        if ((arrived_app_idx != -1) && !placement_plan.target_image.empty() &&
+            (placement->getPlannedCapacity(placement_plan, arrived_app_idx) >= demand[arrived_app_idx])) {
+            return;
+        }
+        placement_plan = placement->plan(getPlacementState(), demand);
+        num_replans++;
+        AOS_LOG_INFO("Scheduler: Placement plan " << num_replans << " places " << placement_plan.num_placed << " sessions with " << placement_plan.num_reconfigs << " reconfigurations");
+
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            const int32_t target_idx = placement_plan.target_image[fpga_id];
+            if ((target_idx == NO_IMAGE_LOADED) || isFPGAReconfiguring(fpga_id) ||
+                (sched->getCurrentImageIdx(fpga_id) == target_idx)) {
+                continue;
+            }
+            // Defragment, an FPGA whose tenants all fit elsewhere is emptied for its new image
+            if (calcFPGALoad(fpga_id) != 0) {
+                std::vector<aos_tenant_move> moves;
+                if (!planTenantMoves(fpga_id, moves)) {
+                    continue;
+                }
+                migrateTenants(moves);
+                if (calcFPGALoad(fpga_id) != 0) {
+                    continue;
+                }
+            }
+            AOS_LOG_INFO("Scheduler: Placing image " << target_idx << " onto idle FPGA " << fpga_id);
+            // Ahead of any request, so a request that needs the FPGA may still cancel it
+            if (!beginSwitchImage(fpga_id, target_idx)) {
+                reconfig_speculative[fpga_id] = true;
+                num_speculative_loads++;
+            }
+        }
+    }
+
+    // The planned image for fpga_id if it runs app_id, otherwise the best pick for that FPGA alone
+    uint32_t getPlannedImage(std::string app_id, uint64_t fpga_id) {
+        if (fpga_id < placement_plan.target_image.size()) {
+            const int32_t image_idx = placement_plan.target_image[fpga_id];
+            if (imageHasApp(image_idx, app_id)) {
+                return image_idx;
+            }
+        }
+        return getReplacementImage(app_id, fpga_id);
     }
 
     bool appIdExists(std::string app_id) {
@@ -1037,6 +3461,371 @@ private:
         return value & 0xFFFFFFFF;
     }
 
+    bool imageHasApp(int32_t image_idx, const std::string & app_id) const {
+        const int32_t app_idx = sched->getAppIdx(app_id);
+        if ((image_idx == NO_IMAGE_LOADED) || (app_idx == -1)) {
+            return false;
+        }
+        return (sched->getImageDescriptor(image_idx).getAppCount(app_idx) > 0);
+    }
+
+    /*
+    An app is covered if some FPGA has a free slot for it or is loading an
+    image that has it
+    */
+    bool isAppCovered(const std::string & app_id) {
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id)) {
+                if (imageHasApp(reconfig_image_idx[fpga_id], app_id)) {
+                    return true;
+                }
+                continue;
+            }
+            for (auto & slot_appid : slot_appid_map[fpga_id]) {
+                if ((slot_appid.second == app_id) && (slot_session_map[fpga_id][slot_appid.first] == nullptr)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    /*
+    Speculatively load an image onto an idle FPGA for the first app that is
+    waiting for a slot or expected within prefetch_horizon_ns and has
+    nowhere to go, so its first op finds the image resident. One
+    speculative load at a time, and only onto FPGAs whose image serves none
+    of the wanted apps, so two predicted apps cannot keep evicting each other.
+    */
+    /*
+    AmorphOS mode switching. An FPGA whose only tenant would run at least
+    single_tenant_speedup faster on another image, by the slots' throughput
+    ratings, is switched to that image while nobody waits for a slot. Once
+    consolidate_demand waiting sessions would fit next to the tenant on a
+    shared image (the one with the most room for them), the FPGA goes back.
+    Either way the tenant is saved, rebound as soon as the image is up and
+    restored. Images are kept for min_image_residency_ns first, so the two
+    directions do not flap.
+    */
+    void checkFPGAModes() {
+        if (isDummy || !mode_switching) {
+            return;
+        }
+        const uint64_t now_ns = monotonic_ns();
+        const std::vector<uint32_t> waiting = getUnscheduledDemand();
+        uint64_t num_waiting = 0;
+        for (auto & count : waiting) {
+            num_waiting += count;
+        }
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id) || !sched->anyImageLoaded(fpga_id) || (calcFPGALoad(fpga_id) != 1) ||
+                ((now_ns - image_installed_ns[fpga_id]) < min_image_residency_ns)) {
+                continue;
+            }
+            aos_app_session * tenant = nullptr;
+            for (auto & slot_session : slot_session_map[fpga_id]) {
+                if (slot_session.second != nullptr) {
+                    tenant = slot_session.second;
+                }
+            }
+            const int32_t app_idx = sched->getAppIdx(tenant->getAppId());
+            const int32_t current_idx = sched->getCurrentImageIdx(fpga_id);
+            if (app_idx == -1) {
+                continue;
+            }
+
+            if (!single_tenant_mode[fpga_id]) {
+                if (num_waiting >= consolidate_demand) {
+                    continue;
+                }
+                // Fastest image for the app, the fewest slots among equals
+                app_demand_t app_demand(1, std::make_pair((uint32_t)app_idx, (uint32_t)1));
+                int32_t best_idx = current_idx;
+                double best_throughput = sched->getImageDescriptor(current_idx).getAppThroughput(app_idx);
+                const double current_throughput = best_throughput;
+                for (auto & image_idx : sched->getAllFittingImages(app_demand)) {
+                    const ImageDescriptor & image = sched->getImageDescriptor(image_idx);
+                    const double throughput = image.getAppThroughput(app_idx);
+                    if ((throughput > best_throughput) ||
+                        ((throughput == best_throughput) && (image.num_slots < sched->getImageDescriptor(best_idx).num_slots))) {
+                        best_idx = image_idx;
+                        best_throughput = throughput;
+                    }
+                }
+                if ((best_idx == current_idx) || (best_throughput < (single_tenant_speedup * current_throughput))) {
+                    continue;
+                }
+                AOS_LOG_INFO("Scheduler: FPGA " << fpga_id << " has a lone " << tenant->getAppId() << " tenant, switching to single app image " << best_idx
+                             << " (" << best_throughput << " vs " << current_throughput << ")");
+                num_single_tenant_switches++;
+                switchTenantImage(fpga_id, tenant->getSessionId(), best_idx);
+                single_tenant_mode[fpga_id] = true;
+            } else {
+                // Image with the most room for waiting sessions next to the tenant, the most slots among equals
+                app_demand_t app_demand(1, std::make_pair((uint32_t)app_idx, (uint32_t)1));
+                int32_t shared_idx = current_idx;
+                uint64_t num_fitting = 0;
+                for (auto & image_idx : sched->getAllFittingImages(app_demand)) {
+                    const ImageDescriptor & image = sched->getImageDescriptor(image_idx);
+                    uint64_t fitting = 0;
+                    for (uint32_t waiting_app_idx = 0; waiting_app_idx < waiting.size(); waiting_app_idx++) {
+                        uint32_t free_slots = image.getAppCount(waiting_app_idx);
+                        if ((waiting_app_idx == (uint32_t)app_idx) && (free_slots > 0)) {
+                            free_slots--;
+                        }
+                        fitting += std::min(free_slots, waiting[waiting_app_idx]);
+                    }
+                    if ((fitting > num_fitting) ||
+                        ((fitting == num_fitting) && (image.num_slots > sched->getImageDescriptor(shared_idx).num_slots))) {
+                        shared_idx = image_idx;
+                        num_fitting = fitting;
+                    }
+                }
+                if ((shared_idx == current_idx) || (num_fitting < consolidate_demand)) {
+                    continue;
+                }
+                AOS_LOG_INFO("Scheduler: " << num_fitting << " waiting sessions fit next to the tenant of FPGA " << fpga_id
+                             << ", consolidating onto image " << shared_idx);
+                num_consolidations++;
+                switchTenantImage(fpga_id, tenant->getSessionId(), shared_idx);
+            }
+        }
+    }
+
+    /*
+    Mode switching and prefetching walk every FPGA and image, so they only
+    run when a session came, went, was bound or unbound or an image came
+    up, and on the admission timer, not after every request.
+    */
+    void runFleetPasses() {
+        if (!fleet_changed) {
+            return;
+        }
+        checkFPGAModes();
+        prefetchImages();
+        fleet_changed = false;
+    }
+
+    // Saves the tenants of fpga_id, loads image_idx and brings session_id back once it is up
+    void switchTenantImage(uint64_t fpga_id, session_id_t session_id, uint32_t image_idx) {
+        unbindAllApps(fpga_id);
+        if (beginSwitchImage(fpga_id, image_idx)) {
+            bindAppToUnusedSlot(session_id, fpga_id);
+            return;
+        }
+        mode_switch_tenants[session_id] = fpga_id;
+    }
+
+    void prefetchImages() {
+        if (isDummy || !speculative_prefetch) {
+            return;
+        }
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id) && reconfig_speculative[fpga_id]) {
+                return;
+            }
+        }
+
+        // Sessions already waiting come first, then predicted arrivals, soonest first
+        std::vector<uint32_t> wanted_apps;
+        std::vector<uint32_t> unscheduled_demand = getUnscheduledDemand();
+        for (uint32_t app_idx = 0; app_idx < unscheduled_demand.size(); app_idx++) {
+            if (unscheduled_demand[app_idx] > 0) {
+                wanted_apps.push_back(app_idx);
+            }
+        }
+        for (auto & predicted : sched->getPredictedArrivals(monotonic_ns(), prefetch_horizon_ns)) {
+            if (std::find(wanted_apps.begin(), wanted_apps.end(), predicted.second) == wanted_apps.end()) {
+                wanted_apps.push_back(predicted.second);
+            }
+        }
+        if (wanted_apps.empty()) {
+            return;
+        }
+
+        // Idle FPGAs that are fair game, empty ones first, then least recently used
+        uint64_t target_fpga_id = ~0x0;
+        bool target_empty = false;
+        uint64_t target_last_access_ns = ~0x0;
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id) || (calcFPGALoad(fpga_id) != 0)) {
+                continue;
+            }
+            const int32_t image_idx = sched->getCurrentImageIdx(fpga_id);
+            bool serves_wanted_app = false;
+            for (auto & app_idx : wanted_apps) {
+                if (imageHasApp(image_idx, sched->getAppIdByIdx(app_idx))) {
+                    serves_wanted_app = true;
+                    break;
+                }
+            }
+            if (serves_wanted_app) {
+                continue;
+            }
+            const bool empty = (image_idx == NO_IMAGE_LOADED);
+            uint64_t last_access_ns = 0;
+            for (auto & stats : slot_access_stats[fpga_id]) {
+                last_access_ns = std::max(last_access_ns, stats.last_access_ns);
+            }
+            if ((target_fpga_id == (uint64_t)~0x0) || (empty && !target_empty) || ((empty == target_empty) && (last_access_ns < target_last_access_ns))) {
+                target_fpga_id = fpga_id;
+                target_empty = empty;
+                target_last_access_ns = last_access_ns;
+            }
+        }
+        if (target_fpga_id == (uint64_t)~0x0) {
+            return;
+        }
+
+        for (auto & app_idx : wanted_apps) {
+            const std::string & app_id = sched->getAppIdByIdx(app_idx);
+            if (isAppCovered(app_id)) {
+                continue;
+            }
+            const uint32_t image_idx = getReplacementImage(app_id, target_fpga_id);
+            AOS_LOG_INFO("Scheduler: Prefetching image " << image_idx << " onto idle FPGA " << target_fpga_id << " for app " << app_id);
+            if (!beginSwitchImage(target_fpga_id, image_idx)) {
+                reconfig_speculative[target_fpga_id] = true;
+                num_speculative_loads++;
+            }
+            return;
+        }
+    }
+
+    /*
+    A tenant is active while it has work in flight or has issued an op
+    within active_threshold_ns. Victim searches only fall back to active
+    tenants when every candidate is active.
+    */
+    bool isSessionActive(aos_app_session * session_ptr, uint64_t now_ns) {
+        if (session_ptr->isDMAWriteBufferBusy() || session_ptr->isDMAReadBufferBusy()) {
+            return true;
+        }
+        const session_id_t session_id = session_ptr->getSessionId();
+        auto req_it = cntrlreg_read_request_queue.find(session_id);
+        if ((req_it != cntrlreg_read_request_queue.end()) && !req_it->second.empty()) {
+            return true;
+        }
+        auto resp_it = cntrlreg_read_response_queue.find(session_id);
+        if ((resp_it != cntrlreg_read_response_queue.end()) && !resp_it->second.empty()) {
+            return true;
+        }
+        const uint64_t last_access_ns = session_ptr->getLastAccessTime();
+        return (now_ns < last_access_ns) || ((now_ns - last_access_ns) < active_threshold_ns);
+    }
+
+    /*
+    Among the occupied slots that can run app_id, pick the tenant to evict
+    under slot_eviction_policy, preferring idle tenants. Ties fall back to
+    LRU. Tenants inside their residency quantum are skipped, returns false
+    if that leaves nothing. same_fpga only looks at victim_fpga_id.
+    */
+    bool selectSlotVictim(std::string app_id, uint64_t & victim_fpga_id, uint64_t & victim_slot_id, bool same_fpga = false) {
+        const uint64_t now_ns = monotonic_ns();
+        bool found = false;
+        bool best_idle = false;
+        uint64_t best_metric = 0;
+        uint64_t best_last_access_ns = 0;
+        const uint64_t first_fpga_id = same_fpga ? victim_fpga_id : 0;
+        const uint64_t end_fpga_id   = same_fpga ? (victim_fpga_id + 1) : num_fpga;
+        for (uint64_t fpga_id = first_fpga_id; fpga_id < end_fpga_id; fpga_id++) {
+            const uint64_t fpga_load = calcFPGALoad(fpga_id);
+            auto & slot_appid_map_ = slot_appid_map[fpga_id];
+            auto & slot_session_map_ = slot_session_map[fpga_id];
+            const uint64_t num_slots = slot_session_map_.size();
+            for (uint64_t slot_id = 0; slot_id < num_slots; slot_id++) {
+                aos_app_session * session_ptr = slot_session_map_[slot_id];
+                if ((slot_appid_map_[slot_id] != app_id) || (session_ptr == nullptr)) {
+                    continue;
+                }
+                // Still inside its residency quantum
+                if (getResidencyLeft(session_ptr, now_ns) != 0) {
+                    continue;
+                }
+                const bool idle = !isSessionActive(session_ptr, now_ns);
+                const uint64_t last_access_ns = session_ptr->getLastAccessTime();
+                uint64_t metric = 0;
+                switch (slot_eviction_policy) {
+                    case EVICTION_POLICY::LEAST_LOAD : metric = fpga_load; break;
+                    case EVICTION_POLICY::LEAST_RECENT_BYTES : metric = session_ptr->getRecentBytes(now_ns); break;
+                    default : metric = last_access_ns; break;
+                }
+                if (!found ||
+                    (idle && !best_idle) ||
+                    ((idle == best_idle) && ((metric < best_metric) || ((metric == best_metric) && (last_access_ns < best_last_access_ns))))) {
+                    found = true;
+                    best_idle = idle;
+                    best_metric = metric;
+                    best_last_access_ns = last_access_ns;
+                    victim_fpga_id = fpga_id;
+                    victim_slot_id = slot_id;
+                }
+            }
+        }
+        return found;
+    }
+
+    /*
+    Pick the FPGA to reflash under fpga_eviction_policy, preferring FPGAs
+    with no active tenant. An FPGA's last access is the newest access to
+    any of its slots. Ties fall back to LRU. FPGAs being reconfigured,
+    loaded or reused less than min_image_residency_ns ago, or with a tenant
+    inside its residency quantum are skipped, returns false if that leaves
+    nothing.
+    */
+    bool selectFPGAVictim(uint64_t & victim_fpga_id) {
+        const uint64_t now_ns = monotonic_ns();
+        bool found = false;
+        bool best_idle = false;
+        uint64_t best_metric = 0;
+        uint64_t best_last_access_ns = 0;
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id) || ((now_ns - image_installed_ns[fpga_id]) < min_image_residency_ns)) {
+                continue;
+            }
+            bool idle = true;
+            bool in_quantum = false;
+            for (auto & slot_session : slot_session_map[fpga_id]) {
+                if (slot_session.second == nullptr) {
+                    continue;
+                }
+                if (getResidencyLeft(slot_session.second, now_ns) != 0) {
+                    in_quantum = true;
+                    break;
+                }
+                if (isSessionActive(slot_session.second, now_ns)) {
+                    idle = false;
+                }
+            }
+            // Reflashing would evict a tenant before its quantum is up
+            if (in_quantum) {
+                continue;
+            }
+            uint64_t last_access_ns = 0;
+            uint64_t recent_bytes = 0;
+            for (auto & stats : slot_access_stats[fpga_id]) {
+                last_access_ns = std::max(last_access_ns, stats.last_access_ns);
+                recent_bytes  += stats.getRecentBytes(now_ns);
+            }
+            uint64_t metric = 0;
+            switch (fpga_eviction_policy) {
+                case EVICTION_POLICY::LEAST_LOAD : metric = calcFPGALoad(fpga_id); break;
+                case EVICTION_POLICY::LEAST_RECENT_BYTES : metric = recent_bytes; break;
+                default : metric = last_access_ns; break;
+            }
+            if (!found ||
+                (idle && !best_idle) ||
+                ((idle == best_idle) && ((metric < best_metric) || ((metric == best_metric) && (last_access_ns < best_last_access_ns))))) {
+                best_idle = idle;
+                best_metric = metric;
+                best_last_access_ns = last_access_ns;
+                victim_fpga_id = fpga_id;
+                found = true;
+            }
+        }
+        return found;
+    }
+
     uint64_t calcFPGALoad(uint64_t fpga_id) {
         assert(fpga_id < num_fpga);
         auto & slot_session_map_ = slot_session_map[fpga_id];
@@ -1080,24 +3869,56 @@ private:
     }
 
     /*
-    The session_id passed in is not scheduled and needs to be
+    The session_id passed in is not scheduled and needs to be. Returns
+    false if the session has to wait for wait_fpga_id to be reconfigured
+    (or ~0x0 if scheduling failed outright), the request is replayed once
+    the new image is up. Evicting a tenant or an image is only allowed once
+    the session has waited eviction_hysteresis_ns, until then wait_fpga_id
+    is ADMISSION_QUEUE_ID and the request waits for admission.
     */
-    bool handleScheduling(session_id_t session_id) {
+    bool handleScheduling(session_id_t session_id, uint64_t & wait_fpga_id) {
         assert(isSessionIdValid(session_id));
         assert(!isSessionScheduled(session_id));
+        wait_fpga_id = ~0x0;
         if (isDummy) {
             return true;
         }
+        aos_latency_timer timer(getStageHistogram(STAGE_SCHEDULING));
+        aos_trace_span span("handleScheduling", session_id);
+
+        AOS_LOG_DEBUG("================================== Inside handleScheduling , trying to schedule session: " << session_id);
+        if (verbose_scheduling) {
+            dumpSchedulerState();
+        }
 
-        std::cout << std::endl << "================================== Inside handleScheduling , trying to schedule session: " << session_id << std::endl;
-        std::cout << std::flush;
-        dumpSchedulerState();
+        AOS_PROBE1(schedule_start, session_id);
+        const bool bound = scheduleSession(session_id, wait_fpga_id);
+        AOS_PROBE3(schedule_done, session_id, bound, wait_fpga_id);
+        return bound;
+    }
 
+    // The decision itself, handleScheduling wraps it in timing, tracing and probes
+    bool scheduleSession(session_id_t session_id, uint64_t & wait_fpga_id) {
         aos_app_session * const session_ptr = sessions[session_id];
         std::string desired_app_id = session_ptr->getAppId();
 
+        // A mode switch of its FPGA is in flight, the session is rebound once the image is up
+        auto tenant_it = mode_switch_tenants.find(session_id);
+        if (tenant_it != mode_switch_tenants.end()) {
+            if (isFPGAReconfiguring(tenant_it->second)) {
+                wait_fpga_id = tenant_it->second;
+                return false;
+            }
+            mode_switch_tenants.erase(tenant_it);
+        }
+
+        const uint64_t now_ns = monotonic_ns();
+        session_ptr->markWaiting(now_ns);
+        const bool may_evict = ((now_ns - session_ptr->getWaitStartTime()) >= eviction_hysteresis_ns);
+
         // Steps to schedule this app
         /*
+        0) Go back to the slot whose DRAM partition still holds the session's data
         1) Find an empty FPGA that preferably has no image or all slots unbound (no running apps/load == 0)
         2) Find an empty slot on any currently flashed FPGA that can accomidate this app
             a) If tie, use the FPGA with the lesser load on it
@@ -1106,220 +3927,308 @@ private:
         4) If no FPGA can fit this app, then we need to select an FPGA for image replacement
         */
 
+        // 0) Its data is still in the partition of a free slot, take it. Binding anyone else
+        // there would have reset the slot, so an occupied slot no longer holds the data.
+        uint64_t local_fpga_id = 0;
+        uint64_t local_slot_id = 0;
+        uint64_t resident_bytes = 0;
+        if (getDataResidency(session_id, local_fpga_id, local_slot_id, resident_bytes) && !isFPGAReconfiguring(local_fpga_id) &&
+            (slot_appid_map[local_fpga_id][local_slot_id] == desired_app_id) && (slot_session_map[local_fpga_id][local_slot_id] == nullptr)) {
+            AOS_LOG_DEBUG("Data of session " << session_id << " (" << resident_bytes << " bytes) is still on FPGA ID: " << local_fpga_id
+                          << " slot " << local_slot_id << ", binding it there");
+            num_local_rebinds++;
+            bindAppToSlot(session_id, local_fpga_id, local_slot_id);
+            return true;
+        }
+
         bool empty_fpga_found = false;
         uint64_t fpga_id_to_use = ~0x0;
 
         // 1) Find an empty FPGA or an FPGA with all slots unbound
+        // FPGAs being reconfigured are neither empty nor available. An idle FPGA
+        // that already holds an image with the app (e.g. prefetched) comes first,
+        // then a speculative load of such an image, then FPGAs with no image.
+        uint64_t resident_fpga_id = ~0x0;
+        uint64_t no_image_fpga_id = ~0x0;
+        uint64_t idle_fpga_id     = ~0x0;
         for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            if (isFPGAReconfiguring(fpga_id)) {
+                continue;
+            }
             if (!sched->anyImageLoaded(fpga_id)) {
-                empty_fpga_found = true;
-                fpga_id_to_use   = fpga_id;
-                break;
+                no_image_fpga_id = std::min(no_image_fpga_id, fpga_id);
+            } else if (calcFPGALoad(fpga_id) == 0) {
+                if (imageHasApp(sched->getCurrentImageIdx(fpga_id), desired_app_id)) {
+                    resident_fpga_id = std::min(resident_fpga_id, fpga_id);
+                } else {
+                    idle_fpga_id = std::min(idle_fpga_id, fpga_id);
+                }
             }
         }
-        if (!empty_fpga_found) {
+        if (resident_fpga_id == (uint64_t)~0x0) {
             for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
-                if (calcFPGALoad(fpga_id) == 0) {
-                    empty_fpga_found = true;
-                    fpga_id_to_use   = fpga_id;
-                    break;
+                if (isFPGAReconfiguring(fpga_id) && reconfig_speculative[fpga_id] && imageHasApp(reconfig_image_idx[fpga_id], desired_app_id)) {
+                    // The speculation paid off, it is a real load from now on
+                    reconfig_speculative[fpga_id] = false;
+                    num_speculative_hits++;
+                    wait_fpga_id = fpga_id;
+                    return false;
                 }
             }
         }
+        if (resident_fpga_id != (uint64_t)~0x0) {
+            empty_fpga_found = true;
+            fpga_id_to_use   = resident_fpga_id;
+        } else if (no_image_fpga_id != (uint64_t)~0x0) {
+            empty_fpga_found = true;
+            fpga_id_to_use   = no_image_fpga_id;
+        } else if (idle_fpga_id != (uint64_t)~0x0) {
+            empty_fpga_found = true;
+            fpga_id_to_use   = idle_fpga_id;
+        }
 
         if (empty_fpga_found) {
-        	std::cout << "Empty FPGA found, fpga id: " << fpga_id_to_use << " ,trying to schedule app: " << desired_app_id << std::endl;
-        	std::cout << std::flush;
-            auto & newImage = getReplacementImage(desired_app_id);
-            switchImage(fpga_id_to_use, newImage);
-            //return true;
+        	AOS_LOG_DEBUG("Empty FPGA found, fpga id: " << fpga_id_to_use << " ,trying to schedule app: " << desired_app_id);
+            const uint32_t newImage = getPlannedImage(desired_app_id, fpga_id_to_use);
+            // A resident image is reused and the slot search below finds it
+            if (!beginSwitchImage(fpga_id_to_use, newImage)) {
+                // The request is replayed, and finds its slot, once the image is up
+                wait_fpga_id = fpga_id_to_use;
+                return false;
+            }
         }
 
-        // 2 & 3) No Empty FPGA was found or we just loaded the image we needed!
-        uint64_t max_load = ~0x0;
-        bool matching_slot_found = false;
+        // 2) No Empty FPGA was found or we just loaded the image we needed!
+        // Use an empty slot that fits the app, on the least loaded FPGA
+        uint64_t min_load = ~0x0;
         bool matching_empty_slot_found = false;
         uint64_t slot_id_to_use = ~0x0;
         fpga_id_to_use = ~0x0;
 
         for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
             const uint64_t fpga_load = calcFPGALoad(fpga_id);
+            if (matching_empty_slot_found && (fpga_load >= min_load)) {
+                continue;
+            }
             auto & slot_appid_map_ = slot_appid_map[fpga_id];
             auto & slot_session_map_ = slot_session_map[fpga_id];
             const uint64_t num_slots = slot_session_map_.size();
-            // First see if we can find a slot that both app id matches and is empty
             for (uint64_t slot_id = 0; slot_id < num_slots; slot_id++) {
-                if (slot_appid_map_[slot_id] == desired_app_id) {
-                    // See if the matching slot is also empty
-                    if (slot_session_map_[slot_id] == nullptr) {
-                        // Found an empty slot
-                        if (!matching_empty_slot_found) {
-                            // First empty slot found
-                            max_load = fpga_load;
-                            matching_slot_found = true;
-                            matching_empty_slot_found = true;
-                            slot_id_to_use = slot_id;
-                            fpga_id_to_use = fpga_id;
-                            break; // Not interested in additional slots on this FPGA
-                        } else {
-                            // Another matching empty slot was found prior
-                            // Use load as a tie breaker
-                            if (max_load > fpga_load) {
-                                // this one wins out
-                                max_load = fpga_load;
-                                slot_id_to_use = slot_id;
-                                fpga_id_to_use = fpga_id;
-                                break; // Not interested in additional slots on this FPGA
-                            }
-                        }
-                    } else {
-                        // First slot found with a match across all FPGAs
-                        if (!matching_slot_found) {
-                            max_load = fpga_load;
-                            matching_slot_found = true;
-                            slot_id_to_use = slot_id;
-                            fpga_id_to_use = fpga_id;
-                            continue; // Keep going through other slots, because they might be empty
-                        } else if (matching_slot_found && !matching_empty_slot_found) {
-                            // A prior non-empty slot was found, use load as tie break
-                            if (max_load > fpga_load) {
-                                max_load = fpga_load;
-                                slot_id_to_use = slot_id;
-                                fpga_id_to_use = fpga_id;
-                                break; // Not interested in additional slots on this FPGA
-                            }
-                        }
-                    }
-                } // Appid == desired app id
-            } // slot loop
-        } // fpga loop
+                if ((slot_appid_map_[slot_id] == desired_app_id) && (slot_session_map_[slot_id] == nullptr)) {
+                    min_load = fpga_load;
+                    matching_empty_slot_found = true;
+                    slot_id_to_use = slot_id;
+                    fpga_id_to_use = fpga_id;
+                    break; // Not interested in additional slots on this FPGA
+                }
+            }
+        }
 
         if (matching_empty_slot_found) {
-        	std::cout << "Matching slot found, binding app to the slot " << slot_id_to_use << " on FPGA ID: " << fpga_id_to_use << std::endl;
-        	std::cout << std::flush;
+        	AOS_LOG_DEBUG("Matching slot found, binding app to the slot " << slot_id_to_use << " on FPGA ID: " << fpga_id_to_use);
             bindAppToSlot(session_id, fpga_id_to_use, slot_id_to_use);
             return true;
-        } else if (matching_slot_found) {
-        	std::cout << "No matching slot found! Need to unbind an app" << std::endl;
-        	std::cout << std::flush;
+        }
+
+        // Everything past here takes something away from someone else, hold off until the hysteresis ran out
+        if (!may_evict) {
+            wait_fpga_id = ADMISSION_QUEUE_ID;
+            return false;
+        }
+
+        // 3) Every fitting slot is taken, evict the tenant the slot policy picks
+        if (selectSlotVictim(desired_app_id, fpga_id_to_use, slot_id_to_use)) {
+        	AOS_LOG_DEBUG("No empty matching slot found! Unbinding the app in slot " << slot_id_to_use << " on FPGA ID: " << fpga_id_to_use);
+            admission_stats.num_slot_evictions++;
+            admission_stats.num_evicted_sessions++;
             // swap out the old session
             unbindAppFromSlot(fpga_id_to_use, slot_id_to_use);
             // Reset the app slot on the FPGA
-            resetSlotState(fpga_id_to_use, slot_id_to_use);
+            resetSlotState(fpga_id_to_use, slot_id_to_use, session_id);
             // swap in the new session
             bindAppToSlot(session_id, fpga_id_to_use, slot_id_to_use);
             // done scheduling
-            return true;        
+            return true;
         }
 
         // 4) No FPGA can accomidate the app_id, and we need to flash a new image onto one
-        std::cout << "No matching FPGA slot found, looking for replacement" << std::endl;
-        std::cout << std::flush;
+        AOS_LOG_DEBUG("No matching FPGA slot found, looking for replacement");
 
-        uint64_t victim_fpga_id = ~0x0;
-        max_load = ~0x0;
+        // A tenant of the app leaves its quantum before any image with the app could be loaded, wait for its slot
+        if (getAppResidencyLeft(desired_app_id, now_ns) < getAppLoadLatency(desired_app_id)) {
+            wait_fpga_id = ADMISSION_QUEUE_ID;
+            return false;
+        }
 
-        // Compute the load of all FPGAs
+        // A speculative load that does not have the app is the cheapest victim, it has no tenants
         for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
-            const uint64_t fpga_load = calcFPGALoad(fpga_id);
-            if (fpga_load < max_load) {
-                victim_fpga_id = fpga_id;
+            if (isFPGAReconfiguring(fpga_id) && reconfig_speculative[fpga_id]) {
+                sched->cancelReconfiguration(fpga_id);
+                reconfig_speculative[fpga_id] = false;
+                num_speculative_cancels++;
+                wait_fpga_id = fpga_id;
+                return false;
+            }
+        }
+
+        uint64_t victim_fpga_id;
+        if (!selectFPGAVictim(victim_fpga_id)) {
+            // Every FPGA is being reconfigured, or it or a tenant is inside its residency quantum,
+            // wait for a reconfiguration if there is one, otherwise for admission
+            wait_fpga_id = ADMISSION_QUEUE_ID;
+            for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+                if (isFPGAReconfiguring(fpga_id)) {
+                    wait_fpga_id = fpga_id;
+                    break;
+                }
             }
+            return false;
         }
 
+        // Tenants that fit elsewhere move instead of being evicted
+        std::vector<aos_tenant_move> moves;
+        planTenantMoves(victim_fpga_id, moves);
+        migrateTenants(moves);
+        // Select replacement image, before unbinding so it can see what would be evicted
+        const uint32_t newImage = getPlannedImage(desired_app_id, victim_fpga_id);
+        if (sched->isImageResident(victim_fpga_id, newImage)) {
+            // The image stays, so at most one slot changes hands. A tenant that moved away may have left one free.
+            if (bindAppToUnusedSlot(session_id, victim_fpga_id)) {
+                return true;
+            }
+            uint64_t victim_slot_id;
+            if (!selectSlotVictim(desired_app_id, victim_fpga_id, victim_slot_id, true)) {
+                wait_fpga_id = ADMISSION_QUEUE_ID;
+                return false;
+            }
+            admission_stats.num_slot_evictions++;
+            admission_stats.num_evicted_sessions++;
+            unbindAppFromSlot(victim_fpga_id, victim_slot_id);
+            bindAppToSlot(session_id, victim_fpga_id, victim_slot_id);
+            return true;
+        }
+        const uint64_t num_evicted = calcFPGALoad(victim_fpga_id);
+        if (num_evicted > 0) {
+            admission_stats.num_fpga_evictions++;
+            admission_stats.num_evicted_sessions += num_evicted;
+        }
         // Unbind and evacuate every app on the image
         unbindAllApps(victim_fpga_id);
-        // Select replacement image
-        auto & newImage = getReplacementImage(desired_app_id);
         // Change images
         // Do not have to call resetSlotState because flashing a new image issues a reset
-        switchImage(victim_fpga_id, newImage);
-        // Schedule the app
-        const uint64_t new_num_slots = slot_session_map[victim_fpga_id].size();
-        assert(slot_appid_map[victim_fpga_id].size() == new_num_slots);
-        for (uint64_t slot_id = 0; slot_id < new_num_slots; slot_id++) {
-            // check if the slot can accomidate the app type (app id)
-            if (slot_appid_map[victim_fpga_id][slot_id] == desired_app_id) {
-                if (slot_session_map[victim_fpga_id][slot_id] == nullptr) {
-                    // the slot is available
-                    bindAppToSlot(session_id, victim_fpga_id, slot_id);
-                    // done scheduling
-                    return true;
-                }
-                // Shouldn't find a fitting slot AND it be NOT available since we
-                // just swapped in a new image
+        if (beginSwitchImage(victim_fpga_id, newImage)) {
+            return bindAppToUnusedSlot(session_id, victim_fpga_id);
+        }
+        // The request is replayed, and finds its slot, once the image is up
+        wait_fpga_id = victim_fpga_id;
+        return false;
+    }
+
+    /*
+    Issues the DRAM zeroing of slots reset since the last pass, then the
+    bulk transfers clients handed over, in the order they came. A transfer
+    waits in the queue while its session is not bound to a slot or the
+    slot's FPGA is being reflashed, restoring the session's saved DRAM on
+    the next bind comes first. Dummy mode has no DRAM, writes are dropped
+    and reads return zeros.
+    */
+    void scheduleDMAOperations() {
+        // Slots reset since the last pass are zeroed before any transfer
+        for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+            while (!pending_dram_zeroing[fpga_id].empty() && !isFPGAReconfiguring(fpga_id) && !isDummy) {
+                zeroSlotDRAM(fpga_id, pending_dram_zeroing[fpga_id].begin()->first);
             }
         }
 
-        // Scheduling failed
-        return false;
-        /*
+        const size_t num_pending = pending_dma_session_id.size();
+        for (size_t idx = 0; idx < num_pending; idx++) {
+            const session_id_t session_id = pending_dma_session_id.front();
+            const DMA_OPERATION op = pending_dma_operation_type.front();
+            pending_dma_session_id.pop();
+            pending_dma_operation_type.pop();
 
-        bool any_appid_match_found = false;
-        uint64_t slot_id_of_lru = 0xFFFFFFFF;
-        std::time_t lru_access_time = std::time(nullptr); // current time
+            // The session closed with the transfer still queued
+            if (!isSessionIdValid(session_id)) {
+                continue;
+            }
 
-        const uint64_t num_slots = slot_session_map.size();
-        assert(slot_appid_map.size() == num_slots);
-        for (uint64_t slot_id = 0; slot_id < num_slots; slot_id++) {
-            // check if the slot can accomidate the app type (app id)
-            if (slot_appid_map[slot_id] == desired_app_id) {
-                any_appid_match_found = true;
-                // check if anything is scheduled in this slot
-                // use the first slot we find
-                if (slot_session_map[slot_id] == nullptr) {
-                    // the slot is available
-                    bindAppToSlot(session_id, slot_id);
-                    // done scheduling
-                    return true;
+            aos_app_session * session_ptr = sessions[session_id];
+            if (isDummy) {
+                if (op == DMA_OPERATION::WRITE) {
+                    session_ptr->markDMAWriteComplete();
+                    session_ptr->clearPendingDMAWrite();
                 } else {
-                    // Search for the LRU
-                    std::time_t slot_last_access_time = slot_session_map[slot_id]->getLastAccessTime();
-                    if (slot_last_access_time < lru_access_time) {
-                        slot_id_of_lru = slot_id;
-                        lru_access_time = slot_last_access_time;
-                    }
+                    memset(session_ptr->getDMAReadBuffer(), 0, session_ptr->getDMAReadSize());
+                    session_ptr->markDMAReadComplete();
                 }
+                continue;
+            }
+            if (!session_ptr->boundToSlot() || isFPGAReconfiguring(session_ptr->getFPGAId())) {
+                pending_dma_session_id.push(session_id);
+                pending_dma_operation_type.push(op);
+                continue;
             }
-        }
-
-        */
-    }
 
-    void scheduleDMAOperations() {
+            const uint64_t fpga_id = session_ptr->getFPGAId();
+            const uint64_t slot_id = session_ptr->getSlotId();
+            current_trace_session = session_id;
+            // The response hands the data over, the buffer stays busy until then
+            if (op == DMA_OPERATION::READ) {
+                aos_trace_span span("bulk_read", session_id, fpga_id, slot_id);
+                if (dma_read_dram(fpga_id, slot_id, session_ptr->getDMAReadAddr(), session_ptr->getDMAReadBuffer(), session_ptr->getDMAReadSize()) != 0) {
+                    AOS_LOG_ERROR("Bulk read of session " << session_id << " failed");
+                    memset(session_ptr->getDMAReadBuffer(), 0, session_ptr->getDMAReadSize());
+                }
+                current_trace_session = TRACE_NO_ID;
+                session_ptr->markDMAReadComplete();
+                continue;
+            }
 
+            const uint64_t addr = session_ptr->getDMAWriteAddr();
+            const uint64_t num_bytes = session_ptr->getDMAWriteSize();
+            aos_trace_span span("bulk_write", session_id, fpga_id, slot_id);
+            if (dma_write_dram(fpga_id, slot_id, addr, session_ptr->getDMAWriteBuffer(), num_bytes) != 0) {
+                AOS_LOG_ERROR("Bulk write of session " << session_id << " failed");
+            } else {
+                claimDRAMPages(fpga_id, slot_id, session_ptr, addr, num_bytes);
+            }
+            current_trace_session = TRACE_NO_ID;
+            session_ptr->markDMAWriteComplete();
+            session_ptr->clearPendingDMAWrite();
+        }
     }
   
     void dumpSchedulerState() {
+        // Skip the walk when its lines are compiled out or filtered
+        if ((LEVEL_DEBUG < AOS_LOG_MIN_LEVEL) || !isLogging(LEVEL_DEBUG)) {
+            return;
+        }
         // Print all Active sessions
-        cout << "Scheduler State: " << endl;
-        cout << "Num sessions: " << sessions.size() << endl;
+        AOS_LOG_DEBUG("Scheduler State: ");
+        AOS_LOG_DEBUG("Num sessions: " << sessions.size());
         for (auto const & session_pair : sessions) {
-            cout << "ID: "
-                 << session_pair.first
-                 << " "
-                 << (session_pair.second)->debugString()
-                 << std::endl;
+            AOS_LOG_DEBUG("ID: "
+                          << session_pair.first
+                          << " "
+                          << (session_pair.second)->debugString());
         }        
         // For each FPGA
         for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
-            cout << "FPGA ID: " << fpga_id << std::endl;
+            AOS_LOG_DEBUG("FPGA ID: " << fpga_id << " Planned image: "
+                          << ((fpga_id < placement_plan.target_image.size()) ? placement_plan.target_image[fpga_id] : NO_IMAGE_LOADED));
             // Print each slot
             const uint64_t num_slots = slot_session_map[fpga_id].size();
             assert(slot_appid_map[fpga_id].size() == num_slots);
             for (uint64_t slot_id = 0; slot_id < num_slots; slot_id++) {
-                cout << "Slot: "
-                     << slot_id
-                     << " AppId: "
-                     << slot_appid_map[fpga_id][slot_id]
-                     << " SessionId: "
-                     << ((slot_session_map[fpga_id][slot_id] == nullptr ? 0xDEADDEADDEADDEAD : (slot_session_map[fpga_id][slot_id]->getSessionId())))
-                     << std::endl;
+                AOS_LOG_DEBUG("Slot: "
+                              << slot_id
+                              << " AppId: "
+                              << slot_appid_map[fpga_id][slot_id]
+                              << " SessionId: "
+                              << ((slot_session_map[fpga_id][slot_id] == nullptr ? 0xDEADDEADDEADDEAD : (slot_session_map[fpga_id][slot_id]->getSessionId()))));
             }
         }
 
-        cout << std::flush;
-
     }
 
 };
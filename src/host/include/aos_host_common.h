@@ -9,6 +9,8 @@
 #include <stdexcept>
 #include <string>
 #include <array>
+#include <set>
+#include <algorithm>
 #include "json.hpp"
 // FPGA specific includes
 #include <fpga_pci.h>
@@ -17,14 +19,286 @@
 #include <utils/lcd.h>
 #include <utils/sh_dpi_tasks.h>
 #include <ctime>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <ostream>
 
 using json = nlohmann::json;
 using std::cout;
 using std::endl;
 using std::flush;
 
+// A range of CntrlReg addresses, [first, first + second)
+using cntrlreg_range_t = std::pair<uint64_t, uint64_t>;
+// A range of an app's DRAM partition, [first, first + second) in bytes
+using dram_range_t = std::pair<uint64_t, uint64_t>;
+
 std::string cmd_exec(std::string cmd);
 
 void printErrorHost(std::string errStr);
 
+// Whether some process listens on the Unix socket at path, looked up in /proc/net/unix without connecting to it
+bool isSocketListening(const char * path);
+
+// Nanoseconds from CLOCK_MONOTONIC
+uint64_t monotonic_ns();
+// Simulation hook, while set monotonic_ns() returns *clock_ns instead. Not thread safe,
+// only for single threaded drivers such as the offline simulator. nullptr restores the real clock.
+void setVirtualClock(const uint64_t * clock_ns);
+
+// Length of one window of recent byte accounting
+#define ACCESS_STATS_WINDOW_NS (1000ULL * 1000 * 1000)
+
+/*
+    Access accounting for a tenant or a slot. Bytes are counted in two
+    back to back windows, so "recent" covers between one and two windows.
+*/
+struct aos_access_stats {
+    uint64_t last_access_ns;
+    uint64_t num_ops;
+    uint64_t total_bytes;
+    uint64_t window_start_ns;
+    uint64_t window_bytes;
+    uint64_t prev_window_bytes;
+
+    aos_access_stats();
+    void reset(uint64_t now_ns);
+    void recordAccess(uint64_t now_ns, uint64_t num_bytes);
+    uint64_t getRecentBytes(uint64_t now_ns) const;
+};
+
+// What preempting a tenant has cost, save is slot to host memory and restore the way back
+struct aos_preemption_stats {
+    uint64_t num_saves;
+    uint64_t num_restores;
+    uint64_t total_save_ns;
+    uint64_t total_restore_ns;
+    uint64_t last_save_ns;
+    uint64_t last_restore_ns;
+    uint64_t saved_bytes;    // DRAM copied out, summed over saves
+    uint64_t skipped_bytes;  // DRAM the host copy already held, left alone
+    uint64_t restored_bytes; // DRAM written back, summed over restores
+    uint64_t resident_bytes; // DRAM still in the slot's partition on restore, not written back
+};
+
+// Memory counters the shell keeps per slot since the image was loaded, in the order of AMIAppStats
+struct aos_mem_counters {
+    uint64_t read_reqs;
+    uint64_t write_reqs;
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+    uint64_t stall_cycles; // cycles a request waited for the arbiter
+    uint64_t read_resps;
+    uint64_t read_latency; // cycles summed over outstanding reads, over read_resps is the mean
+    uint64_t cycles;       // free running, same for every slot
+};
+
+// Latency histograms keep values below 2^LATENCY_SUB_BUCKET_BITS ns exact and split every power of two above into
+// 2^LATENCY_SUB_BUCKET_BITS buckets, so a percentile is within about 3% of the true value
+#define LATENCY_SUB_BUCKET_BITS 5
+#define LATENCY_NUM_BUCKETS ((64 - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+
+/*
+    HDR style log linear histogram of nanosecond latencies. Recording is a
+    handful of relaxed atomic adds and no locks, cheap enough to stay on,
+    and it may be read from another thread while it records. Such a reader
+    can see a sample counted before its bucket, which only shifts a
+    percentile by that one sample.
+*/
+class aos_latency_histogram {
+public:
+
+    aos_latency_histogram();
+    void record(uint64_t value_ns);
+    uint64_t getCount() const;
+    uint64_t getTotal() const;
+    uint64_t getMax() const;
+    // Upper bound of the bucket holding the sample at fraction (0 to 1) of the way up, 0 if empty
+    uint64_t getPercentile(double fraction) const;
+    static uint32_t getBucketIdx(uint64_t value_ns);
+    static uint64_t getBucketUpperBound(uint32_t bucket_idx);
+
+private:
+
+    std::atomic<uint64_t> buckets[LATENCY_NUM_BUCKETS];
+    std::atomic<uint64_t> num_samples;
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> max_ns;
+
+};
+
+// Stages of a daemon request that are timed separately
+enum LATENCY_STAGE {
+    STAGE_RECEIVE,    // command packet and payload off the socket
+    STAGE_SCHEDULING, // finding the session a slot, including any state it moves
+    STAGE_MMIO,       // BAR1 accesses
+    STAGE_DMA,        // DRAM transfers
+    STAGE_RESPONSE,   // response packet and payload onto the socket
+    NUM_LATENCY_STAGES
+};
+
+const char * getLatencyStageName(LATENCY_STAGE stage);
+
+// Records the time from construction to destruction, nothing if histogram is nullptr
+class aos_latency_timer {
+public:
+
+    aos_latency_timer(aos_latency_histogram * histogram);
+    ~aos_latency_timer();
+
+private:
+
+    aos_latency_histogram * histogram;
+    uint64_t start_ns;
+
+};
+
+// Threads with a counter slot of their own, any past that share the last slot
+#define METRIC_MAX_THREADS 64
+#define CACHE_LINE_BYTES 64
+
+/*
+    Counter for the metrics exporter. Every thread adds into a cache line of
+    its own, a relaxed add nobody else touches, and get() sums the lines, so
+    a scrape never bounces a line a hot path is writing. Exiting threads hand
+    their slot index to the next thread, whatever they counted stays in it.
+*/
+class aos_metric_counter {
+public:
+
+    aos_metric_counter();
+    ~aos_metric_counter();
+    aos_metric_counter(const aos_metric_counter &) = delete;
+    aos_metric_counter & operator=(const aos_metric_counter &) = delete;
+
+    void add(uint64_t value = 1);
+    uint64_t get() const;
+
+private:
+
+    struct aos_metric_slot {
+        std::atomic<uint64_t> value;
+        char padding[CACHE_LINE_BYTES - sizeof(std::atomic<uint64_t>)];
+    };
+
+    aos_metric_slot * slots;
+
+};
+
+// Spans each thread's ring buffer holds before the oldest are overwritten
+#define TRACE_RING_EVENTS 8192
+// Tag of a span without a session, FPGA or slot
+#define TRACE_NO_ID (~0x0ULL)
+
+/*
+    Span tracer. Every thread records into a ring buffer of its own, one
+    relaxed load and one release store and no locks, so tracing stays on.
+    dumpTrace writes whatever the rings hold as Chrome trace JSON, for
+    chrome://tracing or ui.perfetto.dev. A span's name has to be a string
+    literal, only the pointer is kept.
+*/
+class aos_trace_span {
+public:
+
+    aos_trace_span(const char * name, uint64_t session_id = TRACE_NO_ID, uint64_t fpga_id = TRACE_NO_ID, uint64_t slot_id = TRACE_NO_ID);
+    ~aos_trace_span();
+    void setSession(uint64_t session_id);
+    void setSlot(uint64_t fpga_id, uint64_t slot_id);
+
+private:
+
+    const char * name;
+    uint64_t session_id;
+    uint64_t fpga_id;
+    uint64_t slot_id;
+    bool recording;
+    uint64_t start_ns;
+
+};
+
+void setTracing(bool enabled);
+bool isTracing();
+// Shown for the calling thread's spans in the trace viewer
+void setTraceThreadName(std::string name);
+void dumpTrace(std::ostream & out);
+
+/*
+    USDT probes, provider aos, for bpftrace, SystemTap or perf. A probe is a
+    nop until a tracer attaches, so they are compiled in whenever
+    <sys/sdt.h> (systemtap-sdt-devel) is around, for example
+        bpftrace -e 'usdt:./aos_host_sched:aos:request_done { @[arg2] = count(); }'
+    -DAOS_NO_PROBES compiles them out. Arguments have to be integers.
+*/
+#if !defined(AOS_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define AOS_PROBES_ENABLED
+#endif
+#endif
+
+#ifdef AOS_PROBES_ENABLED
+#define AOS_PROBE1(name, a1) DTRACE_PROBE1(aos, name, a1)
+#define AOS_PROBE2(name, a1, a2) DTRACE_PROBE2(aos, name, a1, a2)
+#define AOS_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(aos, name, a1, a2, a3)
+#define AOS_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(aos, name, a1, a2, a3, a4)
+#define AOS_PROBE5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(aos, name, a1, a2, a3, a4, a5)
+#else
+#define AOS_PROBE1(name, a1) do {} while (0)
+#define AOS_PROBE2(name, a1, a2) do {} while (0)
+#define AOS_PROBE3(name, a1, a2, a3) do {} while (0)
+#define AOS_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+#define AOS_PROBE5(name, a1, a2, a3, a4, a5) do {} while (0)
+#endif
+
+// Severity of a log line, LEVEL_OFF silences the log
+enum LOG_LEVEL {
+    LEVEL_DEBUG, // every scheduling decision and a dump of the scheduler state
+    LEVEL_INFO,  // reconfigurations, evictions, migrations and other events worth reading later
+    LEVEL_WARN,
+    LEVEL_ERROR,
+    LEVEL_OFF
+};
+
+// Lines below this level are compiled out along with the formatting of their arguments
+#ifndef AOS_LOG_MIN_LEVEL
+#define AOS_LOG_MIN_LEVEL LEVEL_INFO
+#endif
+// Lines the queue to the writer thread holds, a producer drops its line when it is full
+#define LOG_QUEUE_RECORDS 4096
+// Longest line kept, longer ones are cut
+#define LOG_RECORD_BYTES 224
+
+/*
+    Asynchronous log. AOS_LOG formats into a buffer of the calling thread,
+    then hands the line to a lock free queue that a writer thread drains to
+    stdout, so logging never blocks on the terminal or takes a lock. The
+    writer starts with the first line and the tail is written at exit.
+*/
+#define AOS_LOG(level, message) \
+    do { \
+        if (((level) >= AOS_LOG_MIN_LEVEL) && isLogging(level)) { \
+            beginLogLine() << message; \
+            endLogLine(level); \
+        } \
+    } while (0)
+#define AOS_LOG_DEBUG(message) AOS_LOG(LEVEL_DEBUG, message)
+#define AOS_LOG_INFO(message) AOS_LOG(LEVEL_INFO, message)
+#define AOS_LOG_WARN(message) AOS_LOG(LEVEL_WARN, message)
+#define AOS_LOG_ERROR(message) AOS_LOG(LEVEL_ERROR, message)
+
+// Runtime threshold on top of AOS_LOG_MIN_LEVEL
+void setLogLevel(LOG_LEVEL level);
+bool isLogging(LOG_LEVEL level);
+std::ostream & beginLogLine();
+void endLogLine(LOG_LEVEL level);
+// Writes every line queued so far before returning
+void flushLog();
+// Lines lost to a full queue
+uint64_t getNumDroppedLogLines();
+
 #endif // AOS_HOST_COMMON
\ No newline at end of file
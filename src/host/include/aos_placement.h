@@ -0,0 +1,54 @@
+#ifndef AOS_PLACEMENT
+#define AOS_PLACEMENT
+
+#include "aos_scheduler.h"
+
+// How far ahead image selection looks when weighing a reconfiguration against the work it enables
+#define DEFAULT_RECONFIG_HORIZON_NS (60ULL * 1000 * 1000 * 1000)
+
+// What the planner needs to know about one FPGA
+struct FPGAPlacementState {
+    // Image on the FPGA, or the one it is loading, NO_IMAGE_LOADED if empty
+    int32_t image_idx;
+    // Mid reconfiguration, the planner has to keep image_idx
+    bool locked;
+    // Sessions bound to its slots, evicted if the image is switched
+    uint32_t num_bound;
+};
+
+/*
+    Images for the whole fleet. target_image is per FPGA (NO_IMAGE_LOADED
+    leaves an empty FPGA alone), app_slots[fpga][app_idx] is how many of
+    the outstanding sessions of an app the plan runs on that FPGA.
+*/
+struct PlacementPlan {
+    std::vector<int32_t> target_image;
+    std::vector<std::vector<uint32_t>> app_slots;
+    uint64_t num_placed;
+    uint32_t num_reconfigs;
+};
+
+class aos_placement {
+public:
+
+    aos_placement(const aos_scheduler & scheduler, uint64_t horizon_ns);
+
+    /*
+    Jointly picks an image for every FPGA given the outstanding demand,
+    indexed by interned app index (running plus waiting sessions).
+    */
+    PlacementPlan plan(const std::vector<FPGAPlacementState> & fpgas, const std::vector<uint32_t> & demand) const;
+
+    // Sessions of app_idx the plan has room for, summed over the fleet
+    uint64_t getPlannedCapacity(const PlacementPlan & placement, uint32_t app_idx) const;
+
+private:
+
+    double scoreImage(uint32_t image_idx, const FPGAPlacementState & fpga, const std::vector<uint32_t> & remaining, uint64_t & servable) const;
+
+    const aos_scheduler & sched;
+    uint64_t reconfig_horizon_ns;
+
+};
+
+#endif // AOS_PLACEMENT
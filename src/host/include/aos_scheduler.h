@@ -1,5 +1,84 @@
+#ifndef AOS_SCHEDULER
+#define AOS_SCHEDULER
+
 #include "aos_host_common.h"
 
+// Legacy BAR1 layout, used when an image does not describe its slot windows
+#define DEFAULT_SLOT_BAR1_SHIFT 13
+#define DEFAULT_SLOT_BAR1_SIZE  (1ULL << DEFAULT_SLOT_BAR1_SHIFT)
+// Slots the shell's SoftReg router can address, it selects the app with BAR1 bits 15-13 (AmorphOSSoftReg.sv)
+#define SOFTREG_ROUTED_SLOTS    8
+// Window the shell keeps for the per app memory counters, no slot may map over it
+#define MEM_STATS_BAR1_BASE     0x10000ULL
+#define MEM_STATS_BAR1_SIZE     0x400ULL
+// Slot app << 6 and counter << 3 within the window, a write latches every slot
+#define MEM_STATS_SLOT_SHIFT    6
+#define MEM_STATS_MAX_SLOTS     (MEM_STATS_BAR1_SIZE >> MEM_STATS_SLOT_SHIFT)
+
+#define NO_IMAGE_LOADED (-1)
+
+// Assumed cost of loading an image that has never been measured
+#define DEFAULT_IMAGE_LOAD_LATENCY_NS (5ULL * 1000 * 1000 * 1000)
+// Weight of the newest load measurement, out of 256
+#define IMAGE_LOAD_LATENCY_EWMA_WEIGHT 64
+// Weight of the newest inter-arrival gap, out of 256
+#define ARRIVAL_EWMA_WEIGHT 64
+// An app that has not shown up for this many expected gaps is no longer predicted
+#define ARRIVAL_STALE_GAPS 4
+// programImage result when the load was cancelled before the image went on
+#define RECONFIG_CANCELLED (-125)
+
+// Polling passed to the fpga_mgmt sync calls, 0 selects the SDK defaults
+#define FPGA_MGMT_SYNC_TIMEOUT_POLLS 0
+#define FPGA_MGMT_SYNC_DELAY_MSEC    0
+
+// Sparse demand vector, pairs of (interned app index, count)
+using app_demand_t = std::vector<std::pair<uint32_t, uint32_t>>;
+
+// Throughput rating of a slot that does not declare one
+#define DEFAULT_SLOT_THROUGHPUT 1.0
+
+struct SlotDescriptor {
+    uint64_t slot_id;
+    uint32_t app_idx;
+    uint64_t bar1_base;
+    uint64_t bar1_size;
+    // Relative speed of the app in this slot (clock, resources), 1.0 unless the image says otherwise
+    double throughput;
+};
+
+/*
+    Typed form of an image in fpga_images.json, built once when the file
+    is parsed so scheduling queries never have to walk json
+*/
+struct ImageDescriptor {
+    std::string agfi;
+    std::string afi;
+    std::string description;
+    uint32_t num_slots;
+    std::vector<SlotDescriptor> slots;
+    // Dense, indexed by interned app index. Apps interned after this image
+    // was parsed are past the end of the vector and have a count of 0.
+    std::vector<uint32_t> app_counts;
+    // Same indexing, the best throughput rating among the app's slots, 0 if it has none
+    std::vector<double> app_throughput;
+
+    uint32_t getAppCount(uint32_t app_idx) const {
+        return (app_idx < app_counts.size()) ? app_counts[app_idx] : 0;
+    }
+
+    double getAppThroughput(uint32_t app_idx) const {
+        return (app_idx < app_throughput.size()) ? app_throughput[app_idx] : 0.0;
+    }
+};
+
+// Session arrival history of one app
+struct AppArrivalStats {
+    uint64_t num_arrivals;
+    uint64_t last_arrival_ns;
+    uint64_t ewma_interarrival_ns;
+};
+
 class aos_scheduler {
 public:
 
@@ -23,16 +102,102 @@ public:
 
     bool appIdExists(std::string app_id);
 
+    // Typed image library
+    uint32_t getNumImages() const;
+    const ImageDescriptor & getImageDescriptor(uint32_t image_idx) const;
+    int32_t getAppIdx(const std::string & app_id) const;
+    const std::string & getAppIdByIdx(uint32_t app_idx) const;
+    app_demand_t generateAppDemand(std::vector<std::string> app_ids, std::vector<uint32_t> app_counts) const;
+    std::vector<uint32_t> getAllFittingImages(const app_demand_t & app_demand) const;
+    bool canImageSatisfyNeed(uint32_t image_idx, const app_demand_t & app_demand) const;
+    int32_t getCurrentImageIdx(uint64_t fpga_id) const;
+    bool isImageResident(uint64_t fpga_id, uint32_t image_idx) const;
+    // Adopt whatever library image is already on the FPGA, e.g. left by a previous daemon
+    bool probeResidentImage(uint64_t fpga_id);
+    uint32_t getNumApps() const;
+
+    // Measured cost of reconfiguring to an image (clear + load)
+    uint64_t getImageLoadLatency(uint32_t image_idx) const;
+    void recordImageLoadLatency(uint32_t image_idx, uint64_t latency_ns);
+
+    // CntrlReg addresses the app declares as non-volatile (reads return the last write)
+    std::vector<cntrlreg_range_t> getShadowRegRanges(std::string app_id);
+    // CntrlReg addresses holding app state, read back when the app is preempted and written again when it resumes
+    std::vector<cntrlreg_range_t> getStateRegRanges(std::string app_id);
+    // CntrlReg addresses that are safe to zero when the slot gets a new tenant
+    std::vector<cntrlreg_range_t> getResetRegRanges(std::string app_id);
+    // DRAM the app may write without the daemon seeing it, saved on preemption whether the client wrote it or not
+    std::vector<dram_range_t> getDRAMRegions(std::string app_id);
+    // CntrlReg the app writes when it is done, for backends that have no interrupts to stand in for one
+    bool getDoneReg(std::string app_id, uint64_t & addr);
+
     std::map<uint64_t, std::string> getSlotAppIdMap(json & image);
+    std::map<uint64_t, std::string> getSlotAppIdMap(uint32_t image_idx) const;
+    std::map<uint64_t, uint64_t> getSlotBAR1BaseMap(json & image);
+    std::map<uint64_t, uint64_t> getSlotBAR1SizeMap(json & image);
+    bool validateSlotWindows(json & image);
 
-    // Run on the FPGA
+    // Run on the FPGA, blocking
     void clearImage(uint64_t fpga_id);
     void loadImage(uint64_t fpga_id, uint32_t image_idx);
 
+    // Reconfiguration split so the blocking part can run off the daemon thread.
+    // Only programImage may be called from another thread, it touches no scheduler state.
+    void beginReconfiguration(uint64_t fpga_id, uint32_t image_idx);
+    int programImage(uint64_t fpga_id, uint32_t image_idx) const;
+    void completeReconfiguration(uint64_t fpga_id, uint32_t image_idx, int rc);
+
+    // Ask an in flight reconfiguration to stop, safe to call while programImage runs
+    void cancelReconfiguration(uint64_t fpga_id);
+    bool isReconfigurationCancelled(uint64_t fpga_id) const;
+
+    // Arrival prediction
+    void recordSessionArrival(const std::string & app_id, uint64_t now_ns);
+    bool getPredictedArrival(uint32_t app_idx, uint64_t now_ns, uint64_t & predicted_ns) const;
+    // (predicted arrival, app index) of every app expected within horizon_ns, soonest first
+    std::vector<std::pair<uint64_t, uint32_t>> getPredictedArrivals(uint64_t now_ns, uint64_t horizon_ns) const;
+
+    // Stand-in for the FPGA management API, a load sleeps instead of reprogramming
+    void setSimulatedReconfiguration(bool simulated, uint64_t load_latency_ns);
+    uint64_t getSimulatedLoadLatency() const;
+
 private:
 
+    uint32_t internAppId(const std::string & app_id);
+    void addImageDescriptor(json & image);
+    bool convertAppTuplesToDemand(json & app_tuples, app_demand_t & app_demand) const;
+    int clearFPGA(uint64_t fpga_id) const;
+    int loadFPGA(uint64_t fpga_id, uint32_t image_idx) const;
+
     const uint64_t num_fpga;
     json image_library;
-    std::vector<json> current_image;
+    std::map<std::string, std::vector<cntrlreg_range_t>> app_shadow_ranges;
+    std::map<std::string, std::vector<cntrlreg_range_t>> app_state_ranges;
+    std::map<std::string, std::vector<cntrlreg_range_t>> app_reset_ranges;
+    std::map<std::string, std::vector<dram_range_t>> app_dram_regions;
+    std::map<std::string, uint64_t> app_done_reg;
+    std::vector<int32_t> current_image;
+    // When the clear preceding a load started, so the whole reconfiguration is measured
+    std::vector<uint64_t> clear_start_ns;
+
+    // Typed library, image_descriptors[i] describes image_library[i]
+    std::vector<ImageDescriptor> image_descriptors;
+    std::map<std::string, uint32_t> agfi_to_image_idx;
+    // App interning
+    std::map<std::string, uint32_t> app_id_to_idx;
+    std::vector<std::string> app_idx_to_id;
+    // Inverted index, for every app the (ascending) images that contain it
+    std::vector<std::vector<uint32_t>> images_with_app;
+    // EWMA of the measured load latency per image, 0 if never loaded
+    std::vector<uint64_t> image_load_latency_ns;
+    // Per app, indexed by interned app index
+    std::vector<AppArrivalStats> app_arrivals;
+    // Per FPGA, polled by programImage
+    std::unique_ptr<std::atomic<bool>[]> reconfig_cancelled;
+    // Simulated reconfiguration
+    std::atomic<bool> simulated_reconfig;
+    std::atomic<uint64_t> simulated_load_latency_ns;
 
 };
+
+#endif // AOS_SCHEDULER
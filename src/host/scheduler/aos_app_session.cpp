@@ -8,7 +8,9 @@ aos_app_session::aos_app_session(std::string app_id, session_id_t session_id):
     fpga_slot(~0x0),
     saved_state(false),
     creation_time(std::time(nullptr)),
-    last_access_time(creation_time)
+    bound_ns(0),
+    wait_start_ns(0),
+    blocking(true)
 {
     // Setup DMA Buffwers
     // Write Buffer
@@ -27,6 +29,10 @@ aos_app_session::aos_app_session(std::string app_id, session_id_t session_id):
     dma_read_dest_addr = 0;
     dma_read_enque_time = 0;
     dma_read_complete = false;
+
+    memset(&preemption_stats, 0, sizeof(aos_preemption_stats));
+
+    completion_eventfd = -1;
 }
 
 aos_app_session::~aos_app_session() {
@@ -38,6 +44,10 @@ aos_app_session::~aos_app_session() {
         free(dma_read_buffer);
         dma_read_buffer = nullptr;
     }
+    if (completion_eventfd != -1) {
+        close(completion_eventfd);
+        completion_eventfd = -1;
+    }
 }
 
 void aos_app_session::unbindFromSlot() {
@@ -50,6 +60,8 @@ void aos_app_session::bindToSlot(uint64_t fpga_num_id, uint64_t slot_id) {
     active_slot = true;
     fpga_id     = fpga_num_id; 
     fpga_slot   = slot_id;
+    bound_ns      = monotonic_ns();
+    wait_start_ns = 0;
 }
 
 bool aos_app_session::boundToSlot() const {
@@ -95,20 +107,51 @@ session_id_t aos_app_session::getSessionId() const {
     return session_id;
 }
 
-void aos_app_session::updateLastAccessTime() {
-    last_access_time = std::time(nullptr);
+void aos_app_session::recordAccess(uint64_t now_ns, uint64_t num_bytes) {
+    access_stats.recordAccess(now_ns, num_bytes);
 }
 
 std::time_t aos_app_session::getCreationTime() const {
     return creation_time;
 }
 
-std::time_t aos_app_session::getLastAccessTime() const {
-    return last_access_time;
+uint64_t aos_app_session::getLastAccessTime() const {
+    return access_stats.last_access_ns;
+}
+
+uint64_t aos_app_session::getRecentBytes(uint64_t now_ns) const {
+    return access_stats.getRecentBytes(now_ns);
+}
+
+const aos_access_stats & aos_app_session::getAccessStats() const {
+    return access_stats;
 }
 
 bool aos_app_session::isMoreRecentlyUsed(aos_app_session * other) const {
-    return (last_access_time > other->getLastAccessTime());
+    return (access_stats.last_access_ns > other->getLastAccessTime());
+}
+
+uint64_t aos_app_session::getBoundTime() const {
+    return bound_ns;
+}
+
+// Only the first failed attempt starts the clock, retries keep their place
+void aos_app_session::markWaiting(uint64_t now_ns) {
+    if (wait_start_ns == 0) {
+        wait_start_ns = now_ns;
+    }
+}
+
+uint64_t aos_app_session::getWaitStartTime() const {
+    return wait_start_ns;
+}
+
+void aos_app_session::setBlocking(bool is_blocking) {
+    blocking = is_blocking;
+}
+
+bool aos_app_session::isBlocking() const {
+    return blocking;
 }
 
 bool aos_app_session::isDMAWriteBufferBusy() const {
@@ -180,6 +223,7 @@ void aos_app_session::clearPendingDMAWrite() {
     dma_write_dest_addr   = 0;
     dma_write_enque_time  = 0;
     dma_write_complete    = false;
+    dma_write_buffer_busy = false;
 }
 
 void aos_app_session::clearPendingDMARead() {
@@ -187,6 +231,7 @@ void aos_app_session::clearPendingDMARead() {
     dma_read_dest_addr    = 0;
     dma_read_enque_time   = 0;
     dma_read_complete     = false;
+    dma_read_buffer_busy  = false;
 }
 
 std::time_t aos_app_session::getDMAWriteTime() const {
@@ -221,7 +266,161 @@ void aos_app_session::markDMAReadComplete() {
   dma_read_complete = true;
 }
 
+uint64_t aos_app_session::getDMAWriteSize() const {
+  return dma_write_valid_bytes;
+}
+
 uint64_t aos_app_session::getDMAReadSize() const {
   return dma_read_valid_bytes;
 }
 
+void aos_app_session::setShadowRanges(std::vector<cntrlreg_range_t> ranges) {
+    shadow_ranges = ranges;
+}
+
+void aos_app_session::recordCntrlRegWrite(uint64_t addr, uint64_t value) {
+    shadow_cntrlregs[addr] = value;
+}
+
+bool aos_app_session::readShadowCntrlReg(uint64_t addr, uint64_t & value) const {
+    bool non_volatile = false;
+    for (auto & range : shadow_ranges) {
+        if ((addr >= range.first) && ((addr - range.first) < range.second)) {
+            non_volatile = true;
+            break;
+        }
+    }
+    if (!non_volatile) {
+        return false;
+    }
+    // Never written, the FPGA has to be asked
+    auto shadow_it = shadow_cntrlregs.find(addr);
+    if (shadow_it == shadow_cntrlregs.end()) {
+        return false;
+    }
+    value = shadow_it->second;
+    return true;
+}
+
+const std::map<uint64_t, uint64_t> & aos_app_session::getShadowCntrlRegs() const {
+    return shadow_cntrlregs;
+}
+
+void aos_app_session::markDRAMDirty(uint64_t addr, uint64_t num_bytes) {
+    if (num_bytes == 0) {
+        return;
+    }
+    const uint64_t last_page = (addr + num_bytes - 1) / DRAM_PAGE_BYTES;
+    for (uint64_t page = addr / DRAM_PAGE_BYTES; page <= last_page; page++) {
+        dram_dirty_pages.insert(page * DRAM_PAGE_BYTES);
+    }
+}
+
+bool aos_app_session::isDRAMPageDirty(uint64_t page_addr) const {
+    return (dram_dirty_pages.find(page_addr) != dram_dirty_pages.end());
+}
+
+const std::set<uint64_t> & aos_app_session::getDirtyDRAMPages() const {
+    return dram_dirty_pages;
+}
+
+std::map<uint64_t, uint64_t> & aos_app_session::getSavedCntrlRegs() {
+    return saved_cntrlregs;
+}
+
+std::map<uint64_t, std::vector<char>> & aos_app_session::getSavedDRAM() {
+    return saved_dram;
+}
+
+// A partial copy is worse than none, the session starts over as if it was never saved
+void aos_app_session::dropSavedState() {
+    dram_dirty_pages.clear();
+    saved_cntrlregs.clear();
+    saved_dram.clear();
+    saved_state = false;
+}
+
+// The host copy is now current, the slot's registers wait for restore
+void aos_app_session::recordStateSave(uint64_t save_ns, uint64_t num_bytes, uint64_t skipped_bytes) {
+    dram_dirty_pages.clear();
+    saved_state = true;
+    preemption_stats.num_saves++;
+    preemption_stats.total_save_ns += save_ns;
+    preemption_stats.last_save_ns   = save_ns;
+    preemption_stats.saved_bytes   += num_bytes;
+    preemption_stats.skipped_bytes += skipped_bytes;
+}
+
+// The slot holds the state again, the DRAM copy stays for the next save
+void aos_app_session::markStateResident() {
+    saved_cntrlregs.clear();
+    saved_state = false;
+}
+
+void aos_app_session::recordStateRestore(uint64_t restore_ns, uint64_t restored_bytes, uint64_t resident_bytes) {
+    markStateResident();
+    preemption_stats.num_restores++;
+    preemption_stats.total_restore_ns += restore_ns;
+    preemption_stats.last_restore_ns   = restore_ns;
+    preemption_stats.restored_bytes   += restored_bytes;
+    preemption_stats.resident_bytes   += resident_bytes;
+}
+
+uint64_t aos_app_session::getLastSaveTime() const {
+    return preemption_stats.last_save_ns;
+}
+
+uint64_t aos_app_session::getLastRestoreTime() const {
+    return preemption_stats.last_restore_ns;
+}
+
+uint64_t aos_app_session::getSavedDRAMBytes() const {
+    return (saved_dram.size() * DRAM_PAGE_BYTES);
+}
+
+const aos_preemption_stats & aos_app_session::getPreemptionStats() const {
+    return preemption_stats;
+}
+
+void aos_app_session::addResidentDRAMPages(uint64_t fpga_id, uint64_t slot_id, int64_t num_pages) {
+    const std::pair<uint64_t, uint64_t> partition(fpga_id, slot_id);
+    const int64_t pages = (int64_t)resident_dram_pages[partition] + num_pages;
+    if (pages <= 0) {
+        resident_dram_pages.erase(partition);
+    } else {
+        resident_dram_pages[partition] = (uint64_t)pages;
+    }
+}
+
+// The FPGA was reflashed, none of its partitions hold the session's data any more
+void aos_app_session::dropResidentDRAM(uint64_t fpga_id) {
+    auto partition_it = resident_dram_pages.lower_bound(std::make_pair(fpga_id, (uint64_t)0));
+    while ((partition_it != resident_dram_pages.end()) && (partition_it->first.first == fpga_id)) {
+        partition_it = resident_dram_pages.erase(partition_it);
+    }
+}
+
+const std::map<std::pair<uint64_t, uint64_t>, uint64_t> & aos_app_session::getResidentDRAMPages() const {
+    return resident_dram_pages;
+}
+
+int aos_app_session::getCompletionEventFd() {
+    if (completion_eventfd == -1) {
+        completion_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (completion_eventfd == -1) {
+            perror("Unable to create completion eventfd");
+        }
+    }
+    return completion_eventfd;
+}
+
+void aos_app_session::signalCompletion() {
+    // Nobody has asked to be notified
+    if (completion_eventfd == -1) {
+        return;
+    }
+    uint64_t count = 1;
+    if (write(completion_eventfd, &count, sizeof(uint64_t)) == -1) {
+        perror("Unable to signal completion eventfd");
+    }
+}
@@ -0,0 +1,394 @@
+#include "aos_daemon.h"
+#include <fstream>
+#include <sstream>
+
+/*
+    Daemon benchmark. Runs the daemon on the simulated backend in this
+    process and drives it over its socket from num_clients client threads,
+    the same way separate client processes would:
+
+    - cntrlreg: every client binds a session and alternates CntrlReg
+      writes and reads, giving ops/s and per op latency
+    - bulk:     every client writes and reads back each transfer size,
+      giving the latency until the data is in or out of DRAM and MB/s
+    - sessions: open a session, issue the op that binds it and close it,
+      giving sessions/s and the open and bind latencies
+
+    The daemon's own scheduling stage percentiles over the whole run are
+    reported next to them. The results go to stdout and, with --json, to
+    a file that later runs can be compared against.
+*/
+
+struct bench_config {
+    uint64_t num_fpga;
+    std::string images_json;
+    std::string app_id;
+    uint64_t num_clients;
+    uint64_t num_ops;          // CntrlReg ops per client
+    uint64_t num_sessions;     // sessions opened and closed per client
+    uint64_t num_transfers;    // bulk writes and reads per client and size
+    std::vector<uint64_t> transfer_sizes;
+    std::string json_file;
+};
+
+// Releases the client threads of a phase together and times the phase from then on
+class bench_start_line {
+public:
+
+    bench_start_line(uint64_t num_clients) :
+        num_waiting(num_clients),
+        start_ns(0)
+    {}
+
+    void wait() {
+        if (num_waiting.fetch_sub(1) == 1) {
+            start_ns = monotonic_ns();
+            go = true;
+        }
+        while (!go) {
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t getStartNs() const {
+        return start_ns;
+    }
+
+private:
+
+    std::atomic<uint64_t> num_waiting;
+    std::atomic<bool> go{false};
+    std::atomic<uint64_t> start_ns;
+
+};
+
+static json latencyJson(const aos_latency_histogram & histogram) {
+    json entry;
+    const uint64_t count = histogram.getCount();
+    entry["count"]   = count;
+    entry["mean_ns"] = (count == 0) ? 0 : histogram.getTotal() / count;
+    entry["p50_ns"]  = histogram.getPercentile(0.50);
+    entry["p90_ns"]  = histogram.getPercentile(0.90);
+    entry["p99_ns"]  = histogram.getPercentile(0.99);
+    entry["p999_ns"] = histogram.getPercentile(0.999);
+    entry["max_ns"]  = histogram.getMax();
+    return entry;
+}
+
+static void printLatency(const std::string & name, const aos_latency_histogram & histogram) {
+    const uint64_t count = histogram.getCount();
+    printf("  %-24s mean %10lu  p50 %10lu  p99 %10lu  max %10lu ns\n", name.c_str(),
+           (count == 0) ? 0 : histogram.getTotal() / count, histogram.getPercentile(0.50),
+           histogram.getPercentile(0.99), histogram.getMax());
+}
+
+// Runs body(client_idx, start_line) on every client and returns the wall time of the phase
+static uint64_t runClients(uint64_t num_clients, const std::function<void(uint64_t, bench_start_line &)> & body) {
+    bench_start_line start_line(num_clients);
+    std::vector<std::thread> clients;
+    for (uint64_t client_idx = 0; client_idx < num_clients; client_idx++) {
+        clients.push_back(std::thread(body, client_idx, std::ref(start_line)));
+    }
+    for (auto & client : clients) {
+        client.join();
+    }
+    return monotonic_ns() - start_line.getStartNs();
+}
+
+static json benchCntrlReg(const bench_config & cfg) {
+    aos_latency_histogram write_latency;
+    aos_latency_histogram read_latency;
+    std::atomic<uint64_t> num_errors(0);
+
+    const uint64_t wall_ns = runClients(cfg.num_clients, [&](uint64_t client_idx, bench_start_line & start_line) {
+        aos_client client(cfg.app_id);
+        client.aos_init_session();
+        // Bound before the clock starts
+        if (client.aos_cntrlreg_write(0x0, client_idx) != aos_errcode::SUCCESS) {
+            num_errors++;
+        }
+        start_line.wait();
+        for (uint64_t op_idx = 0; op_idx < cfg.num_ops; op_idx += 2) {
+            const uint64_t addr = (op_idx % 64) * 8;
+            uint64_t value = 0;
+            uint64_t start_ns = monotonic_ns();
+            if (client.aos_cntrlreg_write(addr, op_idx) != aos_errcode::SUCCESS) {
+                num_errors++;
+            }
+            const uint64_t mid_ns = monotonic_ns();
+            write_latency.record(mid_ns - start_ns);
+            if (client.aos_cntrlreg_read(addr, value) != aos_errcode::SUCCESS) {
+                num_errors++;
+            }
+            read_latency.record(monotonic_ns() - mid_ns);
+        }
+        client.aos_end_session();
+    });
+
+    const uint64_t num_ops = write_latency.getCount() + read_latency.getCount();
+    const double ops_per_s = (double)num_ops * 1e9 / (double)std::max((uint64_t)1, wall_ns);
+    printf("CntrlReg: %lu ops in %.3f s, %.0f ops/s, %lu errors\n", num_ops, (double)wall_ns / 1e9, ops_per_s, (uint64_t)num_errors);
+    printLatency("write", write_latency);
+    printLatency("read", read_latency);
+
+    json result;
+    result["num_ops"]   = num_ops;
+    result["wall_ns"]   = wall_ns;
+    result["ops_per_s"] = ops_per_s;
+    result["errors"]    = (uint64_t)num_errors;
+    result["write"]     = latencyJson(write_latency);
+    result["read"]      = latencyJson(read_latency);
+    return result;
+}
+
+// MB/s of one transfer of num_bytes at the histogram's mean latency
+static double getMBPerSecond(uint64_t num_bytes, const aos_latency_histogram & histogram) {
+    const double mean_ns = (double)histogram.getTotal() / (double)std::max((uint64_t)1, histogram.getCount());
+    return (double)num_bytes * 1e3 / std::max(1.0, mean_ns);
+}
+
+/*
+    Every client binds a session and then writes and reads back the same
+    bytes. The daemon has no completion notice for a write, so a write is
+    timed until a one byte read behind it returns: transfers of a session
+    are issued in order, the read cannot come back before the write is in
+    DRAM. A read is timed until its payload has arrived.
+*/
+static json benchBulk(const bench_config & cfg) {
+    json results = json::array();
+    printf("Bulk:\n");
+
+    for (uint64_t transfer_size : cfg.transfer_sizes) {
+        aos_latency_histogram write_latency;
+        aos_latency_histogram read_latency;
+        std::atomic<uint64_t> num_errors(0);
+
+        const uint64_t wall_ns = runClients(cfg.num_clients, [&](uint64_t client_idx, bench_start_line & start_line) {
+            std::vector<char> payload(transfer_size, (char)client_idx);
+            std::vector<char> read_back(transfer_size);
+            aos_client client(cfg.app_id);
+            client.aos_init_session();
+            // Bound before the clock starts
+            if (client.aos_cntrlreg_write(0x0, client_idx) != aos_errcode::SUCCESS) {
+                num_errors++;
+            }
+            start_line.wait();
+            for (uint64_t transfer_idx = 0; transfer_idx < cfg.num_transfers; transfer_idx++) {
+                char last_byte = 0;
+                uint64_t start_ns = monotonic_ns();
+                if ((client.aos_bulkdata_write(0, transfer_size, payload.data()) != aos_errcode::SUCCESS) ||
+                    (client.aos_bulkdata_read(transfer_size - 1, 1, &last_byte) != aos_errcode::SUCCESS)) {
+                    num_errors++;
+                }
+                const uint64_t mid_ns = monotonic_ns();
+                write_latency.record(mid_ns - start_ns);
+                if (client.aos_bulkdata_read(0, transfer_size, read_back.data()) != aos_errcode::SUCCESS) {
+                    num_errors++;
+                }
+                read_latency.record(monotonic_ns() - mid_ns);
+                if ((last_byte != (char)client_idx) || (read_back != payload)) {
+                    num_errors++;
+                }
+            }
+            client.aos_end_session();
+        });
+
+        const double write_mb_per_s = getMBPerSecond(transfer_size, write_latency);
+        const double read_mb_per_s  = getMBPerSecond(transfer_size, read_latency);
+        printf("  %10lu bytes: write %8.1f MB/s, read %8.1f MB/s per client, %lu transfers in %.3f s, %lu errors\n",
+               transfer_size, write_mb_per_s, read_mb_per_s, write_latency.getCount(), (double)wall_ns / 1e9, (uint64_t)num_errors);
+
+        json result;
+        result["bytes"]          = transfer_size;
+        result["num_transfers"]  = write_latency.getCount();
+        result["wall_ns"]        = wall_ns;
+        result["errors"]         = (uint64_t)num_errors;
+        result["write_mb_per_s"] = write_mb_per_s;
+        result["read_mb_per_s"]  = read_mb_per_s;
+        result["write"]          = latencyJson(write_latency);
+        result["read"]           = latencyJson(read_latency);
+        results.push_back(result);
+    }
+    return results;
+}
+
+static json benchSessions(const bench_config & cfg) {
+    aos_latency_histogram open_latency;
+    aos_latency_histogram bind_latency;
+    std::atomic<uint64_t> num_errors(0);
+
+    const uint64_t wall_ns = runClients(cfg.num_clients, [&](uint64_t client_idx, bench_start_line & start_line) {
+        start_line.wait();
+        for (uint64_t session_idx = 0; session_idx < cfg.num_sessions; session_idx++) {
+            aos_client client(cfg.app_id);
+            uint64_t start_ns = monotonic_ns();
+            client.aos_init_session();
+            const uint64_t open_ns = monotonic_ns();
+            open_latency.record(open_ns - start_ns);
+            // The first op is the one that waits for a slot
+            if (client.aos_cntrlreg_write(0x0, session_idx) != aos_errcode::SUCCESS) {
+                num_errors++;
+            }
+            bind_latency.record(monotonic_ns() - open_ns);
+            client.aos_end_session();
+        }
+    });
+
+    const uint64_t num_sessions = open_latency.getCount();
+    const double sessions_per_s = (double)num_sessions * 1e9 / (double)std::max((uint64_t)1, wall_ns);
+    printf("Sessions: %lu in %.3f s, %.0f sessions/s, %lu errors\n", num_sessions, (double)wall_ns / 1e9, sessions_per_s, (uint64_t)num_errors);
+    printLatency("open", open_latency);
+    printLatency("open to bound", bind_latency);
+
+    json result;
+    result["num_sessions"]   = num_sessions;
+    result["wall_ns"]        = wall_ns;
+    result["sessions_per_s"] = sessions_per_s;
+    result["errors"]         = (uint64_t)num_errors;
+    result["open"]           = latencyJson(open_latency);
+    result["bind"]           = latencyJson(bind_latency);
+    return result;
+}
+
+static bool parseSizes(const std::string & list, std::vector<uint64_t> & sizes) {
+    sizes.clear();
+    std::istringstream fields(list);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        const uint64_t size = std::stoull(field);
+        if (size == 0) {
+            return false;
+        }
+        sizes.push_back(size);
+    }
+    return !sizes.empty();
+}
+
+static void usage() {
+    printf("Usage: ./aos_bench <num_fpga> <fpga_images_json> [options]\n"
+           "  --clients <n>                client threads (default 4)\n"
+           "  --app <app_id>               app the clients open sessions for (default slot 0 of the first image)\n"
+           "  --ops <n>                    CntrlReg ops per client (default 20000)\n"
+           "  --sessions <n>               sessions opened and closed per client (default 500)\n"
+           "  --transfers <n>              bulk writes and reads per client and size (default 16)\n"
+           "  --sizes <bytes,...>          bulk transfer sizes (default 4096,65536,1048576,16777216)\n"
+           "  --json <file>                also write the results as JSON\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 3) {
+        usage();
+        exit(EXIT_SUCCESS);
+    }
+
+    bench_config cfg;
+    cfg.num_fpga       = std::stoull(argv[1]);
+    cfg.images_json    = argv[2];
+    cfg.num_clients    = 4;
+    cfg.num_ops        = 20000;
+    cfg.num_sessions   = 500;
+    cfg.num_transfers  = 16;
+    cfg.transfer_sizes = {4096, 65536, 1048576, 16777216};
+
+    for (int arg_idx = 3; arg_idx < argc; arg_idx++) {
+        const std::string arg = argv[arg_idx];
+        if (arg_idx + 1 >= argc) {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        const std::string value = argv[++arg_idx];
+        if (arg == "--clients") {
+            cfg.num_clients = std::max((uint64_t)1, (uint64_t)std::stoull(value));
+        } else if (arg == "--app") {
+            cfg.app_id = value;
+        } else if (arg == "--ops") {
+            cfg.num_ops = std::stoull(value);
+        } else if (arg == "--sessions") {
+            cfg.num_sessions = std::stoull(value);
+        } else if (arg == "--transfers") {
+            cfg.num_transfers = std::stoull(value);
+        } else if (arg == "--sizes") {
+            if (!parseSizes(value, cfg.transfer_sizes)) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--json") {
+            cfg.json_file = value;
+        } else {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (cfg.app_id.empty()) {
+        aos_scheduler library(1);
+        library.parseImages(cfg.images_json);
+        cfg.app_id = library.getSlotAppIdMap((uint32_t)0)[0];
+    }
+
+    // Clients always connect to SOCKET_NAME, so the bench cannot run next to a daemon serving it
+    if (isSocketListening(SOCKET_NAME)) {
+        printf("A daemon is listening on %s, stop it before running the benchmark\n", SOCKET_NAME);
+        exit(EXIT_FAILURE);
+    }
+
+    // Keep the daemon's log out of the measurements
+    setLogLevel(LEVEL_WARN);
+
+    // Loads are instant, the benchmark is about the daemon and not the FPGA
+    aos_host host(cfg.num_fpga, false, true);
+    host.parseImagesJson(cfg.images_json);
+    host.setSimulatedLoadLatency(0);
+    for (uint64_t fpga_id = 0; fpga_id < cfg.num_fpga; fpga_id++) {
+        host.loadDefaultImage(fpga_id);
+    }
+    // Left behind by a daemon that is gone
+    unlink(SOCKET_NAME);
+    host.init_socket();
+    std::thread daemon(&aos_host::listen_loop, &host);
+    daemon.detach();
+
+    printf("%lu clients of %s on %lu simulated FPGAs\n", cfg.num_clients, cfg.app_id.c_str(), cfg.num_fpga);
+
+    json results;
+    results["num_fpga"]    = cfg.num_fpga;
+    results["num_clients"] = cfg.num_clients;
+    results["app_id"]      = cfg.app_id;
+    results["cntrlreg"]    = benchCntrlReg(cfg);
+    results["bulk"]        = benchBulk(cfg);
+    results["sessions"]    = benchSessions(cfg);
+
+    // How long the daemon spent finding sessions a slot, per command, over the whole run
+    results["scheduling"] = json::array();
+    printf("Scheduling:\n");
+    // Asked over the socket, the daemon may still be closing the last sessions
+    aos_client observer("aos_bench");
+    std::string stats_json;
+    if (observer.aos_get_stats(stats_json) != aos_errcode::SUCCESS) {
+        printf("Unable to get stats from the daemon\n");
+        exit(EXIT_FAILURE);
+    }
+    const json stats = json::parse(stats_json);
+    for (auto & entry : stats["latency"]) {
+        if (entry["stage"] != "scheduling") {
+            continue;
+        }
+        results["scheduling"].push_back(entry);
+        printf("  %-24s mean %10lu  p50 %10lu  p99 %10lu  max %10lu ns\n", entry["command"].get<std::string>().c_str(),
+               entry["mean_ns"].get<uint64_t>(), entry["p50_ns"].get<uint64_t>(), entry["p99_ns"].get<uint64_t>(), entry["max_ns"].get<uint64_t>());
+    }
+
+    if (!cfg.json_file.empty()) {
+        std::ofstream json_out(cfg.json_file);
+        json_out << results.dump(4) << std::endl;
+        if (!json_out) {
+            printf("Unable to write %s\n", cfg.json_file.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    flushLog();
+    exit(EXIT_SUCCESS);
+
+}
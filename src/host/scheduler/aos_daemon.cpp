@@ -2,13 +2,40 @@
 
 int main(int argc, char *argv[]) {
 
-    if (argc != 3) {
-        printf("Usage: ./aos_host_sched <num_fpga> <fpga_images_json>");
+    const char * usage = "Usage: ./aos_host_sched <num_fpga> <fpga_images_json> [--simulate] [--slot-policy <policy>] [--fpga-policy <policy>]\n"
+                         "                      [--metrics <socket_path | port> | --no-metrics]\n"
+                         "  policies are lru, least_load or least_recent_bytes (defaults lru and least_load)\n"
+                         "  metrics are served in the Prometheus text format, on " DEFAULT_METRICS_SOCKET " by default\n";
+    if (argc < 3) {
+        printf("%s", usage);
         exit(EXIT_SUCCESS);
     }
 
     uint64_t num_fpga = std::stoull(argv[1]);
     std::string jsonFile = argv[2];
+    // Run the scheduler against in memory FPGAs
+    bool simulate = false;
+    EVICTION_POLICY slot_policy = EVICTION_POLICY::LRU;
+    EVICTION_POLICY fpga_policy = EVICTION_POLICY::LEAST_LOAD;
+    // Unix socket path or a TCP port on 127.0.0.1, empty for no exporter
+    std::string metrics_endpoint = DEFAULT_METRICS_SOCKET;
+    for (int arg_idx = 3; arg_idx < argc; arg_idx++) {
+        const std::string arg = argv[arg_idx];
+        if (arg == "--simulate") {
+            simulate = true;
+        } else if ((arg == "--slot-policy") && (arg_idx + 1 < argc) && parseEvictionPolicy(argv[arg_idx + 1], slot_policy)) {
+            arg_idx++;
+        } else if ((arg == "--fpga-policy") && (arg_idx + 1 < argc) && parseEvictionPolicy(argv[arg_idx + 1], fpga_policy)) {
+            arg_idx++;
+        } else if ((arg == "--metrics") && (arg_idx + 1 < argc)) {
+            metrics_endpoint = argv[++arg_idx];
+        } else if (arg == "--no-metrics") {
+            metrics_endpoint.clear();
+        } else {
+            printf("%s", usage);
+            exit(EXIT_FAILURE);
+        }
+    }
 
     bool initFPGA = true;
 
@@ -50,9 +77,10 @@ int main(int argc, char *argv[]) {
     }
     
     // Intialize control over the FPGA
-    aos_host fpga_handle = aos_host(num_fpga, !initFPGA);
+    aos_host fpga_handle(num_fpga, !initFPGA, simulate);
 
     fpga_handle.parseImagesJson(jsonFile);
+    fpga_handle.setEvictionPolicies(slot_policy, fpga_policy);
 
     if (initFPGA) {
         for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
@@ -62,6 +90,11 @@ int main(int argc, char *argv[]) {
 
     fpga_handle.init_socket();
 
+    if (!metrics_endpoint.empty() && (fpga_handle.startMetricsExporter(metrics_endpoint) != 0)) {
+        printf("Error - Unable to start the metrics exporter on %s\n", metrics_endpoint.c_str());
+        exit(EXIT_FAILURE);
+    }
+
     // Main loop
     fpga_handle.listen_loop();
 
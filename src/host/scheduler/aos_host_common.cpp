@@ -14,5 +14,622 @@ std::string cmd_exec(std::string cmd) {
 }
 
 void printErrorHost(std::string errStr) {
-    std::cout << errStr << std::endl;
+    AOS_LOG_ERROR(errStr);
+}
+
+/*
+    Connecting to find out would be answered by the daemon, which takes
+    every connection for a request.
+*/
+bool isSocketListening(const char * path) {
+    std::ifstream unix_sockets("/proc/net/unix");
+    std::string line;
+    // Header
+    std::getline(unix_sockets, line);
+    while (std::getline(unix_sockets, line)) {
+        std::istringstream fields(line);
+        std::string num, ref_count, protocol, flags, type, state, inode, socket_path;
+        fields >> num >> ref_count >> protocol >> flags >> type >> state >> inode >> socket_path;
+        // __SO_ACCEPTCON, the socket is listening
+        if ((socket_path == path) && (flags == "00010000")) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static const uint64_t * virtual_clock_ns = nullptr;
+
+void setVirtualClock(const uint64_t * clock_ns) {
+    virtual_clock_ns = clock_ns;
+}
+
+uint64_t monotonic_ns() {
+    if (virtual_clock_ns != nullptr) {
+        return *virtual_clock_ns;
+    }
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+aos_access_stats::aos_access_stats() {
+    reset(monotonic_ns());
+}
+
+void aos_access_stats::reset(uint64_t now_ns) {
+    last_access_ns    = now_ns;
+    num_ops           = 0;
+    total_bytes       = 0;
+    window_start_ns   = now_ns;
+    window_bytes      = 0;
+    prev_window_bytes = 0;
+}
+
+void aos_access_stats::recordAccess(uint64_t now_ns, uint64_t num_bytes) {
+    // Roll the windows forward, anything older than the previous window is forgotten
+    if ((now_ns - window_start_ns) >= ACCESS_STATS_WINDOW_NS) {
+        prev_window_bytes = ((now_ns - window_start_ns) >= (2 * ACCESS_STATS_WINDOW_NS)) ? 0 : window_bytes;
+        window_bytes      = 0;
+        window_start_ns   = now_ns;
+    }
+    last_access_ns = now_ns;
+    num_ops++;
+    total_bytes  += num_bytes;
+    window_bytes += num_bytes;
+}
+
+uint64_t aos_access_stats::getRecentBytes(uint64_t now_ns) const {
+    const uint64_t age_ns = now_ns - window_start_ns;
+    if (age_ns >= (2 * ACCESS_STATS_WINDOW_NS)) {
+        return 0;
+    }
+    if (age_ns >= ACCESS_STATS_WINDOW_NS) {
+        return window_bytes;
+    }
+    return window_bytes + prev_window_bytes;
+}
+
+aos_latency_histogram::aos_latency_histogram() {
+    for (uint32_t bucket_idx = 0; bucket_idx < LATENCY_NUM_BUCKETS; bucket_idx++) {
+        buckets[bucket_idx].store(0, std::memory_order_relaxed);
+    }
+    num_samples.store(0, std::memory_order_relaxed);
+    total_ns.store(0, std::memory_order_relaxed);
+    max_ns.store(0, std::memory_order_relaxed);
+}
+
+void aos_latency_histogram::record(uint64_t value_ns) {
+    buckets[getBucketIdx(value_ns)].fetch_add(1, std::memory_order_relaxed);
+    num_samples.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(value_ns, std::memory_order_relaxed);
+    uint64_t prev_max_ns = max_ns.load(std::memory_order_relaxed);
+    while ((value_ns > prev_max_ns) && !max_ns.compare_exchange_weak(prev_max_ns, value_ns, std::memory_order_relaxed)) {
+    }
+}
+
+uint64_t aos_latency_histogram::getCount() const {
+    return num_samples.load(std::memory_order_relaxed);
+}
+
+uint64_t aos_latency_histogram::getTotal() const {
+    return total_ns.load(std::memory_order_relaxed);
+}
+
+uint64_t aos_latency_histogram::getMax() const {
+    return max_ns.load(std::memory_order_relaxed);
+}
+
+uint64_t aos_latency_histogram::getPercentile(double fraction) const {
+    const uint64_t count = getCount();
+    if (count == 0) {
+        return 0;
+    }
+    // Rank of the sample, 1 based
+    uint64_t rank = (uint64_t)(fraction * (double)count + 0.5);
+    rank = std::max((uint64_t)1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (uint32_t bucket_idx = 0; bucket_idx < LATENCY_NUM_BUCKETS; bucket_idx++) {
+        seen += buckets[bucket_idx].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return std::min(getBucketUpperBound(bucket_idx), getMax());
+        }
+    }
+    return getMax();
+}
+
+/*
+    Values below 2^LATENCY_SUB_BUCKET_BITS are their own bucket. Above, the
+    most significant bit picks the group and the next
+    LATENCY_SUB_BUCKET_BITS bits the bucket within it.
+*/
+uint32_t aos_latency_histogram::getBucketIdx(uint64_t value_ns) {
+    const uint64_t sub_buckets = (1ULL << LATENCY_SUB_BUCKET_BITS);
+    if (value_ns < sub_buckets) {
+        return (uint32_t)value_ns;
+    }
+    const uint32_t msb = 63 - __builtin_clzll(value_ns);
+    const uint32_t shift = msb - LATENCY_SUB_BUCKET_BITS;
+    return (uint32_t)(((shift + 1) << LATENCY_SUB_BUCKET_BITS) + ((value_ns >> shift) - sub_buckets));
+}
+
+uint64_t aos_latency_histogram::getBucketUpperBound(uint32_t bucket_idx) {
+    const uint64_t sub_buckets = (1ULL << LATENCY_SUB_BUCKET_BITS);
+    if (bucket_idx < sub_buckets) {
+        return bucket_idx;
+    }
+    const uint32_t shift = (bucket_idx >> LATENCY_SUB_BUCKET_BITS) - 1;
+    const uint64_t lower = ((bucket_idx & (sub_buckets - 1)) + sub_buckets) << shift;
+    return lower + ((1ULL << shift) - 1);
+}
+
+const char * getLatencyStageName(LATENCY_STAGE stage) {
+    switch (stage) {
+        case STAGE_RECEIVE : return "receive";
+        case STAGE_SCHEDULING : return "scheduling";
+        case STAGE_MMIO : return "mmio";
+        case STAGE_DMA : return "dma";
+        case STAGE_RESPONSE : return "response";
+        default : return "unknown";
+    }
+}
+
+aos_latency_timer::aos_latency_timer(aos_latency_histogram * histogram) :
+    histogram(histogram),
+    start_ns((histogram == nullptr) ? 0 : monotonic_ns())
+{
+}
+
+aos_latency_timer::~aos_latency_timer() {
+    if (histogram != nullptr) {
+        histogram->record(monotonic_ns() - start_ns);
+    }
+}
+
+// Free counter slot indices, only taken on a thread's first add and when it exits
+static std::mutex metric_thread_mutex;
+static std::vector<uint32_t> free_metric_slots;
+static uint32_t next_metric_slot = 0;
+
+struct aos_metric_thread {
+    uint32_t slot_idx;
+    bool assigned;
+
+    aos_metric_thread() : slot_idx(0), assigned(false) {}
+
+    ~aos_metric_thread() {
+        if (assigned && (slot_idx < METRIC_MAX_THREADS - 1)) {
+            std::lock_guard<std::mutex> lock(metric_thread_mutex);
+            free_metric_slots.push_back(slot_idx);
+        }
+    }
+};
+
+static thread_local aos_metric_thread metric_thread;
+
+static uint32_t getMetricSlotIdx() {
+    if (!metric_thread.assigned) {
+        std::lock_guard<std::mutex> lock(metric_thread_mutex);
+        if (!free_metric_slots.empty()) {
+            metric_thread.slot_idx = free_metric_slots.back();
+            free_metric_slots.pop_back();
+        } else {
+            metric_thread.slot_idx = std::min(next_metric_slot, (uint32_t)(METRIC_MAX_THREADS - 1));
+            if (next_metric_slot < METRIC_MAX_THREADS - 1) {
+                next_metric_slot++;
+            }
+        }
+        metric_thread.assigned = true;
+    }
+    return metric_thread.slot_idx;
+}
+
+aos_metric_counter::aos_metric_counter() {
+    slots = (aos_metric_slot *)aligned_alloc(CACHE_LINE_BYTES, sizeof(aos_metric_slot) * METRIC_MAX_THREADS);
+    if (slots == nullptr) {
+        throw std::bad_alloc();
+    }
+    for (uint32_t slot_idx = 0; slot_idx < METRIC_MAX_THREADS; slot_idx++) {
+        new (&slots[slot_idx].value) std::atomic<uint64_t>(0);
+    }
+}
+
+aos_metric_counter::~aos_metric_counter() {
+    free(slots);
+}
+
+void aos_metric_counter::add(uint64_t value) {
+    slots[getMetricSlotIdx()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t aos_metric_counter::get() const {
+    uint64_t total = 0;
+    for (uint32_t slot_idx = 0; slot_idx < METRIC_MAX_THREADS; slot_idx++) {
+        total += slots[slot_idx].value.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+struct aos_trace_event {
+    const char * name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t session_id;
+    uint64_t fpga_id;
+    uint64_t slot_id;
+    uint32_t tid;
+};
+
+// One writer, its thread. Readers copy and drop whatever the writer lapped meanwhile.
+struct aos_trace_ring {
+    std::atomic<uint64_t> head;
+    std::atomic<bool> in_use;
+    aos_trace_event events[TRACE_RING_EVENTS];
+};
+
+static std::atomic<bool> tracing_enabled(true);
+// Only taken when a thread records its first span, names itself or a dump collects the rings
+static std::mutex trace_registry_mutex;
+static std::vector<aos_trace_ring *> trace_rings;
+static std::map<uint32_t, std::string> trace_thread_names;
+static uint32_t next_trace_tid = 1;
+
+// A thread's ring goes back to the pool when the thread exits, reconfiguration workers come and go
+struct aos_trace_thread {
+    aos_trace_ring * ring;
+    uint32_t tid;
+
+    aos_trace_thread() : ring(nullptr), tid(0) {}
+
+    ~aos_trace_thread() {
+        if (ring != nullptr) {
+            ring->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+
+static thread_local aos_trace_thread trace_thread;
+
+static aos_trace_thread & getTraceThread() {
+    if (trace_thread.ring == nullptr) {
+        std::lock_guard<std::mutex> lock(trace_registry_mutex);
+        for (auto & ring : trace_rings) {
+            if (!ring->in_use.load(std::memory_order_acquire)) {
+                trace_thread.ring = ring;
+                break;
+            }
+        }
+        if (trace_thread.ring == nullptr) {
+            trace_thread.ring = new aos_trace_ring();
+            trace_thread.ring->head.store(0, std::memory_order_relaxed);
+            trace_rings.push_back(trace_thread.ring);
+        }
+        trace_thread.ring->in_use.store(true, std::memory_order_relaxed);
+        trace_thread.tid = next_trace_tid++;
+    }
+    return trace_thread;
+}
+
+void setTracing(bool enabled) {
+    tracing_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool isTracing() {
+    return tracing_enabled.load(std::memory_order_relaxed);
+}
+
+void setTraceThreadName(std::string name) {
+    const uint32_t tid = getTraceThread().tid;
+    std::lock_guard<std::mutex> lock(trace_registry_mutex);
+    trace_thread_names[tid] = name;
+}
+
+aos_trace_span::aos_trace_span(const char * name, uint64_t session_id, uint64_t fpga_id, uint64_t slot_id) :
+    name(name),
+    session_id(session_id),
+    fpga_id(fpga_id),
+    slot_id(slot_id),
+    recording(isTracing()),
+    start_ns(recording ? monotonic_ns() : 0)
+{
+}
+
+aos_trace_span::~aos_trace_span() {
+    if (!recording) {
+        return;
+    }
+    aos_trace_thread & thread = getTraceThread();
+    aos_trace_ring * ring = thread.ring;
+    const uint64_t idx = ring->head.load(std::memory_order_relaxed);
+    aos_trace_event & event = ring->events[idx % TRACE_RING_EVENTS];
+    event.name        = name;
+    event.start_ns    = start_ns;
+    event.duration_ns = monotonic_ns() - start_ns;
+    event.session_id  = session_id;
+    event.fpga_id     = fpga_id;
+    event.slot_id     = slot_id;
+    event.tid         = thread.tid;
+    ring->head.store(idx + 1, std::memory_order_release);
+}
+
+void aos_trace_span::setSession(uint64_t session_id_) {
+    session_id = session_id_;
+}
+
+void aos_trace_span::setSlot(uint64_t fpga_id_, uint64_t slot_id_) {
+    fpga_id = fpga_id_;
+    slot_id = slot_id_;
+}
+
+/*
+    Complete ("X") events, timestamps in microseconds as the format wants,
+    plus a thread_name record for every named thread. Rings are read while
+    their threads keep recording, a span the writer overwrote during the
+    copy is left out.
+*/
+void dumpTrace(std::ostream & out) {
+    std::vector<aos_trace_ring *> rings;
+    std::map<uint32_t, std::string> thread_names;
+    {
+        std::lock_guard<std::mutex> lock(trace_registry_mutex);
+        rings = trace_rings;
+        thread_names = trace_thread_names;
+    }
+    const int pid = getpid();
+
+    json trace_events = json::array();
+    for (auto & thread_name : thread_names) {
+        json entry;
+        entry["name"] = "thread_name";
+        entry["ph"]   = "M";
+        entry["pid"]  = pid;
+        entry["tid"]  = thread_name.first;
+        entry["args"]["name"] = thread_name.second;
+        trace_events.push_back(entry);
+    }
+    std::vector<aos_trace_event> events;
+    for (auto & ring : rings) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first = (head > TRACE_RING_EVENTS) ? (head - TRACE_RING_EVENTS) : 0;
+        events.clear();
+        for (uint64_t idx = first; idx < head; idx++) {
+            events.push_back(ring->events[idx % TRACE_RING_EVENTS]);
+        }
+        const uint64_t new_head = ring->head.load(std::memory_order_acquire);
+        const uint64_t first_intact = (new_head > TRACE_RING_EVENTS) ? (new_head - TRACE_RING_EVENTS) : 0;
+        for (uint64_t idx = std::max(first, first_intact); idx < head; idx++) {
+            const aos_trace_event & event = events[idx - first];
+            json entry;
+            entry["name"] = event.name;
+            entry["cat"]  = "aos";
+            entry["ph"]   = "X";
+            entry["ts"]   = (double)event.start_ns / 1000.0;
+            entry["dur"]  = (double)event.duration_ns / 1000.0;
+            entry["pid"]  = pid;
+            entry["tid"]  = event.tid;
+            entry["args"] = json::object();
+            if (event.session_id != TRACE_NO_ID) {
+                entry["args"]["session"] = event.session_id;
+            }
+            if (event.fpga_id != TRACE_NO_ID) {
+                entry["args"]["fpga"] = event.fpga_id;
+            }
+            if (event.slot_id != TRACE_NO_ID) {
+                entry["args"]["slot"] = event.slot_id;
+            }
+            trace_events.push_back(entry);
+        }
+    }
+
+    json trace;
+    trace["traceEvents"] = trace_events;
+    trace["displayTimeUnit"] = "ns";
+    out << trace.dump();
+}
+
+struct aos_log_record {
+    // Vyukov style: pos + 1 once the line for pos is in, pos + LOG_QUEUE_RECORDS once the writer is done with it
+    std::atomic<uint64_t> sequence;
+    uint64_t time_ns;
+    LOG_LEVEL level;
+    uint32_t length;
+    char text[LOG_RECORD_BYTES];
+};
+
+/*
+    Bounded multi producer queue in front of a single writer thread.
+    Producers claim a record with one compare and swap, drain() is the only
+    consumer and runs under drain_mutex so flushLog() can take a turn.
+*/
+class aos_log_writer {
+public:
+
+    aos_log_writer() :
+        enqueue_pos(0),
+        dequeue_pos(0),
+        num_dropped(0),
+        num_reported_dropped(0),
+        stopping(false)
+    {
+        for (uint64_t idx = 0; idx < LOG_QUEUE_RECORDS; idx++) {
+            records[idx].sequence.store(idx, std::memory_order_relaxed);
+        }
+        writer = std::thread(&aos_log_writer::run, this);
+    }
+
+    ~aos_log_writer() {
+        stopping.store(true, std::memory_order_release);
+        writer.join();
+        drain();
+    }
+
+    void push(LOG_LEVEL level, uint64_t time_ns, const char * text, uint32_t length) {
+        uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        aos_log_record * record;
+        while (true) {
+            record = &records[pos % LOG_QUEUE_RECORDS];
+            const int64_t lag = (int64_t)record->sequence.load(std::memory_order_acquire) - (int64_t)pos;
+            if (lag == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                // The writer is a whole queue behind
+                num_dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        record->time_ns = time_ns;
+        record->level   = level;
+        record->length  = length;
+        memcpy(record->text, text, length);
+        record->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // Writes out every published line, false if there was none
+    bool drain() {
+        std::lock_guard<std::mutex> lock(drain_mutex);
+        bool wrote = false;
+        const uint64_t dropped = num_dropped.load(std::memory_order_relaxed);
+        if (dropped != num_reported_dropped) {
+            fprintf(stdout, "[%14.6f] WARN  %lu log lines dropped\n", (double)monotonic_ns() / 1e9, (unsigned long)(dropped - num_reported_dropped));
+            num_reported_dropped = dropped;
+            wrote = true;
+        }
+        while (true) {
+            aos_log_record & record = records[dequeue_pos % LOG_QUEUE_RECORDS];
+            if (record.sequence.load(std::memory_order_acquire) != (dequeue_pos + 1)) {
+                break;
+            }
+            fprintf(stdout, "[%14.6f] %s ", (double)record.time_ns / 1e9, getLevelTag(record.level));
+            fwrite(record.text, 1, record.length, stdout);
+            fputc('\n', stdout);
+            record.sequence.store(dequeue_pos + LOG_QUEUE_RECORDS, std::memory_order_release);
+            dequeue_pos++;
+            wrote = true;
+        }
+        if (wrote) {
+            fflush(stdout);
+        }
+        return wrote;
+    }
+
+    uint64_t getNumDropped() const {
+        return num_dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    void run() {
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (!drain()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    static const char * getLevelTag(LOG_LEVEL level) {
+        switch (level) {
+            case LEVEL_DEBUG : return "DEBUG";
+            case LEVEL_INFO : return "INFO ";
+            case LEVEL_WARN : return "WARN ";
+            case LEVEL_ERROR : return "ERROR";
+            default : return "     ";
+        }
+    }
+
+    aos_log_record records[LOG_QUEUE_RECORDS];
+    std::atomic<uint64_t> enqueue_pos;
+    uint64_t dequeue_pos;
+    std::atomic<uint64_t> num_dropped;
+    uint64_t num_reported_dropped;
+    std::mutex drain_mutex;
+    std::atomic<bool> stopping;
+    std::thread writer;
+
+};
+
+// Started by the first line, its destructor writes the tail at exit
+static aos_log_writer & getLogWriter() {
+    static aos_log_writer log_writer;
+    return log_writer;
+}
+
+// Fixed buffer a line is formatted into, whatever does not fit is dropped
+class aos_log_buffer : public std::streambuf {
+public:
+
+    aos_log_buffer() {
+        reset();
+    }
+
+    void reset() {
+        setp(text, text + LOG_RECORD_BYTES);
+    }
+
+    const char * data() const {
+        return pbase();
+    }
+
+    uint32_t size() const {
+        return (uint32_t)(pptr() - pbase());
+    }
+
+protected:
+
+    int_type overflow(int_type ch) {
+        return traits_type::not_eof(ch);
+    }
+
+private:
+
+    char text[LOG_RECORD_BYTES];
+
+};
+
+struct aos_log_line {
+    aos_log_buffer buffer;
+    std::ostream out;
+    std::ios::fmtflags default_flags;
+    std::streamsize default_precision;
+
+    aos_log_line() :
+        out(&buffer),
+        default_flags(out.flags()),
+        default_precision(out.precision())
+    {
+    }
+};
+
+static thread_local aos_log_line log_line;
+static std::atomic<int> log_level(LEVEL_DEBUG);
+
+void setLogLevel(LOG_LEVEL level) {
+    log_level.store(level, std::memory_order_relaxed);
+}
+
+bool isLogging(LOG_LEVEL level) {
+    return ((int)level >= log_level.load(std::memory_order_relaxed)) && (level != LEVEL_OFF);
+}
+
+std::ostream & beginLogLine() {
+    log_line.buffer.reset();
+    log_line.out.clear();
+    log_line.out.flags(log_line.default_flags);
+    log_line.out.precision(log_line.default_precision);
+    return log_line.out;
+}
+
+void endLogLine(LOG_LEVEL level) {
+    getLogWriter().push(level, monotonic_ns(), log_line.buffer.data(), log_line.buffer.size());
+}
+
+void flushLog() {
+    getLogWriter().drain();
+}
+
+uint64_t getNumDroppedLogLines() {
+    return getLogWriter().getNumDropped();
 }
@@ -0,0 +1,522 @@
+#include "aos.h"
+#include "json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+/*
+    Multi-tenant load generator. Opens sessions against a running daemon
+    with Poisson arrivals, or replays recorded arrivals, mixing the access
+    patterns of the example apps:
+
+    - memdrive: program the eight MemDrive registers, poll 0x08 until the
+      run reports its end cycle
+    - bitcoin:  write the midstate and hash data, poll the nonce register
+      until it holds a nonce
+    - dnn:      upload the weights over BulkData once per session (the
+      daemon stages one bulk write per session), then start runs through
+      0x00 and poll it
+
+    A session repeats its pattern until its length is up, every repetition
+    is a job. A tenant is a mix entry, and its SLO is met by a job that
+    finishes within slo_ms of its first op, including any wait for a slot.
+*/
+
+enum LOADGEN_PATTERN {
+    PATTERN_MEMDRIVE,
+    PATTERN_BITCOIN,
+    PATTERN_DNN
+};
+
+struct loadgen_tenant {
+    std::string name;
+    LOADGEN_PATTERN pattern;
+    std::string app_id;
+    double weight;
+    uint64_t slo_ns;
+};
+
+struct loadgen_arrival {
+    uint32_t tenant_idx;
+    uint64_t arrival_ns; // since the start of the run
+    uint64_t session_ns;
+};
+
+struct loadgen_config {
+    std::vector<loadgen_tenant> tenants;
+    std::vector<double> rates;     // sessions/s, one run per rate
+    uint64_t duration_ns;          // arrivals are generated over this long
+    uint64_t mean_session_ns;
+    uint64_t think_ns;             // gap between the jobs of a session
+    uint64_t poll_ns;
+    uint64_t poll_timeout_ns;
+    uint64_t dnn_weight_bytes;
+    uint64_t seed;
+    std::string replay_file;
+    std::string record_file;
+    std::string json_file;
+};
+
+// Per tenant outcome of one run, shared by its session threads
+struct loadgen_results {
+    std::mutex lock;
+    std::vector<uint64_t> job_ns;
+    uint64_t num_sessions = 0;
+    uint64_t num_attained = 0;
+    uint64_t num_timeouts = 0;
+    uint64_t num_errors = 0;
+};
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void sleep_ns(uint64_t ns) {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+}
+
+static bool parsePattern(const std::string & name, LOADGEN_PATTERN & pattern, std::string & app_id) {
+    if (name == "memdrive") {
+        pattern = PATTERN_MEMDRIVE;
+        app_id  = "memdrive_v0";
+    } else if (name == "bitcoin") {
+        pattern = PATTERN_BITCOIN;
+        app_id  = "bitcoin";
+    } else if (name == "dnn") {
+        pattern = PATTERN_DNN;
+        app_id  = "dnn_weaver_v0";
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// pattern[:weight[:slo_ms]] separated by commas, e.g. memdrive:3:20,bitcoin:1:50
+static bool parseMix(const std::string & mix, std::vector<loadgen_tenant> & tenants) {
+    std::istringstream entries(mix);
+    std::string entry;
+    while (std::getline(entries, entry, ',')) {
+        std::istringstream fields(entry);
+        std::string name;
+        std::string weight;
+        std::string slo_ms;
+        std::getline(fields, name, ':');
+        std::getline(fields, weight, ':');
+        std::getline(fields, slo_ms, ':');
+        loadgen_tenant tenant;
+        tenant.name = name;
+        if (!parsePattern(name, tenant.pattern, tenant.app_id)) {
+            return false;
+        }
+        tenant.weight = weight.empty() ? 1.0 : std::stod(weight);
+        tenant.slo_ns = (uint64_t)((slo_ms.empty() ? 100.0 : std::stod(slo_ms)) * 1e6);
+        if (tenant.weight < 0.0) {
+            return false;
+        }
+        tenants.push_back(tenant);
+    }
+    double total_weight = 0.0;
+    for (auto & tenant : tenants) {
+        total_weight += tenant.weight;
+    }
+    return total_weight > 0.0;
+}
+
+static bool parseRates(const std::string & list, std::vector<double> & rates) {
+    rates.clear();
+    std::istringstream fields(list);
+    std::string field;
+    while (std::getline(fields, field, ',')) {
+        const double rate = std::stod(field);
+        if (rate <= 0.0) {
+            return false;
+        }
+        rates.push_back(rate);
+    }
+    return !rates.empty();
+}
+
+static int32_t findTenant(const std::vector<loadgen_tenant> & tenants, const std::string & name) {
+    for (uint32_t tenant_idx = 0; tenant_idx < tenants.size(); tenant_idx++) {
+        if (tenants[tenant_idx].name == name) {
+            return tenant_idx;
+        }
+    }
+    return -1;
+}
+
+// Poisson arrivals, tenants drawn by weight, exponential session lengths
+static void generateArrivals(const loadgen_config & cfg, double rate_per_s, std::vector<loadgen_arrival> & arrivals) {
+    std::mt19937_64 rng(cfg.seed);
+    std::exponential_distribution<double> gap_s(rate_per_s);
+    std::exponential_distribution<double> session_ns(1.0 / (double)std::max((uint64_t)1, cfg.mean_session_ns));
+    std::vector<double> weights;
+    for (auto & tenant : cfg.tenants) {
+        weights.push_back(tenant.weight);
+    }
+    std::discrete_distribution<uint32_t> tenant(weights.begin(), weights.end());
+    double arrival_s = gap_s(rng);
+    while ((uint64_t)(arrival_s * 1e9) < cfg.duration_ns) {
+        loadgen_arrival arrival;
+        arrival.tenant_idx = tenant(rng);
+        arrival.arrival_ns = (uint64_t)(arrival_s * 1e9);
+        arrival.session_ns = (uint64_t)session_ns(rng);
+        arrivals.push_back(arrival);
+        arrival_s += gap_s(rng);
+    }
+}
+
+// tenant,arrival_ms,session_ms per line, as written by --record
+static bool readArrivals(const std::string & file_name, const std::vector<loadgen_tenant> & tenants, std::vector<loadgen_arrival> & arrivals) {
+    std::ifstream in(file_name);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        std::string name;
+        double arrival_ms;
+        double session_ms;
+        if (!(fields >> name >> arrival_ms >> session_ms)) {
+            continue;
+        }
+        const int32_t tenant_idx = findTenant(tenants, name);
+        if (tenant_idx < 0) {
+            printf("Tenant %s of %s is not in the mix\n", name.c_str(), file_name.c_str());
+            return false;
+        }
+        arrivals.push_back({(uint32_t)tenant_idx, (uint64_t)(arrival_ms * 1e6), (uint64_t)(session_ms * 1e6)});
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](const loadgen_arrival & a, const loadgen_arrival & b) {
+        return a.arrival_ns < b.arrival_ns;
+    });
+    return true;
+}
+
+static bool writeArrivals(const std::string & file_name, const std::vector<loadgen_tenant> & tenants, const std::vector<loadgen_arrival> & arrivals) {
+    std::ofstream out(file_name);
+    out << "# tenant,arrival_ms,session_ms" << std::endl;
+    out << std::fixed << std::setprecision(6);
+    for (auto & arrival : arrivals) {
+        out << tenants[arrival.tenant_idx].name << "," << ((double)arrival.arrival_ns / 1e6) << "," << ((double)arrival.session_ns / 1e6) << std::endl;
+    }
+    return (bool)out;
+}
+
+/*
+    Reads addr every poll_ns until done(value), false once poll_timeout_ns
+    went by or the read failed.
+*/
+template <typename done_t>
+static bool pollUntil(const loadgen_config & cfg, aos_client & client, uint64_t addr, done_t done, bool & failed) {
+    const uint64_t start_ns = now_ns();
+    while (true) {
+        uint64_t value = 0;
+        if (client.aos_cntrlreg_read(addr, value) != aos_errcode::SUCCESS) {
+            failed = true;
+            return false;
+        }
+        if (done(value)) {
+            return true;
+        }
+        if ((now_ns() - start_ns) >= cfg.poll_timeout_ns) {
+            return false;
+        }
+        sleep_ns(cfg.poll_ns);
+    }
+}
+
+// One job of the tenant's pattern, false if it timed out or an op failed
+static bool runJob(const loadgen_config & cfg, const loadgen_tenant & tenant, aos_client & client, uint64_t job_idx,
+                   std::vector<char> & weights, bool & failed) {
+    failed = false;
+    switch (tenant.pattern) {
+        case LOADGEN_PATTERN::PATTERN_MEMDRIVE : {
+            // Same program as example/memdrive, each job moves its start address
+            const uint64_t program[8] = {(job_idx * 0x1000), 0x15, 0xFFFFFFFFFFFFFFFF, 0x1, 0xC000, 6, 0xFEEBFEEBBEEFBEEF, 0xDAEDDAEDDEADDEAD};
+            for (uint64_t reg_idx = 0; reg_idx < 8; reg_idx++) {
+                if (client.aos_cntrlreg_write(reg_idx * 8, program[reg_idx]) != aos_errcode::SUCCESS) {
+                    failed = true;
+                    return false;
+                }
+            }
+            return pollUntil(cfg, client, 0x08, [](uint64_t end_cycle) { return end_cycle != 0; }, failed);
+        }
+        break;
+        case LOADGEN_PATTERN::PATTERN_BITCOIN : {
+            // Midstate and hash data of bitcoin_client.cpp, one register every 64 bytes from 0x200
+            const uint64_t block[6] = {0xf106abb3af41f790, 0x61a5e75ec8c582a5, 0x60c009cda7252b91, 0x228ea4732a3c9ba8, 0x9395e64dbed17115, 0x2194261a};
+            for (uint64_t reg_idx = 0; reg_idx < 6; reg_idx++) {
+                if (client.aos_cntrlreg_write((1 << 9) + (reg_idx * 64), block[reg_idx]) != aos_errcode::SUCCESS) {
+                    failed = true;
+                    return false;
+                }
+            }
+            return pollUntil(cfg, client, (1 << 9), [](uint64_t nonce) { return nonce != ~0ULL; }, failed);
+        }
+        break;
+        case LOADGEN_PATTERN::PATTERN_DNN : {
+            if ((job_idx == 0) && !weights.empty()) {
+                if (client.aos_bulkdata_write(0, weights.size(), weights.data()) != aos_errcode::SUCCESS) {
+                    failed = true;
+                    return false;
+                }
+            }
+            if (client.aos_cntrlreg_write(0x00, job_idx + 1) != aos_errcode::SUCCESS) {
+                failed = true;
+                return false;
+            }
+            return pollUntil(cfg, client, 0x00, [](uint64_t status) { return status != 0; }, failed);
+        }
+        break;
+    }
+    return false;
+}
+
+static void runSession(const loadgen_config & cfg, const loadgen_tenant & tenant, uint64_t session_ns, loadgen_results & results) {
+    aos_client client(tenant.app_id);
+    client.aos_init_session();
+    std::vector<char> weights((tenant.pattern == PATTERN_DNN) ? cfg.dnn_weight_bytes : 0, 0x5A);
+
+    std::vector<uint64_t> job_ns;
+    uint64_t num_attained = 0;
+    uint64_t num_timeouts = 0;
+    uint64_t num_errors = 0;
+    const uint64_t start_ns = now_ns();
+    for (uint64_t job_idx = 0; ; job_idx++) {
+        const uint64_t job_start_ns = now_ns();
+        bool failed = false;
+        const bool completed = runJob(cfg, tenant, client, job_idx, weights, failed);
+        const uint64_t elapsed_ns = now_ns() - job_start_ns;
+        job_ns.push_back(elapsed_ns);
+        if (completed && (elapsed_ns <= tenant.slo_ns)) {
+            num_attained++;
+        }
+        if (failed) {
+            num_errors++;
+            break;
+        }
+        if (!completed) {
+            num_timeouts++;
+        }
+        if ((now_ns() - start_ns) >= session_ns) {
+            break;
+        }
+        sleep_ns(cfg.think_ns);
+    }
+    client.aos_end_session();
+
+    std::lock_guard<std::mutex> guard(results.lock);
+    results.job_ns.insert(results.job_ns.end(), job_ns.begin(), job_ns.end());
+    results.num_sessions++;
+    results.num_attained += num_attained;
+    results.num_timeouts += num_timeouts;
+    results.num_errors   += num_errors;
+}
+
+static uint64_t percentile(const std::vector<uint64_t> & sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    return sorted[std::min(sorted.size() - 1, (size_t)(fraction * (double)sorted.size()))];
+}
+
+// Opens every session at its arrival time, waits for all of them and reports per tenant
+static json runArrivals(const loadgen_config & cfg, const std::vector<loadgen_arrival> & arrivals, const std::string & label) {
+    std::vector<loadgen_results> results(cfg.tenants.size());
+    std::vector<std::thread> sessions;
+    sessions.reserve(arrivals.size());
+    const uint64_t start_ns = now_ns();
+    for (auto & arrival : arrivals) {
+        const uint64_t elapsed_ns = now_ns() - start_ns;
+        if (arrival.arrival_ns > elapsed_ns) {
+            sleep_ns(arrival.arrival_ns - elapsed_ns);
+        }
+        sessions.push_back(std::thread(runSession, std::cref(cfg), std::cref(cfg.tenants[arrival.tenant_idx]), arrival.session_ns,
+                                       std::ref(results[arrival.tenant_idx])));
+    }
+    for (auto & session : sessions) {
+        session.join();
+    }
+    const uint64_t wall_ns = now_ns() - start_ns;
+
+    printf("%s: %lu sessions in %.3f s\n", label.c_str(), (uint64_t)arrivals.size(), (double)wall_ns / 1e9);
+    std::cout << std::left << std::setw(12) << "Tenant" << std::setw(20) << "App" << std::right << std::setw(10) << "Sessions"
+              << std::setw(10) << "Jobs" << std::setw(10) << "SLO ms" << std::setw(10) << "Attained" << std::setw(10) << "p50 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "Max ms" << std::setw(10) << "Timeouts" << std::setw(8) << "Errors" << std::endl;
+
+    json run;
+    run["label"]    = label;
+    run["sessions"] = arrivals.size();
+    run["wall_ns"]  = wall_ns;
+    run["tenants"]  = json::array();
+    for (uint32_t tenant_idx = 0; tenant_idx < cfg.tenants.size(); tenant_idx++) {
+        const loadgen_tenant & tenant = cfg.tenants[tenant_idx];
+        loadgen_results & result = results[tenant_idx];
+        std::sort(result.job_ns.begin(), result.job_ns.end());
+        const uint64_t num_jobs = result.job_ns.size();
+        const double attainment = (num_jobs == 0) ? 1.0 : ((double)result.num_attained / (double)num_jobs);
+
+        std::cout << std::left << std::setw(12) << tenant.name << std::setw(20) << tenant.app_id << std::right
+                  << std::setw(10) << result.num_sessions << std::setw(10) << num_jobs
+                  << std::setw(10) << std::fixed << std::setprecision(1) << ((double)tenant.slo_ns / 1e6)
+                  << std::setw(9) << (attainment * 100.0) << "%"
+                  << std::setw(10) << ((double)percentile(result.job_ns, 0.50) / 1e6)
+                  << std::setw(10) << ((double)percentile(result.job_ns, 0.99) / 1e6)
+                  << std::setw(10) << ((double)(result.job_ns.empty() ? 0 : result.job_ns.back()) / 1e6)
+                  << std::setw(10) << result.num_timeouts << std::setw(8) << result.num_errors << std::endl;
+
+        json entry;
+        entry["tenant"]     = tenant.name;
+        entry["app_id"]     = tenant.app_id;
+        entry["sessions"]   = result.num_sessions;
+        entry["jobs"]       = num_jobs;
+        entry["slo_ns"]     = tenant.slo_ns;
+        entry["attainment"] = attainment;
+        entry["p50_ns"]     = percentile(result.job_ns, 0.50);
+        entry["p90_ns"]     = percentile(result.job_ns, 0.90);
+        entry["p99_ns"]     = percentile(result.job_ns, 0.99);
+        entry["max_ns"]     = result.job_ns.empty() ? 0 : result.job_ns.back();
+        entry["timeouts"]   = result.num_timeouts;
+        entry["errors"]     = result.num_errors;
+        run["tenants"].push_back(entry);
+    }
+    std::cout << std::endl;
+    return run;
+}
+
+static void usage() {
+    printf("Usage: ./aos_loadgen <pattern[:weight[:slo_ms]],...> [options]\n"
+           "  patterns are memdrive, bitcoin and dnn, weights default to 1 and SLOs to 100 ms\n"
+           "  --rate <sessions/s,...>      Poisson arrival rates, one run each (default 10)\n"
+           "  --duration-s <s>             arrivals are generated over this long (default 10)\n"
+           "  --session-ms <ms>            mean session length (default 200)\n"
+           "  --think-ms <ms>              gap between the jobs of a session (default 10)\n"
+           "  --poll-us <us>               status poll interval (default 100)\n"
+           "  --poll-timeout-ms <ms>       a job that takes longer is a timeout (default 1000)\n"
+           "  --dnn-bytes <n>              weights a dnn session uploads (default 1048576)\n"
+           "  --app <pattern>=<app_id>     app a pattern opens sessions for\n"
+           "  --seed <n>                   arrival seed (default 1)\n"
+           "  --replay <csv>               replay tenant,arrival_ms,session_ms instead of generating\n"
+           "  --record <csv>               save the generated arrivals of the last rate\n"
+           "  --json <file>                also write the results as JSON\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        usage();
+        exit(EXIT_SUCCESS);
+    }
+
+    loadgen_config cfg;
+    cfg.rates            = {10.0};
+    cfg.duration_ns      = 10ULL * 1000 * 1000 * 1000;
+    cfg.mean_session_ns  = 200ULL * 1000 * 1000;
+    cfg.think_ns         = 10ULL * 1000 * 1000;
+    cfg.poll_ns          = 100ULL * 1000;
+    cfg.poll_timeout_ns  = 1000ULL * 1000 * 1000;
+    cfg.dnn_weight_bytes = 1ULL << 20;
+    cfg.seed             = 1;
+    if (!parseMix(argv[1], cfg.tenants)) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    const double ms = 1e6;
+    for (int arg_idx = 2; arg_idx < argc; arg_idx++) {
+        const std::string arg = argv[arg_idx];
+        if (arg_idx + 1 >= argc) {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        const std::string value = argv[++arg_idx];
+        if (arg == "--rate") {
+            if (!parseRates(value, cfg.rates)) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--duration-s") {
+            cfg.duration_ns = (uint64_t)(std::stod(value) * 1e9);
+        } else if (arg == "--session-ms") {
+            cfg.mean_session_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--think-ms") {
+            cfg.think_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--poll-us") {
+            cfg.poll_ns = (uint64_t)(std::stod(value) * 1e3);
+        } else if (arg == "--poll-timeout-ms") {
+            cfg.poll_timeout_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--dnn-bytes") {
+            cfg.dnn_weight_bytes = std::stoull(value);
+        } else if (arg == "--app") {
+            const size_t split = value.find('=');
+            const int32_t tenant_idx = (split == std::string::npos) ? -1 : findTenant(cfg.tenants, value.substr(0, split));
+            if (tenant_idx < 0) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+            cfg.tenants[tenant_idx].app_id = value.substr(split + 1);
+        } else if (arg == "--seed") {
+            cfg.seed = std::stoull(value);
+        } else if (arg == "--replay") {
+            cfg.replay_file = value;
+        } else if (arg == "--record") {
+            cfg.record_file = value;
+        } else if (arg == "--json") {
+            cfg.json_file = value;
+        } else {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    json report;
+    report["runs"] = json::array();
+    if (!cfg.replay_file.empty()) {
+        std::vector<loadgen_arrival> arrivals;
+        if (!readArrivals(cfg.replay_file, cfg.tenants, arrivals)) {
+            printf("Unable to replay %s\n", cfg.replay_file.c_str());
+            exit(EXIT_FAILURE);
+        }
+        report["runs"].push_back(runArrivals(cfg, arrivals, "Replay of " + cfg.replay_file));
+    } else {
+        for (double rate : cfg.rates) {
+            std::vector<loadgen_arrival> arrivals;
+            generateArrivals(cfg, rate, arrivals);
+            if (!cfg.record_file.empty() && !writeArrivals(cfg.record_file, cfg.tenants, arrivals)) {
+                printf("Unable to write %s\n", cfg.record_file.c_str());
+                exit(EXIT_FAILURE);
+            }
+            std::ostringstream label;
+            label << rate << " sessions/s";
+            json run = runArrivals(cfg, arrivals, label.str());
+            run["rate"] = rate;
+            report["runs"].push_back(run);
+        }
+    }
+
+    if (!cfg.json_file.empty()) {
+        std::ofstream json_out(cfg.json_file);
+        json_out << report.dump(4) << std::endl;
+        if (!json_out) {
+            printf("Unable to write %s\n", cfg.json_file.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,155 @@
+#include "aos_placement.h"
+
+aos_placement::aos_placement(const aos_scheduler & scheduler, uint64_t horizon_ns):
+    sched(scheduler),
+    reconfig_horizon_ns(horizon_ns)
+{
+}
+
+/*
+    Same scoring as picking a replacement image for one FPGA: the sessions
+    the image can run out of what is still unplaced, discounted by how much
+    of the horizon its load eats, minus the sessions a switch evicts.
+    Keeping what is on the FPGA costs nothing.
+*/
+double aos_placement::scoreImage(uint32_t image_idx, const FPGAPlacementState & fpga, const std::vector<uint32_t> & remaining, uint64_t & servable) const {
+    const ImageDescriptor & image = sched.getImageDescriptor(image_idx);
+    servable = 0;
+    for (uint32_t app_idx = 0; app_idx < remaining.size(); app_idx++) {
+        servable += std::min(image.getAppCount(app_idx), remaining[app_idx]);
+    }
+    if ((int32_t)image_idx == fpga.image_idx) {
+        return (double)servable;
+    }
+    const uint64_t load_ns = sched.getImageLoadLatency(image_idx);
+    const double useful_fraction = (load_ns >= reconfig_horizon_ns) ? 0.0 : ((double)(reconfig_horizon_ns - load_ns) / (double)reconfig_horizon_ns);
+    return ((double)servable * useful_fraction) - (double)fpga.num_bound;
+}
+
+/*
+    Greedy bin packing. Every round commits the (FPGA, image) pair with the
+    best score against the demand left over by earlier rounds, so the
+    images that run the most sessions are placed first and later FPGAs fill
+    in what they leave. FPGAs being reconfigured are committed up front. An
+    FPGA is only switched when that places something, otherwise it keeps
+    its image, and ties go to keeping the image, then to the larger one.
+*/
+PlacementPlan aos_placement::plan(const std::vector<FPGAPlacementState> & fpgas, const std::vector<uint32_t> & demand) const {
+    const uint64_t num_fpgas = fpgas.size();
+    const uint32_t num_apps = sched.getNumApps();
+
+    PlacementPlan placement;
+    placement.target_image.assign(num_fpgas, NO_IMAGE_LOADED);
+    placement.app_slots.assign(num_fpgas, std::vector<uint32_t>(num_apps, 0));
+    placement.num_placed = 0;
+    placement.num_reconfigs = 0;
+
+    std::vector<uint32_t> remaining(num_apps, 0);
+    for (uint32_t app_idx = 0; (app_idx < num_apps) && (app_idx < demand.size()); app_idx++) {
+        remaining[app_idx] = demand[app_idx];
+    }
+    std::vector<bool> committed(num_fpgas, false);
+
+    auto commit = [&](uint64_t fpga_id, int32_t image_idx) {
+        committed[fpga_id] = true;
+        placement.target_image[fpga_id] = image_idx;
+        if (image_idx == NO_IMAGE_LOADED) {
+            return;
+        }
+        if (image_idx != fpgas[fpga_id].image_idx) {
+            placement.num_reconfigs++;
+        }
+        const ImageDescriptor & image = sched.getImageDescriptor(image_idx);
+        for (uint32_t app_idx = 0; app_idx < num_apps; app_idx++) {
+            const uint32_t taken = std::min(image.getAppCount(app_idx), remaining[app_idx]);
+            placement.app_slots[fpga_id][app_idx] = taken;
+            remaining[app_idx] -= taken;
+            placement.num_placed += taken;
+        }
+    };
+
+    for (uint64_t fpga_id = 0; fpga_id < num_fpgas; fpga_id++) {
+        if (fpgas[fpga_id].locked) {
+            commit(fpga_id, fpgas[fpga_id].image_idx);
+        }
+    }
+
+    while (true) {
+        // Only images with an app that still has demand can place anything
+        std::vector<uint32_t> candidates;
+        for (uint32_t app_idx = 0; app_idx < num_apps; app_idx++) {
+            if (remaining[app_idx] == 0) {
+                continue;
+            }
+            app_demand_t app_demand(1, std::make_pair(app_idx, (uint32_t)1));
+            for (auto & image_idx : sched.getAllFittingImages(app_demand)) {
+                if (std::find(candidates.begin(), candidates.end(), image_idx) == candidates.end()) {
+                    candidates.push_back(image_idx);
+                }
+            }
+        }
+
+        bool found = false;
+        uint64_t best_fpga_id = 0;
+        uint32_t best_image_idx = 0;
+        double best_score = 0.0;
+        bool best_keeps = false;
+        uint64_t best_servable = 0;
+        uint32_t best_num_slots = 0;
+        for (uint64_t fpga_id = 0; fpga_id < num_fpgas; fpga_id++) {
+            if (committed[fpga_id]) {
+                continue;
+            }
+            const FPGAPlacementState & fpga = fpgas[fpga_id];
+            std::vector<uint32_t> options = candidates;
+            if ((fpga.image_idx != NO_IMAGE_LOADED) && (std::find(options.begin(), options.end(), (uint32_t)fpga.image_idx) == options.end())) {
+                options.push_back(fpga.image_idx);
+            }
+            for (auto & image_idx : options) {
+                uint64_t servable = 0;
+                const double score = scoreImage(image_idx, fpga, remaining, servable);
+                const bool keeps = ((int32_t)image_idx == fpga.image_idx);
+                // Never switch an image for nothing
+                if (!keeps && (score <= 0.0)) {
+                    continue;
+                }
+                const uint32_t num_slots = sched.getImageDescriptor(image_idx).num_slots;
+                if (!found ||
+                    (score > best_score) ||
+                    ((score == best_score) && (keeps && !best_keeps)) ||
+                    ((score == best_score) && (keeps == best_keeps) && ((servable > best_servable) || ((servable == best_servable) && (num_slots > best_num_slots))))) {
+                    found = true;
+                    best_fpga_id = fpga_id;
+                    best_image_idx = image_idx;
+                    best_score = score;
+                    best_keeps = keeps;
+                    best_servable = servable;
+                    best_num_slots = num_slots;
+                }
+            }
+        }
+        if (!found) {
+            break;
+        }
+        commit(best_fpga_id, best_image_idx);
+    }
+
+    // Whatever is left places nothing anywhere and keeps its image
+    for (uint64_t fpga_id = 0; fpga_id < num_fpgas; fpga_id++) {
+        if (!committed[fpga_id]) {
+            commit(fpga_id, fpgas[fpga_id].image_idx);
+        }
+    }
+
+    return placement;
+}
+
+uint64_t aos_placement::getPlannedCapacity(const PlacementPlan & placement, uint32_t app_idx) const {
+    uint64_t capacity = 0;
+    for (auto & image_idx : placement.target_image) {
+        if (image_idx != NO_IMAGE_LOADED) {
+            capacity += sched.getImageDescriptor(image_idx).getAppCount(app_idx);
+        }
+    }
+    return capacity;
+}
@@ -1,11 +1,29 @@
 #include "aos_scheduler.h"
 
+static std::once_flag fpga_mgmt_init_flag;
+static int fpga_mgmt_init_rc = 0;
+
+static int initFPGAMgmt() {
+    std::call_once(fpga_mgmt_init_flag, []() {
+        fpga_mgmt_init_rc = fpga_mgmt_init();
+        if (fpga_mgmt_init_rc != 0) {
+            AOS_LOG_ERROR("Scheduler: Unable to initialize the fpga_mgmt library");
+        }
+    });
+    return fpga_mgmt_init_rc;
+}
+
 aos_scheduler::aos_scheduler(uint64_t num_fpgas):
     num_fpga(num_fpgas),
-    current_image(num_fpga)
+    current_image(num_fpga),
+    clear_start_ns(num_fpga, 0),
+    simulated_reconfig(false),
+    simulated_load_latency_ns(0)
 {
+    reconfig_cancelled.reset(new std::atomic<bool>[num_fpga]);
     for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
-        current_image[fpga_id] = json();
+        current_image[fpga_id] = NO_IMAGE_LOADED;
+        reconfig_cancelled[fpga_id] = false;
     }
 }
 
@@ -19,98 +37,279 @@ void aos_scheduler::parseImages(std::string fileName) {
     json_in_file.close();
 
     if (image_library.empty()) {
-        cout << "Scheduler: Image Library is initially empty" << endl << flush;
+        AOS_LOG_INFO("Scheduler: Image Library is initially empty");
     }
 
-    cout << "Scheduler: Parsed file " << fileName << " and found " << parsed_file["images"].size() << " images." << endl << flush;
+    AOS_LOG_INFO("Scheduler: Parsed file " << fileName << " and found " << parsed_file["images"].size() << " images.");
 
     for (auto & image : parsed_file["images"]) {
         std::string agfi_ = image["agfi"];
         if (agfiExists(agfi_)) {
-            cout << "Scheduler: Skipping already exists agfi: " << agfi_ << endl << flush;
+            AOS_LOG_WARN("Scheduler: Skipping already exists agfi: " << agfi_);
+        } else if (!validateSlotWindows(image)) {
+            AOS_LOG_WARN("Scheduler: Skipping agfi with invalid BAR1 slot windows: " << agfi_);
         } else {
             image_library.push_back(image);
-            cout << "Scheduler: Image Library Adding agfi: " << agfi_ << " Description: " << image["description"] << endl << flush;
+            addImageDescriptor(image);
+            AOS_LOG_INFO("Scheduler: Image Library Adding agfi: " << agfi_ << " Description: " << image["description"]);
         }
     } // for in
 
-    cout << "Scheduler: Image library now has " << image_library.size() << " images." << endl << flush;
+    AOS_LOG_INFO("Scheduler: Image library now has " << image_library.size() << " images.");
+
+    // Optional per app metadata
+    if (parsed_file.find("apps") == parsed_file.end()) {
+        return;
+    }
+
+    for (auto & app : parsed_file["apps"]) {
+        std::string app_id_ = app["app_id"];
+        std::vector<cntrlreg_range_t> shadow_ranges;
+        if (app.find("shadow_regs") != app.end()) {
+            for (auto & range : app["shadow_regs"]) {
+                uint64_t base = range["base"];
+                uint64_t size = range["size"];
+                shadow_ranges.push_back(cntrlreg_range_t(base, size));
+            }
+        }
+        app_shadow_ranges[app_id_] = shadow_ranges;
+        AOS_LOG_INFO("Scheduler: App " << app_id_ << " declares " << shadow_ranges.size() << " non-volatile CntrlReg ranges");
+        // State carried across preemption, registers read back from the slot and DRAM the app writes on its own
+        std::vector<cntrlreg_range_t> state_ranges;
+        if (app.find("state_regs") != app.end()) {
+            for (auto & range : app["state_regs"]) {
+                uint64_t base = range["base"];
+                uint64_t size = range["size"];
+                state_ranges.push_back(cntrlreg_range_t(base, size));
+            }
+        }
+        app_state_ranges[app_id_] = state_ranges;
+        // Registers the app lets the daemon zero between tenants, writing others may have side effects
+        std::vector<cntrlreg_range_t> reset_ranges;
+        if (app.find("reset_regs") != app.end()) {
+            for (auto & range : app["reset_regs"]) {
+                uint64_t base = range["base"];
+                uint64_t size = range["size"];
+                reset_ranges.push_back(cntrlreg_range_t(base, size));
+            }
+        }
+        app_reset_ranges[app_id_] = reset_ranges;
+        std::vector<dram_range_t> dram_regions;
+        if (app.find("dram_regions") != app.end()) {
+            for (auto & range : app["dram_regions"]) {
+                uint64_t base = range["base"];
+                uint64_t size = range["size"];
+                dram_regions.push_back(dram_range_t(base, size));
+            }
+        }
+        app_dram_regions[app_id_] = dram_regions;
+        AOS_LOG_INFO("Scheduler: App " << app_id_ << " declares " << state_ranges.size() << " state CntrlReg ranges, " << reset_ranges.size()
+                     << " resettable CntrlReg ranges and " << dram_regions.size() << " DRAM regions");
+        if (app.find("done_reg") != app.end()) {
+            app_done_reg[app_id_] = app["done_reg"];
+        } else {
+            app_done_reg.erase(app_id_);
+        }
+    }
 }
 
 void aos_scheduler::clearImage(uint64_t fpga_id) {
     assert(fpga_id < num_fpga);
-    cout << "Scheduler: Preparing to clear FPGA Image on FPGA " << fpga_id << endl << flush;
-    std::stringstream clear_command;
-    clear_command << "sudo fpga-clear-local-image  -S ";
-    clear_command << fpga_id;
-    std::string clear_result = cmd_exec(clear_command.str());
-    cout << "Scheduler: Clear result: " << clear_result << endl << flush;
-    current_image[fpga_id].clear();
+    AOS_LOG_INFO("Scheduler: Preparing to clear FPGA Image on FPGA " << fpga_id);
+    clear_start_ns[fpga_id] = monotonic_ns();
+    const int rc = clearFPGA(fpga_id);
+    AOS_LOG_INFO("Scheduler: Clear result: " << rc);
+    current_image[fpga_id] = NO_IMAGE_LOADED;
 }
 
 void aos_scheduler::loadImage(uint64_t fpga_id, uint32_t image_idx) {
     assert(fpga_id < num_fpga);
 
-    if (image_idx > image_library.size()) {
-        cout << "Scheduler: Invalid image selection index." << endl << flush;
+    if (image_idx >= image_descriptors.size()) {
+        AOS_LOG_ERROR("Scheduler: Invalid image selection index.");
         return;
     }
 
+    const uint64_t reconfig_start_ns = (clear_start_ns[fpga_id] != 0) ? clear_start_ns[fpga_id] : monotonic_ns();
+    beginReconfiguration(fpga_id, image_idx);
+    // A reconfiguration costs the clear that preceded the load as well
+    clear_start_ns[fpga_id] = reconfig_start_ns;
+    const int rc = loadFPGA(fpga_id, image_idx);
+    completeReconfiguration(fpga_id, image_idx, rc);
+}
+
+/*
+    Bookkeeping before the FPGA is reprogrammed. The FPGA counts as empty
+    until completeReconfiguration runs.
+*/
+void aos_scheduler::beginReconfiguration(uint64_t fpga_id, uint32_t image_idx) {
+    assert(fpga_id < num_fpga);
+    assert(image_idx < image_descriptors.size());
+
     if (anyImageLoaded(fpga_id)) {
-        cout << "Scheduler: On FPGA " << fpga_id << " Overwritting current image agfi: " << current_image[fpga_id]["agfi"] << " Description: " << current_image[fpga_id]["description"] << endl << flush;
+        const ImageDescriptor & current = image_descriptors[current_image[fpga_id]];
+        AOS_LOG_INFO("Scheduler: On FPGA " << fpga_id << " Overwritting current image agfi: " << current.agfi << " Description: " << current.description);
     } else {
-        cout << "Scheduler: On FPGA " << fpga_id << " No prior image written" << endl << flush;
+        AOS_LOG_INFO("Scheduler: On FPGA " << fpga_id << " No prior image written");
     }
 
-    std::string afgi = image_library[image_idx]["agfi"];
-    std::string image_desc = image_library[image_idx]["description"];
-    std::stringstream load_cmd; 
-    load_cmd << "sudo fpga-load-local-image -S ";
-    load_cmd << fpga_id;
-    load_cmd << " -I ";
-    load_cmd << afgi;
+    const ImageDescriptor & image = image_descriptors[image_idx];
+    AOS_LOG_INFO("Scheduler: On FPGA " << fpga_id << " Attempting to load image with index " << image_idx << " afgi: " << image.agfi << " Description: " << image.description);
 
-    cout << "Scheduler: On FPGA " << fpga_id << " Attempting to load image with index " << image_idx << " afgi: " << afgi << " Description: " << image_desc << endl << flush;
-
-    std::string load_result = cmd_exec(load_cmd.str());
+    AOS_PROBE2(load_start, fpga_id, image_idx);
+    clear_start_ns[fpga_id] = monotonic_ns();
+    current_image[fpga_id] = NO_IMAGE_LOADED;
+    reconfig_cancelled[fpga_id] = false;
+}
 
-    cout << "Scheduler: On FPGA " << fpga_id << " Load result: " << load_result << endl << flush;
+// Clear and load, blocks for the whole reconfiguration
+int aos_scheduler::programImage(uint64_t fpga_id, uint32_t image_idx) const {
+    int rc = clearFPGA(fpga_id);
+    if (rc != 0) {
+        return rc;
+    }
+    // A load in progress cannot be aborted, the gap between clear and load is the last chance
+    if (reconfig_cancelled[fpga_id]) {
+        return RECONFIG_CANCELLED;
+    }
+    return loadFPGA(fpga_id, image_idx);
+}
 
-    current_image[fpga_id] = image_library[image_idx];
+void aos_scheduler::completeReconfiguration(uint64_t fpga_id, uint32_t image_idx, int rc) {
+    assert(fpga_id < num_fpga);
+    assert(image_idx < image_descriptors.size());
 
-}
+    const uint64_t reconfig_end_ns = monotonic_ns();
+    AOS_PROBE4(load_done, fpga_id, image_idx, rc, reconfig_end_ns - clear_start_ns[fpga_id]);
 
-bool aos_scheduler::agfiExists(std::string agfi) {
+    if (rc == RECONFIG_CANCELLED) {
+        AOS_LOG_INFO("Scheduler: On FPGA " << fpga_id << " Load of image " << image_idx << " cancelled");
+    } else {
+        AOS_LOG_INFO("Scheduler: On FPGA " << fpga_id << " Load result: " << rc);
+    }
 
-    for (auto & image : image_library) {
-        std::string agfi_ = image["agfi"];
-        if (agfi == agfi_) {
-            return true;
-        }
+    if (rc != 0) {
+        clear_start_ns[fpga_id] = 0;
+        current_image[fpga_id] = NO_IMAGE_LOADED;
+        return;
     }
 
-    return false;
+    recordImageLoadLatency(image_idx, reconfig_end_ns - clear_start_ns[fpga_id]);
+    clear_start_ns[fpga_id] = 0;
+
+    current_image[fpga_id] = (int32_t)image_idx;
 }
 
-bool aos_scheduler::anyImageLoaded(uint64_t fpga_id) {
+bool aos_scheduler::isImageResident(uint64_t fpga_id, uint32_t image_idx) const {
     assert(fpga_id < num_fpga);
-    if (current_image[fpga_id].size() == 0) {
+    return (current_image[fpga_id] == (int32_t)image_idx);
+}
+
+bool aos_scheduler::probeResidentImage(uint64_t fpga_id) {
+    assert(fpga_id < num_fpga);
+    // Nothing survives a simulated FPGA
+    if (simulated_reconfig || (initFPGAMgmt() != 0)) {
         return false;
-    } else {
-        return true;
     }
+    fpga_mgmt_image_info info;
+    memset(&info, 0, sizeof(fpga_mgmt_image_info));
+    if (fpga_mgmt_describe_local_image((int)fpga_id, &info, 0) != 0) {
+        return false;
+    }
+    if (info.status != FPGA_STATUS_LOADED) {
+        return false;
+    }
+    auto image_it = agfi_to_image_idx.find(std::string(info.ids.afi_id));
+    if (image_it == agfi_to_image_idx.end()) {
+        AOS_LOG_WARN("Scheduler: FPGA " << fpga_id << " holds " << info.ids.afi_id << " which is not in the image library");
+        return false;
+    }
+    current_image[fpga_id] = (int32_t)image_it->second;
+    AOS_LOG_INFO("Scheduler: FPGA " << fpga_id << " already holds image " << image_it->second << " agfi: " << image_it->first);
+    return true;
 }
 
+void aos_scheduler::cancelReconfiguration(uint64_t fpga_id) {
+    assert(fpga_id < num_fpga);
+    reconfig_cancelled[fpga_id] = true;
+}
 
-json aos_scheduler::getImageByAgfi(std::string agfi) {
-    for (auto & image : image_library) {
-        std::string agfi_ = image["agfi"];
-        if (agfi == agfi_) {
-            return image;
+bool aos_scheduler::isReconfigurationCancelled(uint64_t fpga_id) const {
+    assert(fpga_id < num_fpga);
+    return reconfig_cancelled[fpga_id];
+}
+
+void aos_scheduler::setSimulatedReconfiguration(bool simulated, uint64_t load_latency_ns) {
+    simulated_reconfig = simulated;
+    simulated_load_latency_ns = load_latency_ns;
+}
+
+uint64_t aos_scheduler::getSimulatedLoadLatency() const {
+    return simulated_load_latency_ns;
+}
+
+int aos_scheduler::clearFPGA(uint64_t fpga_id) const {
+    if (simulated_reconfig) {
+        return 0;
+    }
+    int rc = initFPGAMgmt();
+    if (rc != 0) {
+        return rc;
+    }
+    fpga_mgmt_image_info info;
+    memset(&info, 0, sizeof(fpga_mgmt_image_info));
+    rc = fpga_mgmt_clear_local_image_sync((int)fpga_id, FPGA_MGMT_SYNC_TIMEOUT_POLLS, FPGA_MGMT_SYNC_DELAY_MSEC, &info);
+    if (rc != 0) {
+        AOS_LOG_ERROR("Scheduler: On FPGA " << fpga_id << " Clear failed with " << rc);
+    }
+    return rc;
+}
+
+int aos_scheduler::loadFPGA(uint64_t fpga_id, uint32_t image_idx) const {
+    if (simulated_reconfig) {
+        // Sleep in slices so a cancelled load returns early
+        const uint64_t end_ns = monotonic_ns() + simulated_load_latency_ns;
+        for (uint64_t now_ns = monotonic_ns(); now_ns < end_ns; now_ns = monotonic_ns()) {
+            if (reconfig_cancelled[fpga_id]) {
+                return RECONFIG_CANCELLED;
+            }
+            std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<uint64_t>(end_ns - now_ns, 1000000)));
         }
+        return 0;
     }
+    int rc = initFPGAMgmt();
+    if (rc != 0) {
+        return rc;
+    }
+    // The API takes a mutable buffer
+    std::string agfi = image_descriptors[image_idx].agfi;
+    fpga_mgmt_image_info info;
+    memset(&info, 0, sizeof(fpga_mgmt_image_info));
+    rc = fpga_mgmt_load_local_image_sync((int)fpga_id, &agfi[0], FPGA_MGMT_SYNC_TIMEOUT_POLLS, FPGA_MGMT_SYNC_DELAY_MSEC, &info);
+    if ((rc == 0) && (info.status != FPGA_STATUS_LOADED)) {
+        rc = 1;
+    }
+    if (rc != 0) {
+        AOS_LOG_ERROR("Scheduler: On FPGA " << fpga_id << " Load of " << agfi << " failed with " << rc);
+    }
+    return rc;
+}
+
+bool aos_scheduler::agfiExists(std::string agfi) {
+    return (agfi_to_image_idx.find(agfi) != agfi_to_image_idx.end());
+}
+
+bool aos_scheduler::anyImageLoaded(uint64_t fpga_id) {
+    assert(fpga_id < num_fpga);
+    return (current_image[fpga_id] != NO_IMAGE_LOADED);
+}
 
-    return json();
+json aos_scheduler::getImageByAgfi(std::string agfi) {
+    auto image_it = agfi_to_image_idx.find(agfi);
+    if (image_it == agfi_to_image_idx.end()) {
+        return json();
+    }
+    return image_library[image_it->second];
 }
 
 json & aos_scheduler::getImageByIdx(uint32_t image_idx) {
@@ -133,6 +332,16 @@ json & aos_scheduler::getImageByIdx(uint32_t image_idx) {
 */
 bool aos_scheduler::canImageSatisfyNeed(json & image, json & app_tuples) {
 
+    // Images from the library are answered from their descriptor
+    const int32_t image_idx = getImageIdx(image);
+    if (image_idx != -1) {
+        app_demand_t app_demand;
+        if (!convertAppTuplesToDemand(app_tuples, app_demand)) {
+            return false;
+        }
+        return canImageSatisfyNeed((uint32_t)image_idx, app_demand);
+    }
+
     json image_as_tuple = convertImageToAppTuples(image);
 
     for (auto & app_id : app_tuples.items()) {
@@ -156,46 +365,83 @@ to run concurrently, -1 otherwise
 */
 int32_t aos_scheduler::getFittingImageIdx(json & app_ids) {
 
-    int index = 0;
-    for (auto & image : image_library) {
-        if (canImageSatisfyNeed(image , app_ids)) {
-            return index;
-        }
-        index++;
+    std::vector<uint32_t> indices = getAllFittingImages(app_ids);
+    if (indices.empty()) {
+        return -1;
     }
-
-    return -1;
+    return indices[0];
 }
 
 
 std::vector<uint32_t> aos_scheduler::getAllFittingImages(json & app_tuples) {
+    app_demand_t app_demand;
+    if (!convertAppTuplesToDemand(app_tuples, app_demand)) {
+        // Asks for an app no image has
+        return std::vector<uint32_t>();
+    }
+    return getAllFittingImages(app_demand);
+}
+
+/*
+    Only images that contain every demanded app can fit, so walk the
+    inverted index of the rarest demanded app and check the rest with
+    integer compares. Indices are returned in ascending order.
+*/
+std::vector<uint32_t> aos_scheduler::getAllFittingImages(const app_demand_t & app_demand) const {
     std::vector<uint32_t> indices;
-    uint32_t index = 0;
-    for (auto & image : image_library) {
-        if (canImageSatisfyNeed(image , app_tuples)) {
-            indices.push_back(index);
+
+    if (app_demand.empty()) {
+        // Every image satisfies an empty demand
+        for (uint32_t image_idx = 0; image_idx < image_descriptors.size(); image_idx++) {
+            indices.push_back(image_idx);
+        }
+        return indices;
+    }
+
+    const std::vector<uint32_t> * candidates = nullptr;
+    for (auto & app_count : app_demand) {
+        if (app_count.first >= images_with_app.size()) {
+            return indices;
+        }
+        const std::vector<uint32_t> & app_images = images_with_app[app_count.first];
+        if ((candidates == nullptr) || (app_images.size() < candidates->size())) {
+            candidates = &app_images;
+        }
+    }
+
+    for (auto & image_idx : *candidates) {
+        if (canImageSatisfyNeed(image_idx, app_demand)) {
+            indices.push_back(image_idx);
         }
-        index++;
     }
     return indices;
 }
 
+bool aos_scheduler::canImageSatisfyNeed(uint32_t image_idx, const app_demand_t & app_demand) const {
+    assert(image_idx < image_descriptors.size());
+    const ImageDescriptor & image = image_descriptors[image_idx];
+    for (auto & app_count : app_demand) {
+        if (image.getAppCount(app_count.first) < app_count.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
     Given an image, get it's index in the image library
 */
 int32_t aos_scheduler::getImageIdx(json & image) {
+    if (image.find("agfi") == image.end()) {
+        return -1;
+    }
     std::string agfi = image["agfi"];
 
-    int index = 0;
-    for (auto & image_ : image_library) {
-        std::string check_agfi = image_["agfi"];
-        if (agfi == check_agfi) {
-            return index;
-        }
-        index++;
+    auto image_it = agfi_to_image_idx.find(agfi);
+    if (image_it == agfi_to_image_idx.end()) {
+        return -1;
     }
-
-    return -1;
+    return image_it->second;
 }
 
 /*
@@ -233,18 +479,141 @@ std::map<uint64_t, std::string> aos_scheduler::getSlotAppIdMap(json & image) {
 
 }
 
+std::map<uint64_t, std::string> aos_scheduler::getSlotAppIdMap(uint32_t image_idx) const {
+
+    assert(image_idx < image_descriptors.size());
+    std::map<uint64_t, std::string> slot_appid_map;
+
+    for (auto & slot : image_descriptors[image_idx].slots) {
+        slot_appid_map[slot.slot_id] = app_idx_to_id[slot.app_idx];
+    }
+
+    return slot_appid_map;
+
+}
+
+/*
+    Per slot BAR1 windows. An image may describe where each slot's
+    register space lives in BAR1 with "bar1_base" and "bar1_size",
+    otherwise the legacy fixed 8 KB layout is assumed.
+*/
+std::map<uint64_t, uint64_t> aos_scheduler::getSlotBAR1BaseMap(json & image) {
+
+    std::map<uint64_t, uint64_t> slot_base_map;
+
+    for (auto & slot : image["slots"]) {
+        uint64_t slot_id = slot["slot_id"];
+        if (slot.find("bar1_base") != slot.end()) {
+            uint64_t bar1_base = slot["bar1_base"];
+            slot_base_map[slot_id] = bar1_base;
+        } else {
+            slot_base_map[slot_id] = (slot_id << DEFAULT_SLOT_BAR1_SHIFT);
+        }
+    }
+
+    return slot_base_map;
+}
+
+std::map<uint64_t, uint64_t> aos_scheduler::getSlotBAR1SizeMap(json & image) {
+
+    std::map<uint64_t, uint64_t> slot_size_map;
+
+    for (auto & slot : image["slots"]) {
+        uint64_t slot_id = slot["slot_id"];
+        if (slot.find("bar1_size") != slot.end()) {
+            uint64_t bar1_size = slot["bar1_size"];
+            slot_size_map[slot_id] = bar1_size;
+        } else {
+            slot_size_map[slot_id] = DEFAULT_SLOT_BAR1_SIZE;
+        }
+    }
+
+    return slot_size_map;
+}
+
+/*
+    Windows must be non-empty and 64-bit aligned, and they must fit the
+    shell's SoftReg router: it picks the app from BAR1 bits 15-13 and
+    hands it bits 12-0 only, so a window has to start at slot_id * 8 KB,
+    be at most 8 KB and belong to one of the first 8 slots. Anything else
+    would alias another slot's registers, or the memory counter window
+    right above the routed slots, on the FPGA.
+*/
+bool aos_scheduler::validateSlotWindows(json & image) {
+
+    std::map<uint64_t, uint64_t> slot_base_map = getSlotBAR1BaseMap(image);
+    std::map<uint64_t, uint64_t> slot_size_map = getSlotBAR1SizeMap(image);
+    std::set<uint64_t> seen_slot_ids;
+
+    for (auto & slot : image["slots"]) {
+        const uint64_t slot_id = slot["slot_id"];
+        if (!seen_slot_ids.insert(slot_id).second) {
+            return false;
+        }
+    }
+
+    for (auto & slot_base : slot_base_map) {
+        const uint64_t slot_id = slot_base.first;
+        const uint64_t base = slot_base.second;
+        const uint64_t size = slot_size_map[slot_id];
+        if ((size == 0) || ((base % 8) != 0) || ((size % 8) != 0)) {
+            return false;
+        }
+        if ((slot_id >= SOFTREG_ROUTED_SLOTS) || (base != (slot_id << DEFAULT_SLOT_BAR1_SHIFT)) || (size > DEFAULT_SLOT_BAR1_SIZE)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /*
     Does the app exist in any image?
 
 */
 bool aos_scheduler::appIdExists(std::string app_id) {
-    json app_tuple;
-    app_tuple[app_id]["count"] = 1;
-    if (getFittingImageIdx(app_tuple) == -1) {
+    const int32_t app_idx = getAppIdx(app_id);
+    if (app_idx == -1) {
         return false;
-    } else {
-        return true;
     }
+    return !images_with_app[app_idx].empty();
+}
+
+std::vector<cntrlreg_range_t> aos_scheduler::getShadowRegRanges(std::string app_id) {
+    if (app_shadow_ranges.find(app_id) == app_shadow_ranges.end()) {
+        return std::vector<cntrlreg_range_t>();
+    }
+    return app_shadow_ranges[app_id];
+}
+
+std::vector<cntrlreg_range_t> aos_scheduler::getStateRegRanges(std::string app_id) {
+    if (app_state_ranges.find(app_id) == app_state_ranges.end()) {
+        return std::vector<cntrlreg_range_t>();
+    }
+    return app_state_ranges[app_id];
+}
+
+std::vector<cntrlreg_range_t> aos_scheduler::getResetRegRanges(std::string app_id) {
+    if (app_reset_ranges.find(app_id) == app_reset_ranges.end()) {
+        return std::vector<cntrlreg_range_t>();
+    }
+    return app_reset_ranges[app_id];
+}
+
+std::vector<dram_range_t> aos_scheduler::getDRAMRegions(std::string app_id) {
+    if (app_dram_regions.find(app_id) == app_dram_regions.end()) {
+        return std::vector<dram_range_t>();
+    }
+    return app_dram_regions[app_id];
+}
+
+bool aos_scheduler::getDoneReg(std::string app_id, uint64_t & addr) {
+    auto done_it = app_done_reg.find(app_id);
+    if (done_it == app_done_reg.end()) {
+        return false;
+    }
+    addr = done_it->second;
+    return true;
 }
 
 json aos_scheduler::generateAppTuples(std::vector<std::string> app_ids, std::vector<uint32_t> app_counts) {
@@ -256,3 +625,193 @@ json aos_scheduler::generateAppTuples(std::vector<std::string> app_ids, std::vec
     }
     return app_tuples;
 }
+
+app_demand_t aos_scheduler::generateAppDemand(std::vector<std::string> app_ids, std::vector<uint32_t> app_counts) const {
+    app_demand_t app_demand;
+    int idx = 0;
+    for (auto & app_id_ : app_ids) {
+        const int32_t app_idx = getAppIdx(app_id_);
+        // Unknown apps get an index past every image, nothing can fit them
+        const uint32_t dense_idx = (app_idx == -1) ? (uint32_t)app_idx_to_id.size() : (uint32_t)app_idx;
+        app_demand.push_back(std::make_pair(dense_idx, app_counts[idx]));
+        idx++;
+    }
+    return app_demand;
+}
+
+uint32_t aos_scheduler::getNumImages() const {
+    return image_descriptors.size();
+}
+
+const ImageDescriptor & aos_scheduler::getImageDescriptor(uint32_t image_idx) const {
+    assert(image_idx < image_descriptors.size());
+    return image_descriptors[image_idx];
+}
+
+int32_t aos_scheduler::getAppIdx(const std::string & app_id) const {
+    auto app_it = app_id_to_idx.find(app_id);
+    if (app_it == app_id_to_idx.end()) {
+        return -1;
+    }
+    return app_it->second;
+}
+
+const std::string & aos_scheduler::getAppIdByIdx(uint32_t app_idx) const {
+    assert(app_idx < app_idx_to_id.size());
+    return app_idx_to_id[app_idx];
+}
+
+int32_t aos_scheduler::getCurrentImageIdx(uint64_t fpga_id) const {
+    assert(fpga_id < num_fpga);
+    return current_image[fpga_id];
+}
+
+uint32_t aos_scheduler::internAppId(const std::string & app_id) {
+    auto app_it = app_id_to_idx.find(app_id);
+    if (app_it != app_id_to_idx.end()) {
+        return app_it->second;
+    }
+    const uint32_t app_idx = app_idx_to_id.size();
+    app_id_to_idx[app_id] = app_idx;
+    app_idx_to_id.push_back(app_id);
+    images_with_app.push_back(std::vector<uint32_t>());
+    AppArrivalStats arrivals;
+    memset(&arrivals, 0, sizeof(AppArrivalStats));
+    app_arrivals.push_back(arrivals);
+    return app_idx;
+}
+
+/*
+    Builds the typed descriptor for an image that was just appended to the
+    json library and adds it to the inverted index
+*/
+void aos_scheduler::addImageDescriptor(json & image) {
+    const uint32_t image_idx = image_descriptors.size();
+
+    ImageDescriptor descriptor;
+    descriptor.agfi = image["agfi"];
+    if (image.find("afi") != image.end()) {
+        descriptor.afi = image["afi"];
+    }
+    if (image.find("description") != image.end()) {
+        descriptor.description = image["description"];
+    }
+    descriptor.num_slots = image["num_slots"];
+
+    std::map<uint64_t, uint64_t> slot_base_map = getSlotBAR1BaseMap(image);
+    std::map<uint64_t, uint64_t> slot_size_map = getSlotBAR1SizeMap(image);
+
+    for (auto & slot : image["slots"]) {
+        SlotDescriptor slot_descriptor;
+        slot_descriptor.slot_id   = slot["slot_id"];
+        slot_descriptor.app_idx   = internAppId(slot["app_id"]);
+        slot_descriptor.bar1_base = slot_base_map[slot_descriptor.slot_id];
+        slot_descriptor.bar1_size = slot_size_map[slot_descriptor.slot_id];
+        slot_descriptor.throughput = DEFAULT_SLOT_THROUGHPUT;
+        if (slot.find("throughput") != slot.end()) {
+            slot_descriptor.throughput = slot["throughput"];
+        }
+        descriptor.slots.push_back(slot_descriptor);
+
+        if (descriptor.app_counts.size() <= slot_descriptor.app_idx) {
+            descriptor.app_counts.resize(slot_descriptor.app_idx + 1, 0);
+            descriptor.app_throughput.resize(slot_descriptor.app_idx + 1, 0.0);
+        }
+        descriptor.app_throughput[slot_descriptor.app_idx] = std::max(descriptor.app_throughput[slot_descriptor.app_idx], slot_descriptor.throughput);
+        if (descriptor.app_counts[slot_descriptor.app_idx] == 0) {
+            images_with_app[slot_descriptor.app_idx].push_back(image_idx);
+        }
+        descriptor.app_counts[slot_descriptor.app_idx]++;
+    }
+
+    agfi_to_image_idx[descriptor.agfi] = image_idx;
+    image_descriptors.push_back(descriptor);
+    image_load_latency_ns.push_back(0);
+}
+
+/*
+    App tuples asking for an app that isn't in any image can never be
+    satisfied, returns false in that case
+*/
+bool aos_scheduler::convertAppTuplesToDemand(json & app_tuples, app_demand_t & app_demand) const {
+    app_demand.clear();
+    for (auto & app_id : app_tuples.items()) {
+        const int32_t app_idx = getAppIdx(app_id.key());
+        if (app_idx == -1) {
+            return false;
+        }
+        uint32_t count = app_id.value()["count"];
+        app_demand.push_back(std::make_pair((uint32_t)app_idx, count));
+    }
+    return true;
+}
+
+uint32_t aos_scheduler::getNumApps() const {
+    return app_idx_to_id.size();
+}
+
+uint64_t aos_scheduler::getImageLoadLatency(uint32_t image_idx) const {
+    assert(image_idx < image_load_latency_ns.size());
+    if (image_load_latency_ns[image_idx] == 0) {
+        return DEFAULT_IMAGE_LOAD_LATENCY_NS;
+    }
+    return image_load_latency_ns[image_idx];
+}
+
+void aos_scheduler::recordImageLoadLatency(uint32_t image_idx, uint64_t latency_ns) {
+    assert(image_idx < image_load_latency_ns.size());
+    uint64_t & current = image_load_latency_ns[image_idx];
+    if (current == 0) {
+        current = latency_ns;
+    } else {
+        current = ((current * (256 - IMAGE_LOAD_LATENCY_EWMA_WEIGHT)) + (latency_ns * IMAGE_LOAD_LATENCY_EWMA_WEIGHT)) / 256;
+    }
+}
+
+void aos_scheduler::recordSessionArrival(const std::string & app_id, uint64_t now_ns) {
+    const int32_t app_idx = getAppIdx(app_id);
+    if (app_idx == -1) {
+        return;
+    }
+    AppArrivalStats & arrivals = app_arrivals[app_idx];
+    if (arrivals.num_arrivals > 0) {
+        const uint64_t gap_ns = now_ns - arrivals.last_arrival_ns;
+        if (arrivals.num_arrivals == 1) {
+            arrivals.ewma_interarrival_ns = gap_ns;
+        } else {
+            arrivals.ewma_interarrival_ns = ((arrivals.ewma_interarrival_ns * (256 - ARRIVAL_EWMA_WEIGHT)) + (gap_ns * ARRIVAL_EWMA_WEIGHT)) / 256;
+        }
+    }
+    arrivals.num_arrivals++;
+    arrivals.last_arrival_ns = now_ns;
+}
+
+/*
+    The next session of an app is expected one average gap after the last
+    one. Needs two arrivals to know the gap, and gives up on apps that have
+    been quiet for ARRIVAL_STALE_GAPS gaps.
+*/
+bool aos_scheduler::getPredictedArrival(uint32_t app_idx, uint64_t now_ns, uint64_t & predicted_ns) const {
+    assert(app_idx < app_arrivals.size());
+    const AppArrivalStats & arrivals = app_arrivals[app_idx];
+    if (arrivals.num_arrivals < 2) {
+        return false;
+    }
+    if ((now_ns - arrivals.last_arrival_ns) > (ARRIVAL_STALE_GAPS * arrivals.ewma_interarrival_ns)) {
+        return false;
+    }
+    predicted_ns = arrivals.last_arrival_ns + arrivals.ewma_interarrival_ns;
+    return true;
+}
+
+std::vector<std::pair<uint64_t, uint32_t>> aos_scheduler::getPredictedArrivals(uint64_t now_ns, uint64_t horizon_ns) const {
+    std::vector<std::pair<uint64_t, uint32_t>> predicted;
+    for (uint32_t app_idx = 0; app_idx < app_arrivals.size(); app_idx++) {
+        uint64_t predicted_ns;
+        if (getPredictedArrival(app_idx, now_ns, predicted_ns) && (predicted_ns <= (now_ns + horizon_ns))) {
+            predicted.push_back(std::make_pair(predicted_ns, app_idx));
+        }
+    }
+    std::sort(predicted.begin(), predicted.end());
+    return predicted;
+}
@@ -0,0 +1,521 @@
+#include "aos_daemon.h"
+#include <functional>
+#include <random>
+#include <sstream>
+
+/*
+    Offline discrete event simulator. Replays a session trace against the
+    real aos_scheduler and aos_host scheduling logic in simulated mode,
+    on a virtual clock and without sockets or worker threads, so policies
+    can be compared on millions of sessions without an F1 instance.
+
+    A session arrives, issues num_ops ops spread evenly over duration_ns
+    and ends. Every op needs the session bound to a slot, an op that finds
+    it unbound (not yet scheduled, or evicted since) goes through
+    handleScheduling exactly like a client request would, and waits for a
+    reconfiguration or for admission when scheduling says so.
+*/
+
+// One session of a trace
+struct sim_session_trace {
+    std::string app_id;
+    uint64_t arrival_ns;
+    uint64_t num_ops;
+    uint64_t duration_ns; // think time between the ops, spread evenly
+};
+
+enum SIM_EVENT {
+    SESSION_ARRIVAL,
+    SESSION_OP,
+    RECONFIG_DUE,
+    ADMISSION_RECHECK
+};
+
+struct sim_event {
+    uint64_t time_ns;
+    uint64_t seq; // keeps events at the same time in the order they were queued
+    SIM_EVENT type;
+    uint64_t id;  // trace index or FPGA id
+
+    bool operator>(const sim_event & other) const {
+        return (time_ns > other.time_ns) || ((time_ns == other.time_ns) && (seq > other.seq));
+    }
+};
+
+struct sim_session_state {
+    session_id_t session_id;
+    uint64_t ops_left;
+    bool waiting;
+    uint64_t wait_start_ns;
+    uint64_t wait_ns;   // total time its ops spent waiting for a slot
+    uint64_t finish_ns;
+};
+
+struct sim_config {
+    uint64_t num_fpga;
+    std::string images_json;
+    uint64_t load_latency_ns;
+    uint64_t mmio_ns;
+    EVICTION_POLICY slot_policy;
+    EVICTION_POLICY fpga_policy;
+    uint64_t hysteresis_ns;
+    uint64_t slot_residency_ns;
+    uint64_t image_residency_ns;
+    std::string sessions_csv;
+};
+
+class aos_host_simulator {
+public:
+
+    aos_host_simulator(const sim_config & sim_cfg, std::vector<sim_session_trace> & session_trace) :
+        cfg(sim_cfg),
+        trace(session_trace),
+        clock_ns(1), // 0 means "never" to the session bookkeeping
+        next_seq(0),
+        next_arrival(0),
+        recheck_pending(false),
+        next_fleet_recheck_ns(0),
+        bound_slot_ns(0),
+        available_slot_ns(0),
+        num_loads(0),
+        num_cancelled_loads(0),
+        num_rejected(0)
+    {
+        setVirtualClock(&clock_ns);
+        host = new aos_host(cfg.num_fpga, false, true);
+        host->parseImagesJson(cfg.images_json);
+        host->setVirtualReconfiguration(true);
+        host->setVerboseScheduling(false);
+        host->setEvictionPolicies(cfg.slot_policy, cfg.fpga_policy);
+        host->setAdmissionControl(cfg.hysteresis_ns, cfg.slot_residency_ns, cfg.image_residency_ns);
+        host->setSimulatedLoadLatency(0);
+        for (uint64_t fpga_id = 0; fpga_id < cfg.num_fpga; fpga_id++) {
+            host->loadDefaultImage(fpga_id);
+        }
+        host->setSimulatedLoadLatency(cfg.load_latency_ns);
+
+        std::stable_sort(trace.begin(), trace.end(), [](const sim_session_trace & a, const sim_session_trace & b) {
+            return a.arrival_ns < b.arrival_ns;
+        });
+        state.resize(trace.size());
+        fpga_waiters.resize(cfg.num_fpga);
+        scheduled_due_ns.assign(cfg.num_fpga, 0);
+    }
+
+    ~aos_host_simulator() {
+        delete host;
+        setVirtualClock(nullptr);
+    }
+
+    void run() {
+        pushNextArrival();
+        while (!events.empty()) {
+            const sim_event event = events.top();
+            events.pop();
+            advanceClock(event.time_ns);
+
+            switch (event.type) {
+                case SIM_EVENT::SESSION_ARRIVAL : handleArrival(event.id); break;
+                case SIM_EVENT::SESSION_OP : handleOp(event.id); break;
+                case SIM_EVENT::RECONFIG_DUE : handleReconfigDue(event.id, event.time_ns); break;
+                case SIM_EVENT::ADMISSION_RECHECK : {
+                    recheck_pending = false;
+                    releaseAdmissionWaiters();
+                }
+                break;
+            }
+
+            // What the daemon does after every event, in the same order
+            if (host->admission_replay_pending) {
+                host->admission_replay_pending = false;
+                releaseAdmissionWaiters();
+            }
+            // The daemon's timer runs the fleet passes every FLEET_RECHECK_NS even if nothing changed
+            if (clock_ns >= next_fleet_recheck_ns) {
+                host->fleet_changed = true;
+                next_fleet_recheck_ns = clock_ns + FLEET_RECHECK_NS;
+            }
+            host->runFleetPasses();
+            scheduleReconfigurations();
+            if (!admission_waiters.empty() && !recheck_pending) {
+                recheck_pending = true;
+                pushEvent(clock_ns + ADMISSION_RECHECK_NS, SIM_EVENT::ADMISSION_RECHECK, 0);
+            }
+        }
+    }
+
+    void report(double wall_seconds) {
+        uint64_t first_arrival_ns = trace.empty() ? 0 : trace.front().arrival_ns;
+        uint64_t last_finish_ns = first_arrival_ns;
+        std::vector<uint64_t> waits;
+        waits.reserve(state.size());
+        uint64_t total_wait_ns = 0;
+        for (auto & session : state) {
+            last_finish_ns = std::max(last_finish_ns, session.finish_ns);
+            waits.push_back(session.wait_ns);
+            total_wait_ns += session.wait_ns;
+        }
+        std::sort(waits.begin(), waits.end());
+        auto percentile = [&](double fraction) -> double {
+            if (waits.empty()) {
+                return 0.0;
+            }
+            const size_t idx = std::min(waits.size() - 1, (size_t)(fraction * (double)waits.size()));
+            return (double)waits[idx] / 1e6;
+        };
+
+        uint64_t speculative_loads, speculative_hits, speculative_cancels;
+        host->getSpeculationStats(speculative_loads, speculative_hits, speculative_cancels);
+        const aos_admission_stats admission = host->getAdmissionStats();
+        uint64_t num_migrations, migration_ns;
+        host->getMigrationStats(num_migrations, migration_ns);
+        uint64_t num_to_single, num_to_shared;
+        host->getModeSwitchStats(num_to_single, num_to_shared);
+
+        std::cout << "Sessions:             " << trace.size() << " on " << cfg.num_fpga << " FPGAs, " << num_rejected << " rejected" << std::endl;
+        std::cout << "Makespan:             " << ((double)(last_finish_ns - first_arrival_ns) / 1e9) << " s" << std::endl;
+        std::cout << "Slot utilization:     " << ((available_slot_ns == 0) ? 0.0 : (100.0 * (double)bound_slot_ns / (double)available_slot_ns)) << " %" << std::endl;
+        std::cout << "Reconfigurations:     " << num_loads << " loads, " << num_cancelled_loads << " cancelled, "
+                  << host->getNumAvoidedReconfigurations() << " avoided" << std::endl;
+        std::cout << "Speculative loads:    " << speculative_loads << ", " << speculative_hits << " hits, " << speculative_cancels << " cancelled" << std::endl;
+        std::cout << "Evictions:            " << admission.num_slot_evictions << " slot, " << admission.num_fpga_evictions << " FPGA, "
+                  << admission.num_evicted_sessions << " sessions" << std::endl;
+        std::cout << "Migrations:           " << num_migrations << std::endl;
+        std::cout << "Mode switches:        " << num_to_single << " to single tenant, " << num_to_shared << " to shared" << std::endl;
+        const aos_preemption_stats preemption = host->getPreemptionStats();
+        std::cout << "Data locality:        " << host->getNumLocalRebinds() << " local rebinds, " << preemption.resident_bytes << " bytes left in place, "
+                  << preemption.restored_bytes << " written back" << std::endl;
+        std::cout << "Session wait (ms):    mean " << (state.empty() ? 0.0 : ((double)total_wait_ns / (double)state.size() / 1e6))
+                  << " p50 " << percentile(0.50) << " p99 " << percentile(0.99)
+                  << " max " << (waits.empty() ? 0.0 : ((double)waits.back() / 1e6)) << std::endl;
+        std::cout << "Simulated in:         " << wall_seconds << " s" << std::endl << std::flush;
+
+        if (!cfg.sessions_csv.empty()) {
+            std::ofstream out(cfg.sessions_csv);
+            out << "app_id,arrival_ns,num_ops,duration_ns,wait_ns,finish_ns" << std::endl;
+            for (size_t idx = 0; idx < trace.size(); idx++) {
+                out << trace[idx].app_id << "," << trace[idx].arrival_ns << "," << trace[idx].num_ops << ","
+                    << trace[idx].duration_ns << "," << state[idx].wait_ns << "," << state[idx].finish_ns << std::endl;
+            }
+        }
+    }
+
+private:
+
+    const sim_config cfg;
+    std::vector<sim_session_trace> & trace;
+    aos_host * host;
+    uint64_t clock_ns;
+
+    std::priority_queue<sim_event, std::vector<sim_event>, std::greater<sim_event>> events;
+    uint64_t next_seq;
+    uint64_t next_arrival; // arrivals are queued one at a time, the trace is sorted
+
+    std::vector<sim_session_state> state;
+    std::vector<std::vector<uint64_t>> fpga_waiters; // per FPGA, sessions waiting on its reconfiguration
+    aos_admission_queue<uint64_t> admission_waiters;
+    bool recheck_pending;
+    uint64_t next_fleet_recheck_ns;
+    std::vector<uint64_t> scheduled_due_ns; // per FPGA, the RECONFIG_DUE event that counts
+
+    // Metrics
+    uint64_t bound_slot_ns;
+    uint64_t available_slot_ns;
+    uint64_t num_loads;
+    uint64_t num_cancelled_loads;
+    uint64_t num_rejected; // sessions of apps not in the library
+
+    void pushEvent(uint64_t time_ns, SIM_EVENT type, uint64_t id) {
+        sim_event event;
+        event.time_ns = time_ns;
+        event.seq     = next_seq++;
+        event.type    = type;
+        event.id      = id;
+        events.push(event);
+    }
+
+    void pushNextArrival() {
+        if (next_arrival < trace.size()) {
+            pushEvent(std::max(clock_ns, trace[next_arrival].arrival_ns), SIM_EVENT::SESSION_ARRIVAL, next_arrival);
+            next_arrival++;
+        }
+    }
+
+    // Slot occupancy is integrated between events
+    void advanceClock(uint64_t time_ns) {
+        if (time_ns <= clock_ns) {
+            return;
+        }
+        const uint64_t delta_ns = time_ns - clock_ns;
+        uint64_t bound = 0;
+        uint64_t available = 0;
+        for (uint64_t fpga_id = 0; fpga_id < cfg.num_fpga; fpga_id++) {
+            if (host->isFPGAReconfiguring(fpga_id)) {
+                continue;
+            }
+            bound     += host->calcFPGALoad(fpga_id);
+            available += host->slot_session_map[fpga_id].size();
+        }
+        bound_slot_ns     += delta_ns * bound;
+        available_slot_ns += delta_ns * available;
+        clock_ns = time_ns;
+    }
+
+    void handleArrival(uint64_t idx) {
+        sim_session_state & session = state[idx];
+        session.ops_left      = std::max((uint64_t)1, trace[idx].num_ops);
+        session.waiting       = false;
+        session.wait_start_ns = 0;
+        session.wait_ns       = 0;
+        session.finish_ns     = clock_ns;
+        pushNextArrival();
+        // The daemon turns these away at INTIATE_SESSION
+        if (!host->appIdExists(trace[idx].app_id)) {
+            num_rejected++;
+            return;
+        }
+        session.session_id = host->openSession(trace[idx].app_id, true);
+        pushEvent(clock_ns, SIM_EVENT::SESSION_OP, idx);
+    }
+
+    void handleOp(uint64_t idx) {
+        sim_session_state & session = state[idx];
+        if (session.ops_left == 0) {
+            host->closeSession(session.session_id);
+            session.finish_ns = clock_ns;
+            return;
+        }
+
+        aos_app_session * const session_ptr = host->sessions[session.session_id];
+        if (!session_ptr->boundToSlot()) {
+            uint64_t wait_fpga_id = ~0x0;
+            if (!host->handleScheduling(session.session_id, wait_fpga_id)) {
+                if (!session.waiting) {
+                    session.waiting = true;
+                    session.wait_start_ns = clock_ns;
+                }
+                if (wait_fpga_id < cfg.num_fpga) {
+                    fpga_waiters[wait_fpga_id].push_back(idx);
+                } else {
+                    // Admission, or nothing to wait on at all, either way try again later
+                    admission_waiters.push(trace[idx].app_id, idx);
+                }
+                return;
+            }
+        }
+        if (session.waiting) {
+            session.waiting = false;
+            session.wait_ns += clock_ns - session.wait_start_ns;
+        }
+
+        // The op itself, accounted like recordSessionAccess
+        session_ptr->recordAccess(clock_ns, sizeof(uint64_t));
+        host->slot_access_stats[session_ptr->getFPGAId()][session_ptr->getSlotId()].recordAccess(clock_ns, sizeof(uint64_t));
+        const uint64_t think_ns = trace[idx].duration_ns / std::max((uint64_t)1, trace[idx].num_ops);
+        session.ops_left--;
+        pushEvent(clock_ns + cfg.mmio_ns + think_ns, SIM_EVENT::SESSION_OP, idx);
+    }
+
+    void handleReconfigDue(uint64_t fpga_id, uint64_t due_ns) {
+        if (!host->isFPGAReconfiguring(fpga_id) || (scheduled_due_ns[fpga_id] != due_ns)) {
+            return;
+        }
+        host->handleReconfigurationDone(fpga_id);
+        if (host->reconfig_result[fpga_id] == RECONFIG_CANCELLED) {
+            num_cancelled_loads++;
+        } else {
+            num_loads++;
+        }
+        // Replayed right away, like the daemon does with parked requests, before anything else can grab the FPGA
+        std::vector<uint64_t> waiters;
+        waiters.swap(fpga_waiters[fpga_id]);
+        for (auto & idx : waiters) {
+            handleOp(idx);
+        }
+    }
+
+    // Queue a RECONFIG_DUE for every load in flight, a cancelled load is due right away
+    void scheduleReconfigurations() {
+        for (uint64_t fpga_id = 0; fpga_id < cfg.num_fpga; fpga_id++) {
+            if (!host->isFPGAReconfiguring(fpga_id)) {
+                scheduled_due_ns[fpga_id] = 0;
+                continue;
+            }
+            uint64_t due_ns = host->reconfig_done_ns[fpga_id];
+            if (host->sched->isReconfigurationCancelled(fpga_id)) {
+                due_ns = std::min(due_ns, clock_ns);
+            }
+            if (scheduled_due_ns[fpga_id] != due_ns) {
+                scheduled_due_ns[fpga_id] = due_ns;
+                pushEvent(due_ns, SIM_EVENT::RECONFIG_DUE, fpga_id);
+            }
+        }
+    }
+
+    void releaseAdmissionWaiters() {
+        admission_waiters.replay([this](uint64_t idx) {
+            handleOp(idx);
+        });
+    }
+
+};
+
+// app_id,arrival_ns,num_ops,duration_ns per line, # starts a comment
+static bool readTrace(const std::string & file_name, std::vector<sim_session_trace> & trace) {
+    std::ifstream in(file_name);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream fields(line);
+        sim_session_trace session;
+        if (fields >> session.app_id >> session.arrival_ns >> session.num_ops >> session.duration_ns) {
+            trace.push_back(session);
+        }
+    }
+    return true;
+}
+
+// Poisson arrivals spread uniformly over the apps in the library, exponential durations
+static void generateTrace(aos_scheduler & sched, uint64_t num_sessions, double rate_per_s, uint64_t num_ops,
+                          uint64_t mean_duration_ns, uint64_t seed, std::vector<sim_session_trace> & trace) {
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap_s(rate_per_s);
+    std::exponential_distribution<double> duration_ns(1.0 / (double)std::max((uint64_t)1, mean_duration_ns));
+    std::uniform_int_distribution<uint32_t> app(0, sched.getNumApps() - 1);
+    double arrival_s = 0.0;
+    trace.reserve(num_sessions);
+    for (uint64_t idx = 0; idx < num_sessions; idx++) {
+        arrival_s += gap_s(rng);
+        sim_session_trace session;
+        session.app_id      = sched.getAppIdByIdx(app(rng));
+        session.arrival_ns  = (uint64_t)(arrival_s * 1e9);
+        session.num_ops     = num_ops;
+        session.duration_ns = (uint64_t)duration_ns(rng);
+        trace.push_back(session);
+    }
+}
+
+static void usage() {
+    printf("Usage: ./aos_sim <num_fpga> <fpga_images_json> (--trace <csv> | --synthetic <num_sessions>) [options]\n"
+           "  --rate <sessions/s>          synthetic arrival rate (default 100)\n"
+           "  --ops <n>                    synthetic ops per session (default 16)\n"
+           "  --duration-ms <ms>           synthetic mean session duration (default 100)\n"
+           "  --seed <n>                   synthetic trace seed (default 1)\n"
+           "  --load-ms <ms>               image load latency (default 5000)\n"
+           "  --mmio-ns <ns>               cost of one op (default 2000)\n"
+           "  --slot-policy <policy>       lru, least_load or least_recent_bytes (default lru)\n"
+           "  --fpga-policy <policy>       lru, least_load or least_recent_bytes (default least_load)\n"
+           "  --hysteresis-ms <ms>         admission hysteresis (default 20)\n"
+           "  --slot-residency-ms <ms>     minimum slot residency (default 50)\n"
+           "  --image-residency-ms <ms>    minimum image residency (default 500)\n"
+           "  --sessions-csv <file>        per session wait and finish times\n");
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 4) {
+        usage();
+        exit(EXIT_SUCCESS);
+    }
+
+    sim_config cfg;
+    cfg.num_fpga           = std::stoull(argv[1]);
+    cfg.images_json        = argv[2];
+    cfg.load_latency_ns    = DEFAULT_IMAGE_LOAD_LATENCY_NS;
+    cfg.mmio_ns            = 2000;
+    cfg.slot_policy        = EVICTION_POLICY::LRU;
+    cfg.fpga_policy        = EVICTION_POLICY::LEAST_LOAD;
+    cfg.hysteresis_ns      = DEFAULT_EVICTION_HYSTERESIS_NS;
+    cfg.slot_residency_ns  = DEFAULT_MIN_SLOT_RESIDENCY_NS;
+    cfg.image_residency_ns = DEFAULT_MIN_IMAGE_RESIDENCY_NS;
+
+    std::string trace_file;
+    uint64_t num_synthetic = 0;
+    double rate_per_s = 100.0;
+    uint64_t num_ops = 16;
+    uint64_t mean_duration_ns = 100ULL * 1000 * 1000;
+    uint64_t seed = 1;
+    const uint64_t ms = 1000ULL * 1000;
+
+    for (int arg_idx = 3; arg_idx < argc; arg_idx++) {
+        const std::string arg = argv[arg_idx];
+        if (arg_idx + 1 >= argc) {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        const std::string value = argv[++arg_idx];
+        if (arg == "--trace") {
+            trace_file = value;
+        } else if (arg == "--synthetic") {
+            num_synthetic = std::stoull(value);
+        } else if (arg == "--rate") {
+            rate_per_s = std::stod(value);
+        } else if (arg == "--ops") {
+            num_ops = std::stoull(value);
+        } else if (arg == "--duration-ms") {
+            mean_duration_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--seed") {
+            seed = std::stoull(value);
+        } else if (arg == "--load-ms") {
+            cfg.load_latency_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--mmio-ns") {
+            cfg.mmio_ns = std::stoull(value);
+        } else if (arg == "--slot-policy") {
+            if (!parseEvictionPolicy(value, cfg.slot_policy)) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--fpga-policy") {
+            if (!parseEvictionPolicy(value, cfg.fpga_policy)) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        } else if (arg == "--hysteresis-ms") {
+            cfg.hysteresis_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--slot-residency-ms") {
+            cfg.slot_residency_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--image-residency-ms") {
+            cfg.image_residency_ns = (uint64_t)(std::stod(value) * ms);
+        } else if (arg == "--sessions-csv") {
+            cfg.sessions_csv = value;
+        } else {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    std::vector<sim_session_trace> trace;
+    if (!trace_file.empty()) {
+        if (!readTrace(trace_file, trace)) {
+            printf("Unable to read trace %s\n", trace_file.c_str());
+            exit(EXIT_FAILURE);
+        }
+    } else if (num_synthetic > 0) {
+        aos_scheduler library(1);
+        library.parseImages(cfg.images_json);
+        generateTrace(library, num_synthetic, rate_per_s, num_ops, mean_duration_ns, seed, trace);
+    } else {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    // Keep the scheduler's log out of the report
+    setLogLevel(LEVEL_OFF);
+    const auto wall_start = std::chrono::steady_clock::now();
+    double wall_seconds = 0.0;
+    {
+        aos_host_simulator simulator(cfg, trace);
+        simulator.run();
+        wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        simulator.report(wall_seconds);
+    }
+
+    exit(EXIT_SUCCESS);
+
+}
@@ -0,0 +1,87 @@
+#include "aos.h"
+#include "json.hpp"
+#include <iomanip>
+#include <fstream>
+
+using json = nlohmann::json;
+
+// Dumps what the daemon's GET_STATS command reports, --json prints it as received.
+// --trace <file> saves the daemon's recent spans for chrome://tracing or ui.perfetto.dev instead.
+int main(int argc, char *argv[]) {
+
+    const bool raw = (argc == 2) && (std::string(argv[1]) == "--json");
+    const bool trace = (argc == 3) && (std::string(argv[1]) == "--trace");
+    if (!((argc == 1) || raw || trace)) {
+        printf("Usage: ./aos_stats [--json | --trace <trace_json>]\n");
+        exit(EXIT_SUCCESS);
+    }
+
+    aos_client client_handle = aos_client("aos_stats");
+    if (trace) {
+        std::string trace_json;
+        if (client_handle.aos_get_trace(trace_json) != aos_errcode::SUCCESS) {
+            printf("Unable to get the trace from the daemon\n");
+            return -1;
+        }
+        std::ofstream trace_file(argv[2]);
+        trace_file << trace_json;
+        if (!trace_file) {
+            printf("Unable to write %s\n", argv[2]);
+            return -1;
+        }
+        return 0;
+    }
+
+    std::string stats_json;
+    if (client_handle.aos_get_stats(stats_json) != aos_errcode::SUCCESS) {
+        printf("Unable to get stats from the daemon\n");
+        return -1;
+    }
+    if (raw) {
+        std::cout << stats_json << std::endl;
+        return 0;
+    }
+
+    const json stats = json::parse(stats_json);
+    std::cout << "Uptime: " << ((double)stats["uptime_ns"].get<uint64_t>() / 1e9) << " s" << std::endl << std::endl;
+
+    std::cout << std::left << std::setw(28) << "Command" << std::setw(12) << "Stage" << std::right
+              << std::setw(10) << "Count" << std::setw(12) << "Mean ns" << std::setw(12) << "p50 ns" << std::setw(12) << "p90 ns"
+              << std::setw(12) << "p99 ns" << std::setw(12) << "p99.9 ns" << std::setw(12) << "Max ns" << std::endl;
+    for (auto & entry : stats["latency"]) {
+        std::cout << std::left << std::setw(28) << entry["command"].get<std::string>() << std::setw(12) << entry["stage"].get<std::string>() << std::right
+                  << std::setw(10) << entry["count"].get<uint64_t>() << std::setw(12) << entry["mean_ns"].get<uint64_t>()
+                  << std::setw(12) << entry["p50_ns"].get<uint64_t>() << std::setw(12) << entry["p90_ns"].get<uint64_t>()
+                  << std::setw(12) << entry["p99_ns"].get<uint64_t>() << std::setw(12) << entry["p999_ns"].get<uint64_t>()
+                  << std::setw(12) << entry["max_ns"].get<uint64_t>() << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(12) << "Session" << std::setw(24) << "App" << std::setw(12) << "FPGA/slot" << std::right
+              << std::setw(12) << "Ops" << std::setw(16) << "Bytes" << std::endl;
+    for (auto & entry : stats["sessions"]) {
+        std::string placement = "-";
+        if (entry["bound"].get<bool>()) {
+            placement = std::to_string(entry["fpga_id"].get<uint64_t>()) + "/" + std::to_string(entry["slot_id"].get<uint64_t>());
+        }
+        std::cout << std::left << std::setw(12) << entry["session_id"].get<uint64_t>() << std::setw(24) << entry["app_id"].get<std::string>()
+                  << std::setw(12) << placement << std::right << std::setw(12) << entry["num_ops"].get<uint64_t>()
+                  << std::setw(16) << entry["bytes"].get<uint64_t>() << std::endl;
+    }
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(8) << "FPGA" << std::setw(28) << "Image" << std::right << std::setw(10) << "Tenants"
+              << std::setw(12) << "Ops" << std::setw(16) << "Bytes" << std::endl;
+    for (auto & entry : stats["fpgas"]) {
+        std::string image = entry["image"].get<std::string>();
+        if (entry["reconfiguring"].get<bool>()) {
+            image += " (loading)";
+        }
+        std::cout << std::left << std::setw(8) << entry["fpga_id"].get<uint64_t>() << std::setw(28) << image << std::right
+                  << std::setw(10) << entry["tenants"].get<uint64_t>() << std::setw(12) << entry["num_ops"].get<uint64_t>()
+                  << std::setw(16) << entry["bytes"].get<uint64_t>() << std::endl;
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,432 @@
+#include "aos_daemon.h"
+
+// One scrape of the metrics exporter, what a Prometheus server would see
+static std::string scrapeMetrics(const char * socket_path) {
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    assert(fd != -1);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(sockaddr_un));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    assert(connect(fd, (const sockaddr *)&addr, sizeof(sockaddr_un)) == 0);
+    const std::string request = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    assert(write(fd, request.data(), request.size()) == (ssize_t)request.size());
+    std::string response;
+    char buf[4096];
+    ssize_t num_read;
+    while ((num_read = read(fd, buf, sizeof(buf))) > 0) {
+        response.append(buf, num_read);
+    }
+    close(fd);
+    return response;
+}
+
+// Value of the sample whose name and labels are exactly series
+static uint64_t getMetricValue(const std::string & metrics, const std::string & series) {
+    const size_t pos = metrics.find("\n" + series + " ");
+    assert(pos != std::string::npos);
+    return std::stoull(metrics.substr(pos + series.size() + 2));
+}
+
+// One FPGA keeps serving a tenant while the other loads a new image
+int main(int argc, char *argv[]) {
+
+    // Image library in the test's directory, or the one given
+    std::string images_json = "test_fpga_images.json";
+    if (argc > 1) {
+        images_json = argv[1];
+    }
+
+    const uint64_t num_fpga = 2;
+    const uint64_t load_latency_ns = 2ULL * 1000 * 1000 * 1000;
+
+    aos_host host(num_fpga, false, true);
+    host.parseImagesJson(images_json);
+    host.setSimulatedLoadLatency(0);
+    for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+        host.loadDefaultImage(fpga_id);
+    }
+
+    unlink(SOCKET_NAME);
+    host.init_socket();
+    const char * metrics_socket = "/tmp/aos_metrics_test.socket";
+    assert(host.startMetricsExporter(metrics_socket) == 0);
+    // Another daemon neither takes the live exporter's socket nor deletes a file that is not a socket
+    {
+        aos_host other(1, false, true);
+        assert(other.startMetricsExporter(metrics_socket) != 0);
+        const char * not_a_socket = "/tmp/aos_metrics_test.txt";
+        std::ofstream(not_a_socket) << "not a socket";
+        assert(other.startMetricsExporter(not_a_socket) != 0);
+        assert(access(not_a_socket, F_OK) == 0);
+        unlink(not_a_socket);
+    }
+    std::thread daemon(&aos_host::listen_loop, &host);
+    daemon.detach();
+
+    // Bind a tenant while loads are instant
+    aos_client steady("dnn_weaver_v0");
+    steady.aos_init_session();
+    assert(steady.aos_cntrlreg_write(0x0, 1) == aos_errcode::SUCCESS);
+
+    // A write to the app's done_reg stands in for its completion interrupt
+    int completion_fd = -1;
+    assert(steady.aos_completion_eventfd(completion_fd) == aos_errcode::SUCCESS);
+    const int completion_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event completion_event;
+    completion_event.events  = EPOLLIN;
+    completion_event.data.fd = completion_fd;
+    assert(epoll_ctl(completion_epoll_fd, EPOLL_CTL_ADD, completion_fd, &completion_event) == 0);
+    assert(epoll_wait(completion_epoll_fd, &completion_event, 1, 0) == 0);
+    assert(steady.aos_cntrlreg_write(0x18, 1) == aos_errcode::SUCCESS);
+    assert(epoll_wait(completion_epoll_fd, &completion_event, 1, 5000) == 1);
+    uint64_t num_completions = 0;
+    assert(read(completion_fd, &num_completions, sizeof(uint64_t)) == sizeof(uint64_t));
+    assert(num_completions == 1);
+    close(completion_epoll_fd);
+    close(completion_fd);
+
+    // A written non-volatile register is read back without MMIO, undeclared ones and declared ones never written reach BAR1
+    const aos_latency_histogram & read_mmio = host.getCommandLatency(aos_socket_command::CNTRLREG_READ_REQUEST, STAGE_MMIO);
+    uint64_t shadow_value = 0;
+    assert(steady.aos_cntrlreg_write(0x20, 21) == aos_errcode::SUCCESS);
+    const uint64_t mmio_reads_before = read_mmio.getCount();
+    assert(steady.aos_cntrlreg_read(0x20, shadow_value) == aos_errcode::SUCCESS);
+    assert(shadow_value == 21);
+    assert(read_mmio.getCount() == mmio_reads_before);
+    assert(steady.aos_cntrlreg_read(0x28, shadow_value) == aos_errcode::SUCCESS);
+    assert(read_mmio.getCount() == mmio_reads_before + 1);
+    assert(steady.aos_cntrlreg_read(0x0, shadow_value) == aos_errcode::SUCCESS);
+    assert(shadow_value == 1);
+    assert(read_mmio.getCount() == mmio_reads_before + 2);
+
+    // The default image has no memdrive, the mover needs the other FPGA reconfigured
+    host.setSimulatedLoadLatency(load_latency_ns);
+    std::atomic<bool> mover_done(false);
+    uint64_t mover_latency_ns = 0;
+    std::thread mover_thread([&]() {
+        aos_client mover("memdrive_v0");
+        // The load starts when the session arrives, before its first op
+        const uint64_t start_ns = monotonic_ns();
+        mover.aos_init_session();
+        assert(mover.aos_cntrlreg_write(0x0, 7) == aos_errcode::SUCCESS);
+        mover_latency_ns = monotonic_ns() - start_ns;
+        uint64_t value = 0;
+        assert(mover.aos_cntrlreg_read(0x0, value) == aos_errcode::SUCCESS);
+        assert(value == 7);
+        mover.aos_end_session();
+        mover_done = true;
+    });
+
+    uint64_t num_ops = 0;
+    uint64_t max_op_ns = 0;
+    while (!mover_done) {
+        const uint64_t start_ns = monotonic_ns();
+        uint64_t value = 0;
+        assert(steady.aos_cntrlreg_write(0x8, num_ops) == aos_errcode::SUCCESS);
+        assert(steady.aos_cntrlreg_read(0x8, value) == aos_errcode::SUCCESS);
+        assert(value == num_ops);
+        max_op_ns = std::max(max_op_ns, monotonic_ns() - start_ns);
+        num_ops++;
+    }
+    mover_thread.join();
+    steady.aos_end_session();
+
+    std::cout << "Reconfiguration took " << mover_latency_ns << " ns, "
+              << num_ops << " ops on the other FPGA meanwhile, worst " << max_op_ns << " ns" << std::endl;
+
+    // The mover waited for the load, the other tenant never did
+    assert(mover_latency_ns >= load_latency_ns);
+    assert(num_ops > 0);
+    assert(max_op_ns < (load_latency_ns / 10));
+    // The tenant's first op found its image already on an idle FPGA
+    assert(host.getNumAvoidedReconfigurations() >= 1);
+    // The mover's image was prefetched when its session arrived
+    uint64_t speculative_loads, speculative_hits, speculative_cancels;
+    host.getSpeculationStats(speculative_loads, speculative_hits, speculative_cancels);
+    assert(speculative_hits >= 1);
+
+    // Oversubscribed, two memdrive tenants and one memdrive slot free of the dnn tenant
+    host.setSimulatedLoadLatency(0);
+    aos_client holder("dnn_weaver_v0");
+    holder.aos_init_session();
+    assert(holder.aos_cntrlreg_write(0x0, 1) == aos_errcode::SUCCESS);
+    aos_client first("memdrive_v0");
+    first.aos_init_session();
+    assert(first.aos_cntrlreg_write(0x0, 1) == aos_errcode::SUCCESS);
+    // Dirties one page of its DRAM, which has to be saved when it is preempted
+    char first_data[64];
+    memset(first_data, 0x5A, sizeof(first_data));
+    assert(first.aos_bulkdata_write(DRAM_PAGE_BYTES, sizeof(first_data), first_data) == aos_errcode::SUCCESS);
+    // And a state register, read back from the slot when it is preempted
+    assert(first.aos_cntrlreg_write(0x40, 0x5A5A) == aos_errcode::SUCCESS);
+    const aos_admission_stats before = host.getAdmissionStats();
+
+    // A newcomer cannot take the slot right away, non-blocking it is told to retry
+    aos_client second("memdrive_v0");
+    second.setBlocking(false);
+    second.aos_init_session();
+    assert(second.aos_cntrlreg_write(0x0, 2) == aos_errcode::RETRY);
+
+    // Past the hysteresis and the tenant's residency quantum it may evict
+    std::this_thread::sleep_for(std::chrono::nanoseconds(DEFAULT_EVICTION_HYSTERESIS_NS + DEFAULT_MIN_SLOT_RESIDENCY_NS));
+    assert(second.aos_cntrlreg_write(0x0, 2) == aos_errcode::SUCCESS);
+
+    // The evicted tenant blocks in the admission queue for at least the hysteresis
+    const uint64_t queued_start_ns = monotonic_ns();
+    assert(first.aos_cntrlreg_write(0x0, 1) == aos_errcode::SUCCESS);
+    const uint64_t queued_ns = monotonic_ns() - queued_start_ns;
+    std::cout << "Evicted tenant was queued for " << queued_ns << " ns" << std::endl;
+    assert(queued_ns >= DEFAULT_EVICTION_HYSTERESIS_NS);
+
+    const aos_admission_stats after = host.getAdmissionStats();
+    assert(after.num_retries == before.num_retries + 1);
+    assert(after.num_queued >= before.num_queued + 1);
+    // The newcomer took the slot, the evicted tenant then either took it back or had an FPGA reflashed
+    assert(after.num_slot_evictions >= before.num_slot_evictions + 1);
+    assert(after.num_evicted_sessions == before.num_evicted_sessions + 2);
+    assert(after.max_wait_ns >= DEFAULT_EVICTION_HYSTERESIS_NS);
+    // The evicted tenant's state was captured and put back, and only the page it wrote came off the FPGA
+    aos_preemption_stats first_preemption;
+    assert(host.getSessionPreemptionStats(first.getSessionId(), first_preemption));
+    assert(first_preemption.num_saves == 1);
+    assert(first_preemption.num_restores == 1);
+    assert(first_preemption.saved_bytes == DRAM_PAGE_BYTES);
+    assert(host.getPreemptionStats().num_saves >= 2);
+    // What it wrote before it was preempted is what it finds again
+    uint64_t first_fpga_id, first_slot_id, first_bytes;
+    assert(host.getDataResidency(first.getSessionId(), first_fpga_id, first_slot_id, first_bytes));
+    char restored_data[sizeof(first_data)];
+    assert(host.dma_read_dram(first_fpga_id, first_slot_id, DRAM_PAGE_BYTES, restored_data, sizeof(restored_data)) == 0);
+    assert(memcmp(restored_data, first_data, sizeof(first_data)) == 0);
+    uint64_t restored_reg = 0;
+    assert(first.aos_cntrlreg_read(0x40, restored_reg) == aos_errcode::SUCCESS);
+    assert(restored_reg == 0x5A5A);
+    // The tenant reads the page back itself, and nothing is left queued for DMA afterwards
+    assert(first.aos_bulkdata_read(DRAM_PAGE_BYTES, sizeof(restored_data), restored_data) == aos_errcode::SUCCESS);
+    assert(memcmp(restored_data, first_data, sizeof(first_data)) == 0);
+    assert(host.getNumPendingDMAOperations() == 0);
+    assert(first.aos_bulkdata_read_response(restored_data) == aos_errcode::INVALID_REQUEST);
+    second.aos_end_session();
+    first.aos_end_session();
+    holder.aos_end_session();
+
+    // One dnn tenant on each FPGA, a memdrive tenant needs one reflashed and its dnn tenant moves to the other instead of being evicted
+    host.setAdmissionControl(0, 0, 0);
+    aos_client left("dnn_weaver_v0");
+    left.aos_init_session();
+    assert(left.aos_cntrlreg_write(0x0, 3) == aos_errcode::SUCCESS);
+    aos_client right("dnn_weaver_v0");
+    right.aos_init_session();
+    assert(right.aos_cntrlreg_write(0x0, 4) == aos_errcode::SUCCESS);
+    assert(left.aos_bulkdata_write(0, sizeof(first_data), first_data) == aos_errcode::SUCCESS);
+    assert(right.aos_bulkdata_write(0, sizeof(first_data), first_data) == aos_errcode::SUCCESS);
+    const aos_admission_stats before_migration = host.getAdmissionStats();
+    uint64_t migrations_before, migration_ns;
+    host.getMigrationStats(migrations_before, migration_ns);
+
+    aos_client newcomer("memdrive_v0");
+    newcomer.aos_init_session();
+    assert(newcomer.aos_cntrlreg_write(0x0, 5) == aos_errcode::SUCCESS);
+    // Both dnn tenants keep running, one of them on the other FPGA now
+    uint64_t value = 0;
+    assert(left.aos_cntrlreg_write(0x8, 6) == aos_errcode::SUCCESS);
+    assert(left.aos_cntrlreg_read(0x8, value) == aos_errcode::SUCCESS);
+    assert(value == 6);
+    assert(right.aos_cntrlreg_write(0x8, 7) == aos_errcode::SUCCESS);
+    assert(right.aos_cntrlreg_read(0x8, value) == aos_errcode::SUCCESS);
+    assert(value == 7);
+
+    uint64_t migrations_after;
+    host.getMigrationStats(migrations_after, migration_ns);
+    std::cout << "Migrated " << (migrations_after - migrations_before) << " sessions in " << migration_ns << " ns" << std::endl;
+    assert(migrations_after == migrations_before + 1);
+    assert(host.getAdmissionStats().num_evicted_sessions == before_migration.num_evicted_sessions);
+    // The migrated session's written page went along with it
+    aos_preemption_stats left_preemption, right_preemption;
+    assert(host.getSessionPreemptionStats(left.getSessionId(), left_preemption));
+    assert(host.getSessionPreemptionStats(right.getSessionId(), right_preemption));
+    assert((left_preemption.num_restores + right_preemption.num_restores) == 1);
+    assert((left_preemption.saved_bytes + right_preemption.saved_bytes) == DRAM_PAGE_BYTES);
+    newcomer.aos_end_session();
+    right.aos_end_session();
+    left.aos_end_session();
+
+    // The other FPGA is kept busy. Sessions end asynchronously, once this one is up the daemon is idle.
+    aos_client busy("memdrive_v0");
+    busy.aos_init_session();
+
+    // Add a single slot dnn image that runs twice as fast
+    const std::string single_json = "/tmp/aos_single_tenant_images.json";
+    std::ofstream single_file(single_json);
+    single_file << "{\"images\": [{\"description\": \"1 DNN fast\", \"agfi\": \"agfi-single-dnn\", \"afi\": \"afi-single-dnn\", \"num_slots\": 1,"
+                << " \"slots\": [{\"slot_id\": 0, \"app_id\": \"dnn_weaver_v0\", \"throughput\": 2.0}]}]}";
+    single_file.close();
+    host.parseImagesJson(single_json);
+    unlink(single_json.c_str());
+
+    assert(busy.aos_cntrlreg_write(0x0, 8) == aos_errcode::SUCCESS);
+    // A lone dnn tenant with nobody waiting gets the fast image, its next op waits for it
+    uint64_t to_single, to_shared;
+    host.getModeSwitchStats(to_single, to_shared);
+    const uint64_t to_single_before = to_single;
+    const uint64_t to_shared_before = to_shared;
+    aos_client solo("dnn_weaver_v0");
+    solo.aos_init_session();
+    assert(solo.aos_cntrlreg_write(0x0, 9) == aos_errcode::SUCCESS);
+    assert(solo.aos_cntrlreg_write(0x8, 10) == aos_errcode::SUCCESS);
+    assert(solo.aos_cntrlreg_read(0x8, value) == aos_errcode::SUCCESS);
+    assert(value == 10);
+    host.getModeSwitchStats(to_single, to_shared);
+    assert(to_single == to_single_before + 1);
+
+    // A second dnn session has nowhere to go, so the FPGA goes back to the shared image and both run there
+    host.setAdmissionControl(DEFAULT_EVICTION_HYSTERESIS_NS, 0, 0);
+    aos_client crowd("dnn_weaver_v0");
+    crowd.aos_init_session();
+    assert(crowd.aos_cntrlreg_write(0x0, 11) == aos_errcode::SUCCESS);
+    assert(solo.aos_cntrlreg_write(0x8, 12) == aos_errcode::SUCCESS);
+    assert(solo.aos_cntrlreg_read(0x8, value) == aos_errcode::SUCCESS);
+    assert(value == 12);
+    host.getModeSwitchStats(to_single, to_shared);
+    std::cout << "Mode switches: " << (to_single - to_single_before) << " to single tenant, " << (to_shared - to_shared_before) << " back to shared" << std::endl;
+    assert(to_shared == to_shared_before + 1);
+    assert(to_single == to_single_before + 1);
+
+    // The dnn tenants keep the other FPGA busy. Evicted from the only memdrive slot, the tenant's data is zeroed before the intruder gets the slot
+    host.setAdmissionControl(0, 0, 0);
+    assert(busy.aos_bulkdata_write(0, sizeof(first_data), first_data) == aos_errcode::SUCCESS);
+    // The write is taken in once the daemon serves the next op, a read request and its response
+    assert(busy.aos_cntrlreg_read(0x0, value) == aos_errcode::SUCCESS);
+    assert(value == 8);
+    assert(busy.aos_cntrlreg_write(0x40, 0x77) == aos_errcode::SUCCESS);
+    uint64_t resident_fpga_id, resident_slot_id, resident_bytes;
+    assert(host.getDataResidency(busy.getSessionId(), resident_fpga_id, resident_slot_id, resident_bytes));
+    assert(resident_bytes == DRAM_PAGE_BYTES);
+    aos_client intruder("memdrive_v0");
+    intruder.aos_init_session();
+    assert(intruder.aos_cntrlreg_write(0x0, 13) == aos_errcode::SUCCESS);
+    assert(!host.getDataResidency(busy.getSessionId(), resident_fpga_id, resident_slot_id, resident_bytes));
+    // The register memdrive declares resettable was zeroed, the DRAM before the intruder's first access
+    assert(intruder.aos_cntrlreg_read(0x40, value) == aos_errcode::SUCCESS);
+    assert(value == 0);
+    char partition_data[sizeof(first_data)];
+    assert(host.dma_read_dram(resident_fpga_id, resident_slot_id, 0, partition_data, sizeof(partition_data)) == 0);
+    for (uint64_t byte_idx = 0; byte_idx < sizeof(partition_data); byte_idx++) {
+        assert(partition_data[byte_idx] == 0);
+    }
+    intruder.aos_end_session();
+
+    // Back in the slot, its page is written back from the host copy
+    aos_preemption_stats busy_before;
+    assert(host.getSessionPreemptionStats(busy.getSessionId(), busy_before));
+    assert(busy.aos_cntrlreg_write(0x0, 14) == aos_errcode::SUCCESS);
+    aos_preemption_stats busy_after;
+    assert(host.getSessionPreemptionStats(busy.getSessionId(), busy_after));
+    std::cout << "Rebound with " << (busy_after.resident_bytes - busy_before.resident_bytes) << " bytes left in place, "
+              << (busy_after.restored_bytes - busy_before.restored_bytes) << " written back" << std::endl;
+    assert(busy_after.num_restores == busy_before.num_restores + 1);
+    assert(busy_after.resident_bytes == busy_before.resident_bytes);
+    assert(busy_after.restored_bytes == busy_before.restored_bytes + DRAM_PAGE_BYTES);
+    assert(host.getDataResidency(busy.getSessionId(), resident_fpga_id, resident_slot_id, resident_bytes));
+    assert(host.dma_read_dram(resident_fpga_id, resident_slot_id, 0, partition_data, sizeof(partition_data)) == 0);
+    assert(memcmp(partition_data, first_data, sizeof(first_data)) == 0);
+
+    // Every stage of the ops above was timed, and the sessions' ops were counted
+    aos_client observer("aos_stats");
+    std::string stats_json;
+    assert(observer.aos_get_stats(stats_json) == aos_errcode::SUCCESS);
+    const json stats = json::parse(stats_json);
+    const aos_latency_histogram & write_mmio = host.getCommandLatency(aos_socket_command::CNTRLREG_WRITE_REQUEST, STAGE_MMIO);
+    assert(write_mmio.getCount() > 0);
+    assert(write_mmio.getPercentile(0.5) <= write_mmio.getPercentile(0.99));
+    assert(write_mmio.getPercentile(0.99) <= write_mmio.getMax());
+    assert(host.getCommandLatency(aos_socket_command::CNTRLREG_WRITE_REQUEST, STAGE_SCHEDULING).getCount() > 0);
+    assert(host.getCommandLatency(aos_socket_command::CNTRLREG_WRITE_REQUEST, STAGE_RECEIVE).getCount() > 0);
+    assert(host.getCommandLatency(aos_socket_command::CNTRLREG_WRITE_REQUEST, STAGE_RESPONSE).getCount() > 0);
+    assert(host.getCommandLatency(aos_socket_command::GET_STATS, STAGE_RECEIVE).getCount() == 1);
+    bool found_write_mmio = false;
+    for (auto & entry : stats["latency"]) {
+        if ((entry["command"] == "CNTRLREG_WRITE_REQUEST") && (entry["stage"] == "mmio")) {
+            found_write_mmio = true;
+            assert(entry["count"].get<uint64_t>() > 0);
+        }
+    }
+    assert(found_write_mmio);
+    bool found_busy = false;
+    for (auto & entry : stats["sessions"]) {
+        if (entry["session_id"].get<uint64_t>() == busy.getSessionId()) {
+            found_busy = true;
+            assert(entry["num_ops"].get<uint64_t>() == 6);
+            assert(entry["bytes"].get<uint64_t>() == (4 * sizeof(uint64_t)) + sizeof(first_data));
+        }
+    }
+    assert(found_busy);
+    assert(stats["fpgas"].size() == num_fpga);
+
+    // One counter snapshot covers every slot of the image, the simulated shell counts nothing
+    std::vector<aos_mem_counters> mem_counters;
+    assert(host.snapshotMemCounters(resident_fpga_id, mem_counters) == 0);
+    assert(mem_counters.size() > resident_slot_id);
+    for (auto & counters : mem_counters) {
+        assert((counters.read_reqs == 0) && (counters.write_bytes == 0) && (counters.cycles == 0));
+    }
+
+    // And in the exporter's scrape, as counters and the gauges of the still open sessions
+    const std::string scrape = scrapeMetrics(metrics_socket);
+    assert(scrape.find("HTTP/1.1 200 OK\r\n") == 0);
+    assert(scrape.find("Content-Type: text/plain; version=0.0.4") != std::string::npos);
+    assert(scrape.find("# TYPE aos_requests_total counter\n") != std::string::npos);
+    assert(getMetricValue(scrape, "aos_requests_total{command=\"CNTRLREG_WRITE_REQUEST\"}") >= num_ops);
+    assert(getMetricValue(scrape, "aos_mmio_ops_total{op=\"write\"}") >= num_ops);
+    assert(getMetricValue(scrape, "aos_sessions") == 3);
+    assert(getMetricValue(scrape, "aos_sessions_opened_total") >= getMetricValue(scrape, "aos_sessions_closed_total") + 3);
+    assert(getMetricValue(scrape, "aos_reconfigurations_total{result=\"loaded\"}") >= 1);
+    assert(getMetricValue(scrape, "aos_reconfiguration_duration_seconds_count") >= 1);
+    assert(getMetricValue(scrape, "aos_slot_evictions_total") >= 1);
+    assert(getMetricValue(scrape, "aos_dma_bytes_total{direction=\"read\"}") >= DRAM_PAGE_BYTES);
+    uint64_t num_bound_slots = 0;
+    for (uint64_t fpga_id = 0; fpga_id < num_fpga; fpga_id++) {
+        num_bound_slots += getMetricValue(scrape, "aos_bound_slots{fpga=\"" + std::to_string(fpga_id) + "\"}");
+    }
+    assert(num_bound_slots <= 3);
+    assert(getMetricValue(scrape, "aos_admission_queue_depth") == 0);
+
+    // The same ops show up as spans tagged with where they ran
+    std::string trace_json;
+    assert(observer.aos_get_trace(trace_json) == aos_errcode::SUCCESS);
+    const json trace = json::parse(trace_json);
+    bool found_bar1_write = false;
+    bool found_scheduling = false;
+    bool found_reconfig_thread = false;
+    for (auto & event : trace["traceEvents"]) {
+        if (event["ph"] == "M") {
+            if (event["args"]["name"].get<std::string>().find("reconfig fpga") == 0) {
+                found_reconfig_thread = true;
+            }
+            continue;
+        }
+        if ((event["name"] == "bar1_write") && event["args"].count("session") && (event["args"]["session"].get<uint64_t>() == busy.getSessionId())) {
+            found_bar1_write = true;
+            assert(event["args"]["fpga"].get<uint64_t>() == resident_fpga_id);
+            assert(event["args"]["slot"].get<uint64_t>() == resident_slot_id);
+        }
+        if (event["name"] == "handleScheduling") {
+            found_scheduling = true;
+        }
+    }
+    assert(found_bar1_write);
+    assert(found_scheduling);
+    assert(found_reconfig_thread);
+
+    crowd.aos_end_session();
+    solo.aos_end_session();
+    busy.aos_end_session();
+
+    // The log writer kept up with all of the above
+    flushLog();
+    assert(getNumDroppedLogLines() == 0);
+
+    return 0;
+
+}
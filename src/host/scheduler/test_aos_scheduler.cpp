@@ -1,14 +1,20 @@
 #include "aos_host_common.h"
-#include "aos_scheduler.h"
+#include "aos_placement.h"
 
-int main(void) {
+int main(int argc, char *argv[]) {
+
+    // Image library in the test's directory, or the one given
+    std::string images_json = "test_fpga_images.json";
+    if (argc > 1) {
+        images_json = argv[1];
+    }
 
     uint64_t num_fpga = 1;
     uint64_t fpga_id0 = 0;
 
     aos_scheduler sched(num_fpga);
 
-    sched.parseImages("/home/centos/src/project_data/amorphos-design/f1_host/fpga_images.json");
+    sched.parseImages(images_json);
 
     assert(sched.appIdExists("dnn_weaver_v0"));
     assert(sched.appIdExists("memdrive_v0"));
@@ -81,6 +87,37 @@ int main(void) {
 
     assert(sched.getAllFittingImages(app_tuple2).size() == 0);
 
+    // Typed demand queries agree with the json ones
+    app_demand_t app_demand0 = sched.generateAppDemand(app_ids, app_counts);
+    assert(sched.getAllFittingImages(app_demand0) == fitting_image_idxs);
+    assert(sched.canImageSatisfyNeed(0, app_demand0));
+
+    app_demand_t app_demand1 = sched.generateAppDemand(app_ids1, app_counts1);
+    assert(!sched.canImageSatisfyNeed(0, app_demand1));
+    assert(sched.getAllFittingImages(app_demand1).size() == 1);
+
+    app_demand_t app_demand2 = sched.generateAppDemand(app_ids2, app_counts2);
+    assert(sched.getAllFittingImages(app_demand2).size() == 0);
+
+    std::vector<std::string> app_ids3;
+    std::vector<uint32_t> app_counts3;
+    app_ids3.push_back("dummy_app_id");
+    app_counts3.push_back(1);
+    assert(sched.getAllFittingImages(sched.generateAppDemand(app_ids3, app_counts3)).size() == 0);
+
+    assert(sched.getImageDescriptor(0).agfi == dnn8_agfi);
+    assert(sched.getImageDescriptor(0).getAppCount(sched.getAppIdx("dnn_weaver_v0")) == 8);
+    // Slots without a throughput rating count as 1, apps without a slot as 0
+    assert(sched.getImageDescriptor(0).getAppThroughput(sched.getAppIdx("dnn_weaver_v0")) == DEFAULT_SLOT_THROUGHPUT);
+    assert(sched.getImageDescriptor(0).getAppThroughput(sched.getAppIdx("memdrive_v0")) == 0.0);
+
+    // Unmeasured images fall back to the default, measurements are smoothed
+    assert(sched.getImageLoadLatency(0) == DEFAULT_IMAGE_LOAD_LATENCY_NS);
+    sched.recordImageLoadLatency(0, 1000);
+    assert(sched.getImageLoadLatency(0) == 1000);
+    sched.recordImageLoadLatency(0, 2000);
+    assert(sched.getImageLoadLatency(0) > 1000 && sched.getImageLoadLatency(0) < 2000);
+
     json app_tuple3 = sched.convertImageToAppTuples(image0);
 
     std::cout << app_tuple3 << std::endl;
@@ -100,11 +137,59 @@ int main(void) {
         std::cout << "Slot " << i << " " << slotIdMap1[i] << std::endl;
     }
 
+    // BAR1 slot windows, every slot gets a non-empty window that does not overlap its neighbours
+    std::map<uint64_t, uint64_t> slotBaseMap0 = sched.getSlotBAR1BaseMap(image0);
+    std::map<uint64_t, uint64_t> slotSizeMap0 = sched.getSlotBAR1SizeMap(image0);
+
+    assert(slotBaseMap0.size() == slotIdMap0.size());
+    assert(slotSizeMap0.size() == slotIdMap0.size());
+
+    std::cout << "Slot BAR1 Windows:" << std::endl;
+    for (uint64_t i = 0; i < slotBaseMap0.size(); i++) {
+        assert(slotSizeMap0[i] > 0);
+        if (i > 0) {
+            assert(slotBaseMap0[i] >= (slotBaseMap0[i - 1] + slotSizeMap0[i - 1]) || (slotBaseMap0[i] + slotSizeMap0[i]) <= slotBaseMap0[i - 1]);
+        }
+        std::cout << "Slot " << i << " base " << slotBaseMap0[i] << " size " << slotSizeMap0[i] << std::endl;
+    }
+    assert(sched.validateSlotWindows(image0));
+
+    // No slot may map over the memory counter window
+    json image0_stats_overlap = image0;
+    image0_stats_overlap["slots"][0]["bar1_base"] = MEM_STATS_BAR1_BASE + MEM_STATS_BAR1_SIZE - 8;
+    image0_stats_overlap["slots"][0]["bar1_size"] = DEFAULT_SLOT_BAR1_SIZE;
+    assert(!sched.validateSlotWindows(image0_stats_overlap));
+
+    // Nor may a window reach past what the shell's SoftReg router decodes for its slot
+    json image0_large_window = image0;
+    image0_large_window["slots"][0]["bar1_base"] = 0;
+    image0_large_window["slots"][0]["bar1_size"] = 2 * DEFAULT_SLOT_BAR1_SIZE;
+    assert(!sched.validateSlotWindows(image0_large_window));
+    json image0_moved_window = image0;
+    image0_moved_window["slots"][0]["bar1_base"] = SOFTREG_ROUTED_SLOTS * DEFAULT_SLOT_BAR1_SIZE;
+    image0_moved_window["slots"][0]["bar1_size"] = DEFAULT_SLOT_BAR1_SIZE;
+    assert(!sched.validateSlotWindows(image0_moved_window));
+    json image0_unrouted_slot = image0;
+    image0_unrouted_slot["slots"][0]["slot_id"] = SOFTREG_ROUTED_SLOTS;
+    image0_unrouted_slot["slots"][0].erase("bar1_base");
+    image0_unrouted_slot["slots"][0].erase("bar1_size");
+    assert(!sched.validateSlotWindows(image0_unrouted_slot));
+    // A smaller window at the slot's base is fine, the rest of its 8 KB is just out of bounds
+    json image0_small_window = image0;
+    image0_small_window["slots"][0]["bar1_base"] = 0;
+    image0_small_window["slots"][0]["bar1_size"] = 1024;
+    assert(sched.validateSlotWindows(image0_small_window));
+
+    // Apps that declare nothing never have reads served from the register shadow
+    assert(sched.getShadowRegRanges("dummy_app_id").empty());
+
     sched.clearImage(fpga_id0);
 
     sleep(2);
 
     sched.loadImage(fpga_id0, 0);
+    assert(sched.isImageResident(fpga_id0, 0));
+    assert(!sched.isImageResident(fpga_id0, 1));
 
     sleep(2);
 
@@ -117,7 +202,84 @@ int main(void) {
     sleep(2);
     
     sched.loadImage(fpga_id0, 0);
-    
+    assert(sched.isImageResident(fpga_id0, 0));
+    assert(!sched.isImageResident(fpga_id0, 1));
+
+    // Arrival prediction needs two arrivals and forgets quiet apps
+    const uint32_t dnn_idx = sched.getAppIdx("dnn_weaver_v0");
+    uint64_t predicted_ns = 0;
+    sched.recordSessionArrival("dnn_weaver_v0", 1000);
+    assert(!sched.getPredictedArrival(dnn_idx, 1000, predicted_ns));
+    sched.recordSessionArrival("dnn_weaver_v0", 2000);
+    assert(sched.getPredictedArrival(dnn_idx, 2000, predicted_ns));
+    assert(predicted_ns == 3000);
+    assert(sched.getPredictedArrivals(2000, 1000).size() == 1);
+    assert(sched.getPredictedArrivals(2000, 999).empty());
+    assert(!sched.getPredictedArrival(dnn_idx, 2000 + (ARRIVAL_STALE_GAPS * 1000) + 1, predicted_ns));
+
+    // A cancelled simulated load returns early and leaves the FPGA empty
+    sched.setSimulatedReconfiguration(true, 10ULL * 1000 * 1000 * 1000);
+    sched.beginReconfiguration(fpga_id0, 1);
+    int program_rc = 0;
+    std::thread worker([&]() { program_rc = sched.programImage(fpga_id0, 1); });
+    sched.cancelReconfiguration(fpga_id0);
+    worker.join();
+    assert(program_rc == RECONFIG_CANCELLED);
+    sched.completeReconfiguration(fpga_id0, 1, program_rc);
+    assert(!sched.anyImageLoaded(fpga_id0));
+
+    // Joint placement, two empty FPGAs get an image each so every session runs
+    aos_placement placement(sched, DEFAULT_RECONFIG_HORIZON_NS);
+    const uint32_t md_idx = sched.getAppIdx("memdrive_v0");
+    const uint32_t md_image_idx = sched.getAllFittingImages(app_demand1)[0];
+    std::vector<uint32_t> demand(sched.getNumApps(), 0);
+    demand[dnn_idx] = 3;
+    demand[md_idx]  = 1;
+    FPGAPlacementState empty_fpga = { NO_IMAGE_LOADED, false, 0 };
+    std::vector<FPGAPlacementState> fleet(2, empty_fpga);
+    PlacementPlan plan0 = placement.plan(fleet, demand);
+    assert(plan0.num_placed == 4);
+    assert(plan0.num_reconfigs == 2);
+    assert(placement.getPlannedCapacity(plan0, dnn_idx) >= 3);
+    assert(placement.getPlannedCapacity(plan0, md_idx) >= 1);
+
+    // An image that runs its tenants stays, the empty FPGA takes the rest
+    fleet[0].image_idx = 0;
+    fleet[0].num_bound = 2;
+    demand[dnn_idx] = 2;
+    PlacementPlan plan1 = placement.plan(fleet, demand);
+    assert(plan1.target_image[0] == 0);
+    assert(plan1.target_image[1] == (int32_t)md_image_idx);
+    assert(plan1.app_slots[0][dnn_idx] == 2);
+    assert(plan1.num_placed == 3);
+    assert(plan1.num_reconfigs == 1);
+
+    // Evicting two tenants to run one session is not worth it
+    PlacementPlan plan2 = placement.plan(std::vector<FPGAPlacementState>(1, fleet[0]), demand);
+    assert(plan2.target_image[0] == 0);
+    assert(plan2.num_reconfigs == 0);
+    assert(placement.getPlannedCapacity(plan2, md_idx) == 0);
+
+    // An FPGA being reconfigured keeps the image it is loading
+    fleet[1].image_idx = 0;
+    fleet[1].locked = true;
+    PlacementPlan plan3 = placement.plan(fleet, demand);
+    assert(plan3.target_image[1] == 0);
+    assert(placement.getPlannedCapacity(plan3, md_idx) == 0);
+
+    // Access accounting forgets bytes older than two windows
+    aos_access_stats stats;
+    stats.reset(0);
+    stats.recordAccess(10, 4096);
+    stats.recordAccess(20, 64);
+    assert(stats.num_ops == 2);
+    assert(stats.last_access_ns == 20);
+    assert(stats.getRecentBytes(30) == 4160);
+    stats.recordAccess(ACCESS_STATS_WINDOW_NS + 10, 8);
+    assert(stats.getRecentBytes(ACCESS_STATS_WINDOW_NS + 20) == 4168);
+    assert(stats.getRecentBytes((3 * ACCESS_STATS_WINDOW_NS) + 20) == 0);
+    assert(stats.total_bytes == 4168);
+
     return 0;
 
 }
\ No newline at end of file
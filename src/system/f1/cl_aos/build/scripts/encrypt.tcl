@@ -80,8 +80,10 @@ file copy -force $AOS_SRC/RRWCArbiter.sv $TARGET_DIR
 file copy -force $AOS_SRC/RespMerge.sv $TARGET_DIR
 file copy -force $AOS_SRC/TwoInputArbiter.sv $TARGET_DIR
 file copy -force $AOS_SRC/AmorphOSSoftReg.sv $TARGET_DIR
+file copy -force $AOS_SRC/AmorphOSStatsSoftReg.sv $TARGET_DIR
 #file copy -force $AOS_SRC/AmorphOSPCIE.sv $TARGET_DIR
 file copy -force $AOS_SRC/AmorphOSMem.sv $TARGET_DIR
+file copy -force $AOS_SRC/AmorphOSMemStats.sv $TARGET_DIR
 file copy -force $AOS_SRC/AmorphOSMem2SDRAM.sv $TARGET_DIR
 # F1 interfaces
 file copy -force $F1_SRC/AXIL2SR.sv $TARGET_DIR
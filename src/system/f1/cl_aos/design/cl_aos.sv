@@ -232,6 +232,11 @@ endgenerate
 	// AmorphOS to apps
 	SoftRegReq					 app_softreg_req[F1_NUM_APPS-1:0];
 	SoftRegResp					 app_softreg_resp[F1_NUM_APPS-1:0];		
+	// OS counter window to the app router
+	SoftRegReq					 os2apps_softreg_req;
+	SoftRegResp					 os2apps_softreg_resp;
+	// Per app memory counters from AmorphOSMem
+	AMIAppStats					 app_mem_stats[F1_NUM_APPS-1:0];
 
 	// MemDrive connectors
 	AMIRequest                   md_mem_reqs        [1:0];
@@ -324,6 +329,21 @@ endgenerate
 
 		end else if (F1_CONFIG_SOFTREG_CONFIG == 2) begin
 			// Full AmorphOS system
+			// OS window with the per app memory counters, everything else goes on to the apps
+			AmorphOSStatsSoftReg #(.SR_NUM_APPS(F1_NUM_APPS))
+			amorphos_stats_softreg_inst
+			(
+				// User clock and reset
+				.clk(global_clk),
+				.rst(global_rst),
+				.app_stats(app_mem_stats),
+				// Interface to Host
+				.softreg_req(softreg_req_from_axil2sr),
+				.softreg_resp(softreg_resp_to_axil2sr),
+				// Interface to the app router
+				.app_softreg_req(os2apps_softreg_req),
+				.app_softreg_resp(os2apps_softreg_resp)
+			);
 			// SoftReg Interface
 			if (F1_AXIL_USE_ROUTE_TREE == 0) begin : sr_no_tree
 				AmorphOSSoftReg
@@ -334,8 +354,8 @@ endgenerate
 					.rst(global_rst), 
 					.app_enable(app_enable),
 					// Interface to Host
-					.softreg_req(softreg_req_from_axil2sr),
-					.softreg_resp(softreg_resp_to_axil2sr),
+					.softreg_req(os2apps_softreg_req),
+					.softreg_resp(os2apps_softreg_resp),
 					// Virtualized interface each app
 					.app_softreg_req(app_softreg_req),
 					.app_softreg_resp(app_softreg_resp)
@@ -348,8 +368,8 @@ endgenerate
 					.rst(global_rst), 
 					.app_enable(app_enable),
 					// Interface to Host
-					.softreg_req(softreg_req_from_axil2sr),
-					.softreg_resp(softreg_resp_to_axil2sr),
+					.softreg_req(os2apps_softreg_req),
+					.softreg_resp(os2apps_softreg_resp),
 					// Virtualized interface each app
 					.app_softreg_req(app_softreg_req),
 					.app_softreg_resp(app_softreg_resp)
@@ -385,6 +405,10 @@ generate
 		assign app_mem_req_grants[0]        = ami2_ami2axi4_req_grant_in;
 		assign app_mem_resps[0]             = ami2_ami2axi4_resp_in;
 		assign ami2_ami2axi4_resp_grant_out = app_mem_resp_grants[0];
+		// no counters without AmorphOSMem
+		for (ami_num = 0; ami_num < F1_NUM_APPS; ami_num = ami_num + 1) begin : no_ami_stats
+			assign app_mem_stats[ami_num] = '0;
+		end
 	end else if (F1_CONFIG_AMI_ENABLED == 1) begin
 		AmorphOSMem
 		amorphosmem_inst
@@ -406,7 +430,9 @@ generate
 			.ch2mem_inter_req_out(ami2_ami2axi4_req_out),
 			.ch2mem_inter_req_grant_in(ami2_ami2axi4_req_grant_in),
 			.ch2mem_inter_resp_in(ami2_ami2axi4_resp_in),
-			.ch2mem_inter_resp_grant_out(ami2_ami2axi4_resp_grant_out)
+			.ch2mem_inter_resp_grant_out(ami2_ami2axi4_resp_grant_out),
+			// Per app counters for the OS SoftReg window
+			.app_stats(app_mem_stats)
 		);
 	end else if (F1_CONFIG_AMI_ENABLED == 2) begin
 		for (ami_num = 0; ami_num < NUM_AMI_INSTS; ami_num = ami_num + 1) begin : multi_ami
@@ -430,7 +456,9 @@ generate
 				.ch2mem_inter_req_out(ami2_ami2axi4_req_out[(ami_num*CHANNELS_PER_AMI)+(CHANNELS_PER_AMI-1):(ami_num*CHANNELS_PER_AMI)]),
 				.ch2mem_inter_req_grant_in(ami2_ami2axi4_req_grant_in[(ami_num*CHANNELS_PER_AMI)+(CHANNELS_PER_AMI-1):(ami_num*CHANNELS_PER_AMI)]),
 				.ch2mem_inter_resp_in(ami2_ami2axi4_resp_in[(ami_num*CHANNELS_PER_AMI)+(CHANNELS_PER_AMI-1):(ami_num*CHANNELS_PER_AMI)]),
-				.ch2mem_inter_resp_grant_out(ami2_ami2axi4_resp_grant_out[(ami_num*CHANNELS_PER_AMI)+(CHANNELS_PER_AMI-1):(ami_num*CHANNELS_PER_AMI)])
+				.ch2mem_inter_resp_grant_out(ami2_ami2axi4_resp_grant_out[(ami_num*CHANNELS_PER_AMI)+(CHANNELS_PER_AMI-1):(ami_num*CHANNELS_PER_AMI)]),
+				// Per app counters for the OS SoftReg window
+				.app_stats(app_mem_stats[(AMI_NUM_APPS*ami_num)+(AMI_NUM_APPS-1):(ami_num*AMI_NUM_APPS)])
 			);
 		end	
 	end
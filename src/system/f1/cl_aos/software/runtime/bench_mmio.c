@@ -0,0 +1,662 @@
+// MMIO microbenchmark for the AmorphOS BAR1 (SoftReg) path
+// Built on the raw access pattern of test_cl_aos.c
+//
+// Measures
+//  - per app 32 bit poke/peek latency distributions
+//  - 64 bit accesses as 2 x 32 bit (what the daemon does) vs native 64 bit
+//  - back to back posted write throughput
+//  - concurrent poke/peek from 1..N threads, one app per thread
+//
+// Runs against the FPGA in --slot, or with --shm against a shared memory
+// stand-in (/dev/shm/aos_bench_mmio) to get the software floor. Images built
+// with F1SoftRegLoopback behind every app need --loopback <wait-cycles>, the
+// loopback only answers a read after a write told it how long to wait.
+// Results go to stdout as CSV (default) or JSON (--format json).
+
+// Normal C includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// FPGA specific includes
+#include <fpga_pci.h>
+#include <fpga_mgmt.h>
+#include <utils/lcd.h>
+#include <utils/sh_dpi_tasks.h>
+
+/* use the stdout logger for printing debug information  */
+const struct logger *logger = &logger_stdout;
+
+static uint16_t pci_vendor_id = 0x1D0F; /* Amazon PCI Vendor ID */
+static uint16_t pci_device_id = 0xF000; /* PCI Device ID preassigned by Amazon for F1 applications */
+
+/* Shared memory stand-in for BAR1, same size as the real aperture */
+#define SHM_NAME "/aos_bench_mmio"
+#define SHM_BAR1_SIZE (2 * 1024 * 1024)
+
+#define MAX_THREADS 64
+
+enum output_format {
+	FORMAT_CSV,
+	FORMAT_JSON
+};
+
+struct bench_config {
+	int fpga_slot;         // which FPGA (PCIe slot) to attach to
+	int num_apps;          // number of app slots to sweep
+	int app_shift;         // log2 of the per app register window
+	int iters;             // samples per measurement
+	int burst_dwords;      // length of a burst write
+	int num_threads;       // threads for the concurrent test
+	int use_shm;           // use the shared memory stand-in instead of the FPGA
+	int loopback;          // image has F1SoftRegLoopback behind every app
+	uint64_t loopback_wait;// cycles the loopback waits before answering a read
+	enum output_format format;
+};
+
+/* Access backend, either the real BAR1 or the shared memory stand-in */
+static pci_bar_handle_t pci_bar1_handle = PCI_BAR_HANDLE_INIT;
+static volatile uint8_t * shm_bar1 = NULL;
+static int use_shm = 0;
+
+static int bar1_poke(uint64_t offset, uint32_t value) {
+	if (use_shm) {
+		*(volatile uint32_t *)(shm_bar1 + offset) = value;
+		return 0;
+	}
+	return fpga_pci_poke(pci_bar1_handle, offset, value);
+}
+
+static int bar1_peek(uint64_t offset, uint32_t * value) {
+	if (use_shm) {
+		*value = *(volatile uint32_t *)(shm_bar1 + offset);
+		return 0;
+	}
+	return fpga_pci_peek(pci_bar1_handle, offset, value);
+}
+
+static int bar1_poke64(uint64_t offset, uint64_t value) {
+	if (use_shm) {
+		*(volatile uint64_t *)(shm_bar1 + offset) = value;
+		return 0;
+	}
+	return fpga_pci_poke64(pci_bar1_handle, offset, value);
+}
+
+static int bar1_peek64(uint64_t offset, uint64_t * value) {
+	if (use_shm) {
+		*value = *(volatile uint64_t *)(shm_bar1 + offset);
+		return 0;
+	}
+	return fpga_pci_peek64(pci_bar1_handle, offset, value);
+}
+
+static uint64_t app_offset(const struct bench_config * cfg, uint32_t app_id, uint64_t offset) {
+	uint64_t tmp = app_id;
+	return (tmp << cfg->app_shift) | offset;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Results */
+struct bench_result {
+	const char * test;
+	int app;
+	int threads;
+	int width;
+	uint64_t ops;
+	uint64_t min_ns;
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+	double mean_ns;
+	double mb_per_s;
+	double mops_per_s;
+};
+
+static int results_emitted = 0;
+
+static void summarize(struct bench_result * res, uint64_t * samples, uint64_t num_samples) {
+	uint64_t i;
+	double sum = 0.0;
+	res->ops = num_samples;
+	if (num_samples == 0) {
+		return;
+	}
+	qsort(samples, num_samples, sizeof(uint64_t), cmp_u64);
+	for (i = 0; i < num_samples; i++) {
+		sum += (double)samples[i];
+	}
+	res->min_ns  = samples[0];
+	res->p50_ns  = samples[(num_samples * 50) / 100];
+	res->p90_ns  = samples[(num_samples * 90) / 100];
+	res->p99_ns  = samples[(num_samples * 99) / 100];
+	res->max_ns  = samples[num_samples - 1];
+	res->mean_ns = sum / (double)num_samples;
+}
+
+static void emit_header(const struct bench_config * cfg) {
+	if (cfg->format == FORMAT_CSV) {
+		printf("test,app,threads,width,ops,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns,mb_per_s,mops_per_s\n");
+	} else {
+		printf("{\n  \"backend\": \"%s\",\n  \"results\": [\n", cfg->use_shm ? "shm" : "fpga");
+	}
+}
+
+static void emit_result(const struct bench_config * cfg, const struct bench_result * res) {
+	if (cfg->format == FORMAT_CSV) {
+		printf("%s,%d,%d,%d,%lu,%lu,%lu,%lu,%lu,%lu,%.1f,%.3f,%.3f\n",
+		       res->test, res->app, res->threads, res->width, res->ops,
+		       res->min_ns, res->p50_ns, res->p90_ns, res->p99_ns, res->max_ns,
+		       res->mean_ns, res->mb_per_s, res->mops_per_s);
+	} else {
+		printf("%s    {\"test\": \"%s\", \"app\": %d, \"threads\": %d, \"width\": %d, \"ops\": %lu, "
+		       "\"min_ns\": %lu, \"p50_ns\": %lu, \"p90_ns\": %lu, \"p99_ns\": %lu, \"max_ns\": %lu, "
+		       "\"mean_ns\": %.1f, \"mb_per_s\": %.3f, \"mops_per_s\": %.3f}",
+		       (results_emitted > 0) ? ",\n" : "",
+		       res->test, res->app, res->threads, res->width, res->ops,
+		       res->min_ns, res->p50_ns, res->p90_ns, res->p99_ns, res->max_ns,
+		       res->mean_ns, res->mb_per_s, res->mops_per_s);
+	}
+	results_emitted++;
+}
+
+static void emit_footer(const struct bench_config * cfg) {
+	if (cfg->format == FORMAT_JSON) {
+		printf("\n  ]\n}\n");
+	}
+}
+
+/*
+	The loopback only answers a read after it has been armed by a write
+	with the number of cycles to wait, so reads have to be preceded by one
+*/
+static int arm_loopback(const struct bench_config * cfg, uint32_t app_id) {
+	if (!cfg->loopback) {
+		return 0;
+	}
+	return bar1_poke(app_offset(cfg, app_id, 0x00), (uint32_t)cfg->loopback_wait);
+}
+
+/* Per app 32 bit poke and peek latency distributions */
+static int bench_per_app_latency(const struct bench_config * cfg, uint64_t * samples) {
+	int app;
+	int i;
+	int rc;
+	uint32_t read_val;
+	uint64_t start;
+	struct bench_result res;
+
+	for (app = 0; app < cfg->num_apps; app++) {
+		// poke
+		for (i = 0; i < cfg->iters; i++) {
+			start = now_ns();
+			rc = bar1_poke(app_offset(cfg, app, 0x00), (uint32_t)(cfg->loopback ? cfg->loopback_wait : i));
+			samples[i] = now_ns() - start;
+			fail_on(rc, out, "Unable to poke app %d", app);
+			if (cfg->loopback) {
+				// drain the response the write armed
+				rc = bar1_peek(app_offset(cfg, app, 0x00), &read_val);
+				fail_on(rc, out, "Unable to drain app %d", app);
+			}
+		}
+		memset(&res, 0, sizeof(res));
+		res.test = "poke_latency";
+		res.app = app;
+		res.threads = 1;
+		res.width = 32;
+		summarize(&res, samples, cfg->iters);
+		emit_result(cfg, &res);
+
+		// peek
+		for (i = 0; i < cfg->iters; i++) {
+			rc = arm_loopback(cfg, app);
+			fail_on(rc, out, "Unable to arm app %d", app);
+			start = now_ns();
+			rc = bar1_peek(app_offset(cfg, app, 0x00), &read_val);
+			samples[i] = now_ns() - start;
+			fail_on(rc, out, "Unable to peek app %d", app);
+		}
+		memset(&res, 0, sizeof(res));
+		res.test = "peek_latency";
+		res.app = app;
+		res.threads = 1;
+		res.width = 32;
+		summarize(&res, samples, cfg->iters);
+		emit_result(cfg, &res);
+	}
+	return 0;
+out:
+	return 1;
+}
+
+/*
+	A 64 bit CntrlReg access done the way the daemon does it (two 32 bit
+	accesses) against single 64 bit accesses
+*/
+static int bench_access_width(const struct bench_config * cfg, uint64_t * samples) {
+	int i;
+	int rc;
+	uint32_t lo;
+	uint32_t hi;
+	uint64_t read64;
+	uint64_t start;
+	struct bench_result res;
+	const uint64_t offset = app_offset(cfg, 0, 0x00);
+
+	// 2 x 32 bit writes
+	for (i = 0; i < cfg->iters; i++) {
+		start = now_ns();
+		rc = bar1_poke(offset, (uint32_t)i);
+		fail_on(rc, out, "Unable to poke lower half");
+		rc = bar1_poke(offset + 0x04, 0);
+		fail_on(rc, out, "Unable to poke upper half");
+		samples[i] = now_ns() - start;
+		if (cfg->loopback) {
+			rc = bar1_peek(offset, &lo);
+			fail_on(rc, out, "Unable to drain loopback");
+		}
+	}
+	memset(&res, 0, sizeof(res));
+	res.test = "write64_as_2x32";
+	res.threads = 1;
+	res.width = 32;
+	summarize(&res, samples, cfg->iters);
+	emit_result(cfg, &res);
+
+	// 1 x 64 bit writes
+	for (i = 0; i < cfg->iters; i++) {
+		start = now_ns();
+		rc = bar1_poke64(offset, (uint64_t)(cfg->loopback ? cfg->loopback_wait : (uint64_t)i));
+		samples[i] = now_ns() - start;
+		fail_on(rc, out, "Unable to poke64");
+		if (cfg->loopback) {
+			rc = bar1_peek(offset, &lo);
+			fail_on(rc, out, "Unable to drain loopback");
+		}
+	}
+	memset(&res, 0, sizeof(res));
+	res.test = "write64";
+	res.threads = 1;
+	res.width = 64;
+	summarize(&res, samples, cfg->iters);
+	emit_result(cfg, &res);
+
+	// 2 x 32 bit reads
+	for (i = 0; i < cfg->iters; i++) {
+		rc = arm_loopback(cfg, 0);
+		fail_on(rc, out, "Unable to arm loopback");
+		start = now_ns();
+		rc = bar1_peek(offset, &lo);
+		fail_on(rc, out, "Unable to peek lower half");
+		if (cfg->loopback) {
+			rc = arm_loopback(cfg, 0);
+			fail_on(rc, out, "Unable to arm loopback");
+		}
+		rc = bar1_peek(offset + 0x04, &hi);
+		fail_on(rc, out, "Unable to peek upper half");
+		samples[i] = now_ns() - start;
+	}
+	memset(&res, 0, sizeof(res));
+	res.test = "read64_as_2x32";
+	res.threads = 1;
+	res.width = 32;
+	summarize(&res, samples, cfg->iters);
+	emit_result(cfg, &res);
+
+	// 1 x 64 bit reads
+	for (i = 0; i < cfg->iters; i++) {
+		rc = arm_loopback(cfg, 0);
+		fail_on(rc, out, "Unable to arm loopback");
+		start = now_ns();
+		rc = bar1_peek64(offset, &read64);
+		samples[i] = now_ns() - start;
+		fail_on(rc, out, "Unable to peek64");
+	}
+	memset(&res, 0, sizeof(res));
+	res.test = "read64";
+	res.threads = 1;
+	res.width = 64;
+	summarize(&res, samples, cfg->iters);
+	emit_result(cfg, &res);
+
+	return 0;
+out:
+	return 1;
+}
+
+/* Back to back posted writes, the way a register block gets programmed */
+static int bench_burst_write(const struct bench_config * cfg, uint64_t * samples) {
+	int i;
+	int dw;
+	int rc;
+	uint32_t drain;
+	uint64_t start;
+	uint64_t total_ns = 0;
+	struct bench_result res;
+	const uint64_t window = 1ULL << cfg->app_shift;
+
+	for (i = 0; i < cfg->iters; i++) {
+		start = now_ns();
+		for (dw = 0; dw < cfg->burst_dwords; dw++) {
+			rc = bar1_poke(app_offset(cfg, 0, ((uint64_t)dw * 4) % window), (uint32_t)dw);
+			fail_on(rc, out, "Unable to burst write");
+		}
+		samples[i] = now_ns() - start;
+		total_ns += samples[i];
+		if (cfg->loopback) {
+			rc = bar1_peek(app_offset(cfg, 0, 0x00), &drain);
+			fail_on(rc, out, "Unable to drain loopback");
+		}
+	}
+	memset(&res, 0, sizeof(res));
+	res.test = "burst_write";
+	res.threads = 1;
+	res.width = 32;
+	summarize(&res, samples, cfg->iters);
+	if (total_ns > 0) {
+		const double bytes = (double)cfg->iters * (double)cfg->burst_dwords * 4.0;
+		res.mb_per_s   = (bytes / (1024.0 * 1024.0)) / ((double)total_ns / 1e9);
+		res.mops_per_s = ((double)cfg->iters * (double)cfg->burst_dwords) / ((double)total_ns / 1e3);
+	}
+	emit_result(cfg, &res);
+	return 0;
+out:
+	return 1;
+}
+
+/*
+	Concurrent access, every thread hammers its own app slot. A loopback
+	can't be shared since its write/read protocol would interleave.
+*/
+struct thread_args {
+	const struct bench_config * cfg;
+	int app;
+	uint64_t * samples;
+	int rc;
+};
+
+static void * concurrent_worker(void * arg) {
+	struct thread_args * args = (struct thread_args *)arg;
+	const struct bench_config * cfg = args->cfg;
+	int i;
+	int rc;
+	uint32_t read_val;
+	uint64_t start;
+
+	for (i = 0; i < cfg->iters; i++) {
+		start = now_ns();
+		rc = bar1_poke(app_offset(cfg, args->app, 0x00), (uint32_t)(cfg->loopback ? cfg->loopback_wait : i));
+		fail_on(rc, out, "Unable to poke from thread");
+		rc = bar1_peek(app_offset(cfg, args->app, 0x00), &read_val);
+		fail_on(rc, out, "Unable to peek from thread");
+		args->samples[i] = now_ns() - start;
+	}
+	args->rc = 0;
+	return NULL;
+out:
+	args->rc = 1;
+	return NULL;
+}
+
+static int bench_concurrent(const struct bench_config * cfg) {
+	pthread_t threads[MAX_THREADS];
+	struct thread_args args[MAX_THREADS];
+	struct bench_result res;
+	uint64_t * all_samples;
+	uint64_t start;
+	uint64_t elapsed;
+	int num_threads = 1;
+	int t;
+	int rc = 0;
+
+	// 1, 2, 4, ... threads and finally the requested count
+	while (num_threads > 0) {
+		all_samples = (uint64_t *)malloc(sizeof(uint64_t) * cfg->iters * num_threads);
+		assert(all_samples != NULL);
+		start = now_ns();
+		for (t = 0; t < num_threads; t++) {
+			args[t].cfg = cfg;
+			args[t].app = t % cfg->num_apps;
+			args[t].samples = all_samples + ((uint64_t)t * cfg->iters);
+			args[t].rc = 0;
+			pthread_create(&threads[t], NULL, concurrent_worker, &args[t]);
+		}
+		for (t = 0; t < num_threads; t++) {
+			pthread_join(threads[t], NULL);
+			rc |= args[t].rc;
+		}
+		elapsed = now_ns() - start;
+
+		memset(&res, 0, sizeof(res));
+		res.test = "concurrent_poke_peek";
+		res.app = -1;
+		res.threads = num_threads;
+		res.width = 32;
+		summarize(&res, all_samples, (uint64_t)cfg->iters * num_threads);
+		if (elapsed > 0) {
+			res.mops_per_s = ((double)cfg->iters * num_threads * 2.0) / ((double)elapsed / 1e3);
+			res.mb_per_s   = (res.mops_per_s * 4.0 * 1e6) / (1024.0 * 1024.0);
+		}
+		emit_result(cfg, &res);
+		free(all_samples);
+
+		if (rc != 0) {
+			return rc;
+		}
+		if (num_threads == cfg->num_threads) {
+			num_threads = 0;
+		} else if ((num_threads * 2) > cfg->num_threads) {
+			num_threads = cfg->num_threads;
+		} else {
+			num_threads *= 2;
+		}
+	}
+	return rc;
+}
+
+int check_afi_ready(int slot_id);
+
+void usage(char* program_name) {
+	printf("usage: %s [--slot <fpga-slot>] [--apps <n>] [--app-shift <bits>] [--iters <n>]\n"
+	       "          [--burst <dwords>] [--threads <n>] [--shm] [--loopback <wait-cycles>]\n"
+	       "          [--format csv|json]\n", program_name);
+}
+
+static int attach_shm(void) {
+	int fd = shm_open(SHM_NAME, O_CREAT | O_RDWR, 0600);
+	if (fd == -1) {
+		perror("shm_open");
+		return 1;
+	}
+	if (ftruncate(fd, SHM_BAR1_SIZE) == -1) {
+		perror("ftruncate");
+		close(fd);
+		return 1;
+	}
+	shm_bar1 = (volatile uint8_t *)mmap(NULL, SHM_BAR1_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm_bar1 == MAP_FAILED) {
+		perror("mmap");
+		shm_bar1 = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+
+	struct bench_config cfg;
+	uint64_t * samples;
+	int rc;
+	int i;
+
+	cfg.fpga_slot     = 0;
+	cfg.num_apps      = 8;
+	cfg.app_shift     = 13;
+	cfg.iters         = 10000;
+	cfg.burst_dwords  = 64;
+	cfg.num_threads   = 8;
+	cfg.use_shm       = 0;
+	cfg.loopback      = 0;
+	cfg.loopback_wait = 1;
+	cfg.format        = FORMAT_CSV;
+
+	// Process command line args
+	for (i = 1; i < argc; i++) {
+		if ((i + 1 < argc) && !strcmp(argv[i], "--slot")) {
+			sscanf(argv[++i], "%d", &cfg.fpga_slot);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--apps")) {
+			sscanf(argv[++i], "%d", &cfg.num_apps);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--app-shift")) {
+			sscanf(argv[++i], "%d", &cfg.app_shift);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--iters")) {
+			sscanf(argv[++i], "%d", &cfg.iters);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--burst")) {
+			sscanf(argv[++i], "%d", &cfg.burst_dwords);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--threads")) {
+			sscanf(argv[++i], "%d", &cfg.num_threads);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--loopback")) {
+			cfg.loopback = 1;
+			sscanf(argv[++i], "%lu", &cfg.loopback_wait);
+		} else if ((i + 1 < argc) && !strcmp(argv[i], "--format")) {
+			i++;
+			if (!strcmp(argv[i], "json")) {
+				cfg.format = FORMAT_JSON;
+			} else if (!strcmp(argv[i], "csv")) {
+				cfg.format = FORMAT_CSV;
+			} else {
+				printf("error: Invalid format: %s\n", argv[i]);
+				usage(argv[0]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--shm")) {
+			cfg.use_shm = 1;
+		} else {
+			printf("error: Invalid arg: %s\n", argv[i]);
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	if ((cfg.iters <= 0) || (cfg.num_apps <= 0) || (cfg.burst_dwords <= 0) ||
+	    (cfg.num_threads <= 0) || (cfg.num_threads > MAX_THREADS) ||
+	    (((uint64_t)cfg.num_apps << cfg.app_shift) > SHM_BAR1_SIZE) ||
+	    (cfg.loopback && (cfg.loopback_wait == 0)) ||
+	    (cfg.loopback && (cfg.num_threads > cfg.num_apps))) {
+		printf("error: Invalid configuration\n");
+		usage(argv[0]);
+		return 1;
+	}
+
+	use_shm = cfg.use_shm;
+
+	if (use_shm) {
+		rc = attach_shm();
+		fail_on(rc, out, "Unable to map the shared memory stand-in\n");
+	} else {
+		/* initialize the fpga_pci library so we could have access to FPGA PCIe from this applications */
+		rc = fpga_pci_init();
+		fail_on(rc, out, "Unable to initialize the fpga_pci library");
+
+		/* check the afi */
+		rc = check_afi_ready(cfg.fpga_slot);
+		fail_on(rc, out, "AFI not ready\n");
+
+		/* Attach to BAR1 */
+		rc = fpga_pci_attach(cfg.fpga_slot, FPGA_APP_PF, APP_PF_BAR1, 0, &pci_bar1_handle);
+		fail_on(rc, out, "Unable to attach to the AFI on slot id %d\n", cfg.fpga_slot);
+	}
+
+	samples = (uint64_t *)malloc(sizeof(uint64_t) * cfg.iters);
+	assert(samples != NULL);
+
+	emit_header(&cfg);
+
+	rc = bench_per_app_latency(&cfg, samples);
+	fail_on(rc, cleanup, "Per app latency benchmark failed\n");
+
+	rc = bench_access_width(&cfg, samples);
+	fail_on(rc, cleanup, "Access width benchmark failed\n");
+
+	rc = bench_burst_write(&cfg, samples);
+	fail_on(rc, cleanup, "Burst write benchmark failed\n");
+
+	rc = bench_concurrent(&cfg);
+	fail_on(rc, cleanup, "Concurrent benchmark failed\n");
+
+cleanup:
+	emit_footer(&cfg);
+	free(samples);
+
+	/* Clean Up */
+	if (use_shm) {
+		munmap((void *)shm_bar1, SHM_BAR1_SIZE);
+	} else if (pci_bar1_handle >= 0) {
+		if (fpga_pci_detach(pci_bar1_handle)) {
+			printf("Failure while detaching from the fpga.\n");
+		}
+	}
+	return rc;
+
+out:
+	return 1;
+}
+
+ int check_afi_ready(int slot_id) {
+   struct fpga_mgmt_image_info info = {0};
+   int rc;
+
+   /* get local image description, contains status, vendor id, and device id. */
+   rc = fpga_mgmt_describe_local_image(slot_id, &info,0);
+   fail_on(rc, out, "Unable to get AFI information from slot %d. Are you running as root?",slot_id);
+
+   /* check to see if the slot is ready */
+   if (info.status != FPGA_STATUS_LOADED) {
+     rc = 1;
+     fail_on(rc, out, "AFI in Slot %d is not in READY state !", slot_id);
+   }
+
+   /* confirm that the AFI that we expect is in fact loaded */
+   if (info.spec.map[FPGA_APP_PF].vendor_id != pci_vendor_id ||
+       info.spec.map[FPGA_APP_PF].device_id != pci_device_id) {
+     rc = fpga_pci_rescan_slot_app_pfs(slot_id);
+     fail_on(rc, out, "Unable to update PF for slot %d",slot_id);
+     /* get local image description, contains status, vendor id, and device id. */
+     rc = fpga_mgmt_describe_local_image(slot_id, &info,0);
+     fail_on(rc, out, "Unable to get AFI information from slot %d",slot_id);
+
+     /* confirm that the AFI that we expect is in fact loaded after rescan */
+     if (info.spec.map[FPGA_APP_PF].vendor_id != pci_vendor_id ||
+         info.spec.map[FPGA_APP_PF].device_id != pci_device_id) {
+       rc = 1;
+       fail_on(rc, out, "The PCI vendor id and device of the loaded AFI are not "
+               "the expected values.");
+     }
+   }
+
+   return rc;
+ out:
+   return 1;
+ }
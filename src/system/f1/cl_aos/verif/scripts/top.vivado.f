@@ -96,8 +96,10 @@ ${AOS_SRC}/RRWCArbiter.sv
 ${AOS_SRC}/RespMerge.sv
 ${AOS_SRC}/TwoInputArbiter.sv
 ${AOS_SRC}/AmorphOSSoftReg.sv
+${AOS_SRC}/AmorphOSStatsSoftReg.sv
 ${AOS_SRC}/AmorphOSPCIE.sv
 ${AOS_SRC}/AmorphOSMem.sv
+${AOS_SRC}/AmorphOSMemStats.sv
 ${AOS_SRC}/AmorphOSMem2SDRAM.sv
 
 # DNN Weaver
@@ -69,6 +69,11 @@ parameter F1_AXIL_rd_resp_FIFO_Depth = 2;
 // Buffer output of the AXIL2SR module
 parameter F1_AXIL_buffer_sr_req_FIFO_Type = 0;
 parameter F1_AXIL_buffer_sr_req_FIFO_Depth = 2;
+// SoftReg window reserved for the OS, above the 8 KB app windows
+// A write anywhere in it latches the memory counters of every app, a read at
+// base + (app << 6) + (counter << 3) returns the latched counter
+parameter F1_OS_STATS_SOFTREG_BASE = 32'h0001_0000;
+parameter F1_OS_STATS_SOFTREG_BITS = 10; // 1 KB, up to 16 apps
 
 // Interface to memory via AXI-4
 